@@ -9,11 +9,18 @@
 #ifndef _SYMTSERIES_H_
 #define _SYMTSERIES_H_
 #include <float.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define STS_MIN_CARDINALITY 2
-#define STS_MAX_CARDINALITY 16
+#define STS_MAX_CARDINALITY 512
+// Largest cardinality representable in SAX notation ('A' to 'P')
+#define STS_MAX_SAX_CARDINALITY 16
 #define STS_STAT_EPS 1e-2
 
 #if defined(_MSC_VER)
@@ -23,14 +30,24 @@
 #endif
 
 
-typedef unsigned char sts_symbol;
+typedef uint16_t sts_symbol;
 
-typedef struct sts_word {
+typedef enum {
+  STS_ENC_SAX, // one symbol of the average per frame
+  STS_ENC_ESAX, // (min, mean, max) symbols per frame, see sts_new_esax_window
+  STS_ENC_1DSAX, // packed mean and slope per frame, see sts_new_1dsax_window
+  STS_ENC_SFA // quantized Fourier coefficients, see sts_new_sfa
+} sts_encoding;
+
+struct sts_word {
   sts_symbol* symbols;
   size_t n_values;
-  size_t w;
-  unsigned char c; // TODO: migrate to multi-cardinal words (for indexing)
-} * sts_word;
+  size_t w; // number of symbols
+  unsigned int c; // TODO: migrate to multi-cardinal words (for indexing)
+  sts_encoding encoding; // words of different encodings aren't comparable
+  unsigned int c_slope; // 1 or STS_ENC_1DSAX slope cardinality
+  const float* breaks; // STS_ENC_SFA breakpoints of the model or NULL
+};
 
 struct sts_ring_buffer
 {
@@ -40,10 +57,78 @@ struct sts_ring_buffer
   size_t finite_cnt; // number of non-nan and non-inf elements
 };
 
-typedef struct sts_window {
+typedef enum {
+  STS_NORM_ZSCORE, // running mean and std of the window
+  STS_NORM_FIXED, // caller-supplied mean and std, see sts_new_fixed_window
+  STS_NORM_ROBUST // running median and MAD, see sts_new_robust_window
+} sts_normalization;
+
+struct sts_order_stats;
+struct sts_frame_extrema;
+struct sts_frame_regression;
+struct sts_sliding_dft;
+
+/*
+ * Symbolic Fourier Approximation model, see sts_new_sfa
+ */
+struct sts_sfa;
+
+/*
+ * Breakpoints tracking the empirical quantiles of normalized frame averages,
+ * see sts_new_adaptive_breakpoints
+ */
+struct sts_breakpoints;
+
+/*
+ * SAX words of the same n, w and c packed one after another for searches,
+ * see sts_new_library
+ */
+struct sts_library;
+
+struct sts_window {
   struct sts_ring_buffer* values;
   struct sts_word current_word;
-} * sts_window;
+  sts_normalization normalization;
+  double* thresholds; // STS_NORM_FIXED breakpoints scaled to raw frame sums
+  struct sts_order_stats* order; // STS_NORM_ROBUST finite values in order
+  struct sts_breakpoints* breakpoints; // adaptive breakpoints (not owned)
+  struct sts_frame_extrema* extrema; // STS_ENC_ESAX sliding frame extrema
+  struct sts_frame_regression* regression; // STS_ENC_1DSAX frame sums
+  struct sts_sfa* sfa; // STS_ENC_SFA model (not owned)
+  struct sts_sliding_dft* dft; // STS_ENC_SFA Fourier coefficients
+  struct sts_append_stats* stats; // STS_ENABLE_STATS instrumentation or NULL
+  uint64_t record_id; // STS_ENABLE_RECORDING session and id, 0 if unseen
+};
+
+/*
+ * Window of d aligned channels sharing timestamps. Ring buffer stores n time
+ * slots of d adjacent values, current_word holds symbols of all channels one
+ * channel after another (channel-major), so that it's the multivariate word
+ * of n * d values and w * d symbols
+ */
+struct sts_mwindow {
+  double* buffer; // n * d values, slot i starts at buffer + i * d
+  size_t n, d, w;
+  size_t head; // oldest slot
+  double* mu, * s2; // per channel on-line statistics
+  size_t* finite_cnt;
+  double* frame_sums; // d scratch values for word updates
+  size_t* frame_sizes;
+  struct sts_word current_word;
+};
+
+/*
+ * Handles of the C API. C++ shares one namespace between struct tags and
+ * typedefs, so it names these types struct pointers, see symtseries.hpp
+ */
+#ifndef __cplusplus
+typedef struct sts_word* sts_word;
+typedef struct sts_window* sts_window;
+typedef struct sts_mwindow* sts_mwindow;
+typedef struct sts_sfa* sts_sfa;
+typedef struct sts_breakpoints* sts_breakpoints;
+typedef struct sts_library* sts_library;
+#endif
 
 /**
  * Initializes empty window-like-container
@@ -53,7 +138,184 @@ typedef struct sts_window {
  * @return NULL on failure or allocated window
  *
  */
-sts_window sts_new_window(size_t n, size_t w, unsigned char c);
+struct sts_window* sts_new_window(size_t n, size_t w, unsigned int c);
+
+/**
+ * Bytes of caller storage sts_init_window needs
+ * @param n size of the window
+ * @param w length of the produced code
+ * @return size of the window, its ring buffer and its symbols together
+ */
+size_t sts_window_storage_size(size_t n, size_t w);
+
+/**
+ * Same as sts_new_window constructing the window in caller's storage, e.g.
+ * Lua userdata, without allocations. The window is released with its storage
+ * and must not be passed to sts_free_window
+ * @param storage sts_window_storage_size(n, w) bytes aligned for double
+ * @param n
+ * @param w
+ * @param c
+ * @return NULL on failure or the window at the start of storage
+ */
+struct sts_window* sts_init_window(void* storage,
+                                   size_t n,
+                                   size_t w,
+                                   unsigned int c);
+
+/**
+ * Initializes empty window which normalizes values with the provided mean and
+ * standard deviation instead of the ones of the window. Running statistics
+ * aren't maintained and breakpoints are scaled once, so that frames are
+ * quantized by plain comparisons of their sums. Use mu = 0 and sigma = 1 to
+ * quantize raw values.
+ * @param n size of the window
+ * @param w length of the produced code, should be divisor of n
+ * @param c code's cardinality
+ * @param mu mean of the series
+ * @param sigma standard deviation of the series, should be positive
+ * @return NULL on failure or allocated window
+ */
+struct sts_window* sts_new_fixed_window(size_t n,
+                                        size_t w,
+                                        unsigned int c,
+                                        double mu,
+                                        double sigma);
+
+/**
+ * Initializes empty window which normalizes values with the median and the
+ * median absolute deviation (scaled to be consistent with the standard
+ * deviation of normal distribution) of its finite values instead of their
+ * mean and standard deviation, so that outliers don't flatten the word.
+ * Values are kept in order statistics tree, an append takes O(log n) and
+ * producing a word O(log^2 n + n).
+ * @param n size of the window
+ * @param w length of the produced code, should be divisor of n
+ * @param c code's cardinality
+ * @return NULL on failure or allocated window
+ */
+struct sts_window* sts_new_robust_window(size_t n, size_t w, unsigned int c);
+
+/**
+ * Initializes adaptive breakpoints of cardinality c. They start as the
+ * Gaussian ones and, after 10 * c values, follow the i / c quantiles of the
+ * added values estimated with P^2 algorithm, which takes O(c) time and memory
+ * per value. Published breakpoints only change once some estimate drifts
+ * further than tolerance, words and distances of heavy-tailed or skewed data
+ * are then balanced.
+ * Breakpoints aren't thread-safe and can be shared by several windows.
+ * @param c cardinality of the breakpoints
+ * @param tolerance largest allowed drift of published breakpoints
+ * @return NULL on failure or allocated breakpoints
+ */
+struct sts_breakpoints* sts_new_adaptive_breakpoints(unsigned int c,
+                                                    double tolerance);
+
+/**
+ * Updates quantile estimates with value, non-finite values are ignored
+ * @param bp breakpoints to be updated
+ * @param value normalized frame average
+ * @return true if published breakpoints have changed
+ */
+bool sts_breakpoints_add(struct sts_breakpoints* bp, double value);
+
+/**
+ * @param bp breakpoints
+ * @return bp->c - 1 ascending breakpoints currently used for quantization or
+ * NULL on failure
+ */
+const float* sts_breakpoints_values(const struct sts_breakpoints* bp);
+
+/**
+ * Frees allocated breakpoints, windows using them have to be freed first
+ * @param bp pre-allocated breakpoints
+ */
+void sts_free_breakpoints(struct sts_breakpoints* bp);
+
+/**
+ * Initializes empty z-normalizing window which quantizes with bp instead of
+ * the Gaussian breakpoints and trains bp with the average of its newest frame
+ * on each appended value. Words of such windows should be compared with
+ * sts_adaptive_mindist.
+ * @param n size of the window
+ * @param w length of the produced code, should be divisor of n
+ * @param bp breakpoints which define code's cardinality, not owned by window
+ * @return NULL on failure or allocated window
+ */
+struct sts_window* sts_new_adaptive_window(size_t n,
+                                           size_t w,
+                                           struct sts_breakpoints* bp);
+
+/**
+ * Initializes empty window producing Extended SAX words: every frame is
+ * encoded with 3 symbols of its normalized minimum, average and maximum, so
+ * that spikes hidden by the average remain visible. Frame extrema are kept in
+ * monotonic deques, an append takes amortized O(w).
+ * @param n size of the window
+ * @param w number of frames, should be divisor of n, words have 3 * w symbols
+ * @param c code's cardinality
+ * @return NULL on failure or allocated window
+ */
+struct sts_window* sts_new_esax_window(size_t n, size_t w, unsigned int c);
+
+/**
+ * Initializes empty window producing 1d-SAX words: every frame is encoded
+ * with a single symbol packing the symbol of its normalized average and the
+ * one of the slope of its linear regression, mean * c_slope + slope. All-NaN
+ * frames are encoded with c * c_slope. Slopes are quantized with Gaussian
+ * breakpoints of variance 0.03 / (n / w) as proposed in the 1d-SAX paper.
+ * Regression sums of frames are updated incrementally, an append takes O(w)
+ * and so does producing a word.
+ * @param n size of the window
+ * @param w length of the produced code, should be divisor of n
+ * @param c cardinality of averages
+ * @param c_slope cardinality of slopes, c * c_slope should fit sts_symbol
+ * @return NULL on failure or allocated window
+ */
+struct sts_window* sts_new_1dsax_window(size_t n,
+                                        size_t w,
+                                        unsigned int c,
+                                        unsigned int c_slope);
+
+/**
+ * Initializes Symbolic Fourier Approximation model. Words of the model encode
+ * windows of n values with w symbols: real and imaginary parts of DFT
+ * coefficients 1, 2, ..., (w + 1) / 2 of z-normalized window scaled by
+ * sqrt(2 / n), every position quantized with its own breakpoints (Multiple
+ * Coefficient Binning). Breakpoints are the ones of N(0, 1) until the model is
+ * trained with sts_sfa_train. Words keep a pointer to the model breakpoints,
+ * so the model should outlive them and mustn't be retrained in the meantime.
+ * @param n size of encoded windows
+ * @param w length of the produced code, (w + 1) / 2 < n / 2
+ * @param c code's cardinality
+ * @return NULL on failure or allocated model
+ */
+struct sts_sfa* sts_new_sfa(size_t n, size_t w, unsigned int c);
+
+/**
+ * Sets breakpoints of every position by equi-depth binning of the
+ * coefficients of all sliding windows of series without non-finite values
+ * @param sfa model to be trained
+ * @param series training series
+ * @param n_values number of elements in series, at least sfa's n
+ * @return false on failure (no finite window) and true otherwise
+ */
+bool sts_sfa_train(struct sts_sfa* sfa, const double* series, size_t n_values);
+
+/**
+ * Frees allocated model, its words and windows have to be freed first
+ * @param sfa pre-allocated model
+ */
+void sts_free_sfa(struct sts_sfa* sfa);
+
+/**
+ * Initializes empty window producing SFA words of the model. Coefficients are
+ * maintained with sliding DFT, an append takes O(w). Windows containing
+ * non-finite values produce words of NaN symbols.
+ * @param sfa model, not owned by window
+ * @return NULL on failure or allocated window
+ */
+struct sts_window* sts_new_sfa_window(struct sts_sfa* sfa);
 
 /**
  * Appends new value to the end of the window
@@ -65,7 +327,8 @@ sts_window sts_new_window(size_t n, size_t w, unsigned char c);
  * to construct a word, NULL otherwise. sts_dup_word to store it
  *
  */
-const struct sts_word* sts_append_value(sts_window window, double value);
+const struct sts_word* sts_append_value(struct sts_window* window,
+                                        double value);
 
 /**
  * Appends provided array. Only the last word is stored in window->current_word.
@@ -77,7 +340,233 @@ const struct sts_word* sts_append_value(sts_window window, double value);
  *
  */
 const struct sts_word*
-sts_append_array(sts_window window, const double* values, size_t n_values);
+sts_append_array(struct sts_window* window,
+                 const double* values,
+                 size_t n_values);
+
+/**
+ * Same as sts_append_array for arrays of floats, values are widened to double
+ * one at a time, the window stores doubles
+ * @return pointer to updated window->current_word or NULL on failure
+ */
+const struct sts_word* sts_append_float_array(struct sts_window* window,
+                                              const float* values,
+                                              size_t n_values);
+
+/**
+ * Same as sts_append_array for arrays of 32-bit integers
+ * @return pointer to updated window->current_word or NULL on failure
+ */
+const struct sts_word* sts_append_int32_array(struct sts_window* window,
+                                              const int32_t* values,
+                                              size_t n_values);
+
+/**
+ * Same as sts_append_array for arrays of 64-bit integers
+ * @return pointer to updated window->current_word or NULL on failure
+ */
+const struct sts_word* sts_append_int64_array(struct sts_window* window,
+                                              const int64_t* values,
+                                              size_t n_values);
+
+/**
+ * Appends rows of interleaved channels into a bank of windows, one window per
+ * channel, in a single pass over the rows. Value of channel j at row i is
+ * base[i * stride + j]. Words of all windows are updated once at the end.
+ * @param windows array of n_channels windows, sizes may differ
+ * @param n_channels number of channels
+ * @param base first row
+ * @param n_rows number of rows
+ * @param stride number of elements between the starts of consecutive rows,
+ * at least n_channels
+ * @return false on failure (nothing is appended then), true otherwise
+ */
+bool sts_append_strided(struct sts_window** windows,
+                        size_t n_channels,
+                        const double* base,
+                        size_t n_rows,
+                        size_t stride);
+
+/**
+ * Same as sts_append_value for feeds guaranteed to be finite (checked with
+ * assert in debug builds). Once a z-normalized SAX window is full of finite
+ * values appends take a path without NaN and infinity checks in ring buffer,
+ * statistics and PAA, other windows fall back to sts_append_value. Appending
+ * non-finite value in release build is undefined.
+ * @param window window to be updated
+ * @param value finite value to be appended
+ * @return pointer to updated window->current_word or NULL on failure
+ */
+const struct sts_word* sts_append_finite_value(struct sts_window* window,
+                                               double value);
+
+/**
+ * Same as sts_append_array for arrays of finite values, see
+ * sts_append_finite_value
+ * @return pointer to updated window->current_word or NULL on failure
+ */
+const struct sts_word* sts_append_finite_array(struct sts_window* window,
+                                               const double* values,
+                                               size_t n_values);
+
+/**
+ * Appends values one at a time and writes the word after every append, one
+ * after another. Z-normalized SAX windows compute the words with the sums of
+ * sts_sliding_words in O(w) each and append the values at the end, words may
+ * then differ from the ones of sts_append_value where a frame average is
+ * within rounding error of a breakpoint. Other windows append value by value.
+ * @param window window to be updated
+ * @param values values to be appended
+ * @param n_values number of elements in values
+ * @param out storage for n_values * window->current_word.w symbols
+ * @return false on failure and true otherwise
+ */
+bool sts_append_collect(struct sts_window* window,
+                        const double* values,
+                        size_t n_values,
+                        sts_symbol* out);
+
+/**
+ * Initializes empty multivariate window, every channel is z-normalized with
+ * its own statistics
+ * @param n size of the window in time slots
+ * @param w length of the code of each channel, should be divisor of n
+ * @param c code's cardinality
+ * @param d number of channels
+ * @return NULL on failure or allocated window
+ */
+struct sts_mwindow* sts_new_mwindow(size_t n,
+                                    size_t w,
+                                    unsigned int c,
+                                    size_t d);
+
+/**
+ * Appends one time step to all channels
+ * @param mw window to be updated
+ * @param values d values of the time step
+ * @return pointer to updated multivariate word mw->current_word or NULL on
+ * failure. sts_mindist of two such words lowerbounds the euclidean distance
+ * over all channels, sts_mwindow_channel gives words of single channels
+ */
+const struct sts_word* sts_mwindow_append(struct sts_mwindow* mw,
+                                          const double* values);
+
+/**
+ * Fills view with the word of channel k, which symbols point into
+ * mw->current_word, so it's valid until the next append
+ * @param mw window
+ * @param k channel
+ * @param view word to be filled, sts_dup_word to store it
+ * @return false on failure and true otherwise
+ */
+bool sts_mwindow_channel(const struct sts_mwindow* mw,
+                         size_t k,
+                         struct sts_word* view);
+
+/**
+ * Resets all channels of multivariate window to zero size
+ * @param mw window to be reset
+ * @return false if the window was malformed and true otherwise
+ */
+bool sts_reset_mwindow(struct sts_mwindow* mw);
+
+/**
+ * Frees allocated multivariate window
+ * @param mw pre-allocated window
+ */
+void sts_free_mwindow(struct sts_mwindow* mw);
+
+/**
+ * Name of the kernels encoding words: "avx512", "avx2", "sse4.2" or
+ * "scalar". The best set the CPU supports is picked when the library is
+ * loaded unless the STS_KERNEL environment variable names another supported
+ * one. All sets produce identical words
+ * @return name of the active kernel set
+ */
+const char* sts_active_kernel(void);
+
+/**
+ * Switches kernels, e.g. for benchmarks. Not synchronized with encoding
+ * in other threads
+ * @param name one of the names sts_active_kernel returns
+ * @return false if the set is unknown or unsupported by the CPU
+ */
+bool sts_select_kernel(const char* name);
+
+/*
+ * Latency buckets: durations below 8 ns have one bucket each, every further
+ * power of two is split into 8 buckets, bounds stay within 12.5% up to 2^40 ns
+ */
+#define STS_STATS_BUCKETS 304
+
+/*
+ * Append instrumentation of a window, see sts_get_window_stats
+ */
+struct sts_window_stats {
+  uint64_t appends; // values appended
+  uint64_t recomputes; // word updates, one per append call
+  uint64_t nan_frames; // symbols of all-NaN frames summed over updates
+  uint64_t word_changes; // updates which changed the word
+  uint64_t latency[STS_STATS_BUCKETS]; // append calls by duration
+};
+
+/**
+ * Reads append counters and the latency histogram of a window. Windows count
+ * in builds with STS_ENABLE_STATS defined only. Reading doesn't block the
+ * thread appending to the window, every field is read atomically, but not
+ * all of them at once
+ * @param window window to read
+ * @param stats snapshot to fill
+ * @return false if the build or the window has no instrumentation
+ */
+bool sts_get_window_stats(const struct sts_window* window,
+                          struct sts_window_stats* stats);
+
+/**
+ * Latency quantile of append calls, snapshots of several windows can be
+ * summed into one beforehand
+ * @param stats snapshot of sts_get_window_stats
+ * @param q quantile in [0, 1], e.g. 0.99 or 0.999
+ * @return upper bound of the bucket holding the quantile in ns, 0 if there
+ * were no append calls
+ */
+uint64_t sts_stats_percentile(const struct sts_window_stats* stats, double q);
+
+/*
+ * Recordings start with the 8 bytes "STSREC1" and NUL followed by records of
+ * little-endian fields, each record starts with a one byte tag:
+ * 'W' window seen for the first time: u32 id, u64 n, u64 w (frames), u32 c,
+ *     u32 c_slope, u8 sts_normalization, u8 sts_encoding, u8 adaptive
+ * 'V' sts_append_value: u32 id, u64 ns since start, f64 value, u64 hash
+ * 'A' sts_append_array: u32 id, u64 ns since start, u64 count, count f64
+ *     values (the last n of the call), u64 hash
+ * 'R' sts_reset_window: u32 id, u64 ns since start
+ * 'U' window appended to by a call that isn't recorded, none of its later
+ *     calls are: u32 id, u64 ns since start
+ * hash is 64-bit FNV-1a of the little-endian u16 symbols of the returned word
+ */
+#define STS_RECORD_MAGIC "STSREC1"
+
+/**
+ * Starts logging every sts_append_value, sts_append_array and
+ * sts_reset_window call of windows created from now on to a file, see
+ * STS_RECORD_MAGIC for the format. Windows created before aren't recorded,
+ * their values are unknown to a replay. Recording of a window stops at its
+ * first sts_append_finite_*, typed or sts_append_strided append.
+ * sts_append_collect is recorded as the appends it makes. Available in GCC
+ * and Clang builds with STS_ENABLE_RECORDING defined, calls of several
+ * threads are serialized
+ * @param path file to create or truncate
+ * @return false if the build doesn't record, recording is in progress or the
+ * file can't be opened
+ */
+bool sts_start_recording(const char* path);
+
+/**
+ * Stops recording and closes the file
+ * @return false if nothing was recorded or the file couldn't be written
+ */
+bool sts_stop_recording(void);
 
 /**
  * Returns symbolic representation of series which doesn't store initial values
@@ -87,25 +576,214 @@ sts_append_array(sts_window window, const double* values, size_t n_values);
  * @param c
  * @return NULL on failure or freshly-alocated sts_word
  */
-sts_word sts_from_double_array(const double* series,
-                               size_t n_values,
-                               size_t w,
-                               unsigned int c);
+struct sts_word* sts_from_double_array(const double* series,
+                                       size_t n_values,
+                                       size_t w,
+                                       unsigned int c);
+
+/**
+ * Same as sts_from_double_array writing into caller's storage
+ * @param series
+ * @param n_values
+ * @param w
+ * @param c
+ * @param out word to be filled, out->symbols has to hold w symbols
+ * @return false on failure and true otherwise
+ */
+bool sts_from_double_array_into(const double* series,
+                                size_t n_values,
+                                size_t w,
+                                unsigned int c,
+                                struct sts_word* out);
+
+/**
+ * SAX words of the sliding windows of n values of series starting at every
+ * stride-th position, as sts_from_double_array would encode each of them.
+ * Frame sums and statistics come from prefix sums, so a word takes O(w)
+ * instead of O(n); words may differ where a frame average is within rounding
+ * error of a breakpoint.
+ * @param series
+ * @param n_values number of elements in series
+ * @param n size of encoded windows
+ * @param w length of each word, should be divisor of n
+ * @param c
+ * @param stride distance between the starts of consecutive windows, >= 1
+ * @param out storage for ((n_values - n) / stride + 1) * w symbols, words
+ * are written one after another
+ * @return number of words written, 0 on failure or if n_values < n
+ */
+size_t sts_sliding_words(const double* series,
+                         size_t n_values,
+                         size_t n,
+                         size_t w,
+                         unsigned int c,
+                         size_t stride,
+                         sts_symbol* out);
+
+/**
+ * Same as sts_from_double_array for series of floats, values are widened to
+ * double while being averaged
+ * @return NULL on failure or freshly-alocated sts_word
+ */
+struct sts_word* sts_from_float_array(const float* series,
+                                      size_t n_values,
+                                      size_t w,
+                                      unsigned int c);
+
+/**
+ * Same as sts_from_double_array for series of 32-bit integers
+ * @return NULL on failure or freshly-alocated sts_word
+ */
+struct sts_word* sts_from_int32_array(const int32_t* series,
+                                      size_t n_values,
+                                      size_t w,
+                                      unsigned int c);
+
+/**
+ * Same as sts_from_double_array for series of 64-bit integers, values above
+ * 2^53 in magnitude are rounded to the nearest double
+ * @return NULL on failure or freshly-alocated sts_word
+ */
+struct sts_word* sts_from_int64_array(const int64_t* series,
+                                      size_t n_values,
+                                      size_t w,
+                                      unsigned int c);
+
+/**
+ * Same as sts_from_double_array, but normalizes series with its median and
+ * median absolute deviation, see sts_new_robust_window
+ * @return NULL on failure or freshly-alocated sts_word
+ */
+struct sts_word* sts_from_double_array_robust(const double* series,
+                                              size_t n_values,
+                                              size_t w,
+                                              unsigned int c);
+
+/**
+ * Same as sts_from_double_array, but normalizes series with the provided mean
+ * and standard deviation, see sts_new_fixed_window
+ * @return NULL on failure or freshly-alocated sts_word
+ */
+struct sts_word* sts_from_double_array_fixed(const double* series,
+                                             size_t n_values,
+                                             size_t w,
+                                             unsigned int c,
+                                             double mu,
+                                             double sigma);
+
+/**
+ * Same as sts_from_double_array, but produces Extended SAX word, see
+ * sts_new_esax_window
+ * @param w number of frames, the word has 3 * w symbols
+ * @return NULL on failure or freshly-alocated sts_word
+ */
+struct sts_word* sts_from_double_array_esax(const double* series,
+                                            size_t n_values,
+                                            size_t w,
+                                            unsigned int c);
+
+/**
+ * Same as sts_from_double_array, but produces 1d-SAX word, see
+ * sts_new_1dsax_window
+ * @return NULL on failure or freshly-alocated sts_word
+ */
+struct sts_word* sts_from_double_array_1dsax(const double* series,
+                                             size_t n_values,
+                                             size_t w,
+                                             unsigned int c,
+                                             unsigned int c_slope);
+
+/**
+ * Returns SFA word of the series, see sts_new_sfa
+ * @param series series to be converted
+ * @param n_values number of elements in series, should be equal to sfa's n
+ * @param sfa model
+ * @return NULL on failure or freshly-alocated sts_word
+ */
+struct sts_word* sts_from_double_array_sfa(const double* series,
+                                           size_t n_values,
+                                           const struct sts_sfa* sfa);
+
+/**
+ * Converts series into words of several cardinalities while computing PAA and
+ * quantizing it only once. Cardinalities dividing the largest requested one
+ * are derived from its symbols, the rest are quantized from the stored PAA.
+ * @param series series to be converted
+ * @param n_values number of elements in series
+ * @param w length of produced words, should be divisor of n_values
+ * @param c array of requested cardinalities
+ * @param n_c number of requested cardinalities
+ * @param out array of n_c words, out[i] receives the word of cardinality c[i]
+ * @return false on failure (nothing is allocated then), true otherwise
+ */
+bool sts_from_double_array_multi(const double* series,
+                                 size_t n_values,
+                                 size_t w,
+                                 const unsigned int* c,
+                                 size_t n_c,
+                                 struct sts_word** out);
+
+/**
+ * Converts interleaved channels into one word per channel in a single pass
+ * over the rows, without gathering channels into temporary arrays. Value of
+ * channel j at row i is base[i * stride + j]. Words are the ones
+ * sts_from_double_array produces for every channel.
+ * @param base first row
+ * @param n_values number of rows
+ * @param stride number of elements between the starts of consecutive rows,
+ * at least n_channels
+ * @param n_channels number of channels
+ * @param w length of produced words, should be divisor of n_values
+ * @param c cardinality of produced words
+ * @param out array of n_channels words, out[j] receives the word of channel j
+ * @return false on failure (nothing is allocated then), true otherwise
+ */
+bool sts_from_strided_array(const double* base,
+                            size_t n_values,
+                            size_t stride,
+                            size_t n_channels,
+                            size_t w,
+                            unsigned int c,
+                            struct sts_word** out);
+
+/**
+ * Derives the word of a lower cardinality from a higher-cardinality one
+ * without revisiting the original series. iSAX breakpoints of c are a subset
+ * of the ones of a->c whenever c divides a->c (e.g. 4 and 8 of 16), so every
+ * symbol of a maps onto exactly one symbol of the result.
+ * @param a word to be reduced
+ * @param c cardinality of the result, should be a divisor of a->c
+ * @return NULL on failure or freshly-allocated sts_word
+ */
+struct sts_word* sts_word_to_cardinality(const struct sts_word* a,
+                                         unsigned int c);
 
 /**
  * Constructs word from symbolic representation, e.g. "AABBC"
  * @param symbols symbolic representation in SAX notation
- * @param c cardinality of the word
+ * @param c cardinality of the word, at most STS_MAX_SAX_CARDINALITY
  * @return NULL on failure (illegal symbols for cardinality or unprocessable
  * cardinality itself) or freshly-allocated sts_word with
  * sts_word.w == strlen(symbols)
  */
-sts_word sts_from_sax_string(const char* symbols, unsigned char c);
+struct sts_word* sts_from_sax_string(const char* symbols, unsigned int c);
+
+/**
+ * Same as sts_from_sax_string writing into caller's storage
+ * @param symbols
+ * @param c
+ * @param out word to be filled, out->symbols has to hold strlen(symbols)
+ * symbols
+ * @return false on failure and true otherwise
+ */
+bool sts_from_sax_string_into(const char* symbols,
+                              unsigned int c,
+                              struct sts_word* out);
 
 /**
  * @param a word
- * @return NULL on failure (illegal symbols for cardinality) or SAX string
- * corresponding to a
+ * @return NULL on failure (illegal symbols for cardinality or cardinality
+ * above STS_MAX_SAX_CARDINALITY) or SAX string corresponding to a
  */
 char* sts_word_to_sax_string(const struct sts_word* a);
 
@@ -122,6 +800,14 @@ char* sts_word_to_sax_string(const struct sts_word* a);
  * mindist("E", "#") == mindist("E", "A") // furthest symbol away
  * mindist("C", "#") == mindist("C", "A") // equal distant maps to lowest
  * mindist("#", "#") == 0
+ * @note 1d-SAX words are compared by their averages only, which keeps the
+ * lower bound.
+ * @note SFA words of the same model are compared with per-position
+ * breakpoints and without compression factor.
+ * @note Extended SAX words are compared symbol-wise with n / (3 * frames)
+ * compression as in the ESAX paper, which isn't a lower bound on distance
+ * anymore since extrema symbols are included. Words of different encodings
+ * yield NaN.
  *
  */
 double sts_mindist(const struct sts_word* a, const struct sts_word* b);
@@ -141,6 +827,89 @@ double sts_mindist_ab(const struct sts_word* a,
                       double* above,
                       double* below);
 
+/**
+ * Same as sts_mindist for words quantized with adaptive breakpoints. Distance
+ * table is regenerated lazily after published breakpoints have changed.
+ * @param bp breakpoints of the words
+ * @param a word 1
+ * @param b word 2
+ * @return NaN on failure, otherwise minimum possible distance between
+ * original series under current breakpoints
+ */
+double sts_adaptive_mindist(struct sts_breakpoints* bp,
+                            const struct sts_word* a,
+                            const struct sts_word* b);
+
+/**
+ * Initializes empty library of SAX words
+ * @param n number of values words represent
+ * @param w length of words
+ * @param c words' cardinality
+ * @return NULL on failure or allocated library
+ */
+struct sts_library* sts_new_library(size_t n, size_t w, unsigned int c);
+
+/**
+ * Copies symbols of word to the end of the library
+ * @param lib library
+ * @param word SAX word of the library's w and c and n or 0 values
+ * @return false if word doesn't fit the library or on failure
+ */
+bool sts_library_add(struct sts_library* lib, const struct sts_word* word);
+
+/**
+ * Removes all words of the library, keeping its memory for further adds
+ * @param lib library
+ * @return false if lib is NULL
+ */
+bool sts_library_clear(struct sts_library* lib);
+
+/**
+ * @param lib library
+ * @return number of words in lib
+ */
+size_t sts_library_size(const struct sts_library* lib);
+
+/**
+ * Fills view with i-th word of the library, which symbols point into the
+ * library, so it's valid until the next sts_library_add
+ * @param lib library
+ * @param i index of the word
+ * @param view word to be filled, sts_dup_word to store it
+ * @return false on failure and true otherwise
+ */
+bool sts_library_word(const struct sts_library* lib,
+                      size_t i,
+                      struct sts_word* view);
+
+/**
+ * Finds up to k words of the library closest to query by sts_mindist. A
+ * table of distances from the query's symbols is built once, then every
+ * word costs w lookups and is abandoned as soon as it gets farther than the
+ * k-th closest one so far or threshold.
+ * @param lib library
+ * @param query word comparable with the words of the library
+ * @param k maximum number of words to find
+ * @param threshold non-negative, words farther than it are skipped, INFINITY
+ * for none
+ * @param indices storage for k indices of found words, closest first, ties
+ * ordered by index
+ * @param distances storage for k mindists of found words
+ * @return number of words found, 0 on failure
+ */
+size_t sts_library_nearest(const struct sts_library* lib,
+                           const struct sts_word* query,
+                           size_t k,
+                           double threshold,
+                           size_t* indices,
+                           double* distances);
+
+/**
+ * Frees allocated library
+ * @param lib pre-allocated library
+ */
+void sts_free_library(struct sts_library* lib);
+
 /**
  * Returns whether to words are considered equal in terms of w, c and
  * representation
@@ -157,13 +926,13 @@ bool sts_words_equal(const struct sts_word* a, const struct sts_word* b);
  * Frees allocated memory for sax representation
  * @param a pre-allocated word which contents should be freed
  */
-void sts_free_word(sts_word a);
+void sts_free_word(struct sts_word* a);
 
 /**
  * Frees allocated window
  * @param w pre-allocated window
  */
-void sts_free_window(sts_window w);
+void sts_free_window(struct sts_window* w);
 
 /**
  * Resets a->values->cnt to zero and adjusts ring buffer accordingly
@@ -171,12 +940,16 @@ void sts_free_window(sts_window w);
  * @return true in case of successfull reset and false if the window was
  * malformed
  */
-bool sts_reset_window(sts_window w);
+bool sts_reset_window(struct sts_window* w);
 
 /**
  * @param a word to be copied
  * @return freshly-allocated copy of the provided word or NULL on failure
  */
-sts_word sts_dup_word(const struct sts_word* a);
+struct sts_word* sts_dup_word(const struct sts_word* a);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
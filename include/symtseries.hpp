@@ -0,0 +1,446 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Header-only C++17 layer over symtseries.h. Windows own their C window and
+ * are move-only, words keep their symbols inline and never touch the heap. */
+
+#ifndef _SYMTSERIES_HPP_
+#define _SYMTSERIES_HPP_
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "symtseries.h"
+
+namespace sts {
+
+namespace detail {
+
+/*
+ * i / c quantiles of N(0, 1) for c up to STS_MAX_SAX_CARDINALITY, row of c
+ * starts at (c - 2) * (c - 1) / 2. Same values as exact_break in symtseries.c
+ */
+inline constexpr double exact_breaks[] = {
+  // c = 2
+  0,
+  // c = 3
+  -0.43072729929545756, 0.43072729929545756,
+  // c = 4
+  -0.67448975019608182, 0, 0.67448975019608182,
+  // c = 5
+  -0.84162123357291418, -0.25334710313579978, 0.25334710313579978,
+  0.84162123357291418,
+  // c = 6
+  -0.96742156610170116, -0.43072729929545756, 0, 0.43072729929545756,
+  0.96742156610170116,
+  // c = 7
+  -1.0675705238781419, -0.56594882193286311, -0.18001236979270513,
+  0.18001236979270513, 0.56594882193286311, 1.0675705238781419,
+  // c = 8
+  -1.1503493803760083, -0.67448975019608182, -0.31863936396437514, 0,
+  0.31863936396437514, 0.67448975019608182, 1.1503493803760083,
+  // c = 9
+  -1.2206403488473498, -0.76470967378638721, -0.43072729929545756,
+  -0.13971029888186207, 0.13971029888186207, 0.43072729929545756,
+  0.76470967378638721, 1.2206403488473498,
+  // c = 10
+  -1.2815515655446004, -0.84162123357291418, -0.52440051270804078,
+  -0.25334710313579978, 0, 0.25334710313579978, 0.52440051270804078,
+  0.84162123357291418, 1.2815515655446004,
+  // c = 11
+  -1.3351777361189368, -0.90845786853738519, -0.60458534658323726,
+  -0.34875569551704472, -0.11418529432142838, 0.11418529432142838,
+  0.34875569551704472, 0.60458534658323726, 0.90845786853738519,
+  1.3351777361189368,
+  // c = 12
+  -1.3829941271006383, -0.96742156610170116, -0.67448975019608182,
+  -0.43072729929545756, -0.21042839424792467, 0, 0.21042839424792467,
+  0.43072729929545756, 0.67448975019608182, 0.96742156610170116,
+  1.3829941271006383,
+  // c = 13
+  -1.4260768722728472, -1.0200762327862016, -0.73631591737612956,
+  -0.50240222337335538, -0.29338123212119332, -0.096558615289639105,
+  0.096558615289639105, 0.29338123212119332, 0.50240222337335538,
+  0.73631591737612956, 1.0200762327862016, 1.4260768722728472,
+  // c = 14
+  -1.4652337926855228, -1.0675705238781419, -0.79163860774337458,
+  -0.56594882193286311, -0.36610635680056969, -0.18001236979270513, 0,
+  0.18001236979270513, 0.36610635680056969, 0.56594882193286311,
+  0.79163860774337458, 1.0675705238781419, 1.4652337926855228,
+  // c = 15
+  -1.5010859460440249, -1.1107716166367856, -0.84162123357291418,
+  -0.62292572321008766, -0.43072729929545756, -0.25334710313579978,
+  -0.083651733907129072, 0.083651733907129072, 0.25334710313579978,
+  0.43072729929545756, 0.62292572321008766, 0.84162123357291418,
+  1.1107716166367856, 1.5010859460440249,
+  // c = 16
+  -1.5341205443525465, -1.1503493803760083, -0.88714655901887607,
+  -0.67448975019608182, -0.48877641111466957, -0.31863936396437514,
+  -0.15731068461017075, 0, 0.15731068461017075, 0.31863936396437514,
+  0.48877641111466957, 0.67448975019608182, 0.88714655901887607,
+  1.1503493803760083, 1.5341205443525465
+};
+
+constexpr double exact_break(unsigned int i, unsigned int c)
+{
+  return exact_breaks[(c - 2) * (c - 1) / 2 + i - 1];
+}
+
+// std::trunc and std::floor aren't constexpr, values here are small
+constexpr double trunc_milli(double value)
+{
+  return static_cast<double>(static_cast<long long>(value * 1000)) / 1000;
+}
+
+constexpr double round_milli(double value)
+{
+  return static_cast<double>(static_cast<long long>(value * 1000 + 0.5))
+         / 1000;
+}
+
+template <unsigned int C>
+constexpr std::array<float, C - 1> make_breakpoints()
+{
+  static_assert(C >= STS_MIN_CARDINALITY && C <= STS_MAX_SAX_CARDINALITY,
+                "constexpr tables cover SAX cardinalities only");
+  std::array<float, C - 1> row{};
+  for (unsigned int i = 1; i < C; ++i) {
+    row[i - 1] = static_cast<float>(trunc_milli(exact_break(i, C)));
+  }
+  return row;
+}
+
+template <unsigned int C>
+constexpr std::array<float, C * C> make_distances()
+{
+  static_assert(C >= STS_MIN_CARDINALITY && C <= STS_MAX_SAX_CARDINALITY,
+                "constexpr tables cover SAX cardinalities only");
+  std::array<float, C * C> dist{};
+  for (unsigned int sa = 0; sa < C; ++sa) {
+    for (unsigned int sb = 0; sb < C; ++sb) {
+      // internally we use the reversed iSAX ordering
+      unsigned int lo = C - 1 - (sa > sb ? sa : sb);
+      unsigned int hi = C - 1 - (sa > sb ? sb : sa);
+      double d = hi - lo > 1 ? exact_break(hi, C) - exact_break(lo + 1, C) : 0;
+      dist[sa * C + sb] = static_cast<float>(round_milli(d));
+    }
+  }
+  return dist;
+}
+
+} // namespace detail
+
+/**
+ * Gaussian breakpoints of cardinality C in ascending order, identical to the
+ * ones the library quantizes with
+ */
+template <unsigned int C>
+inline constexpr std::array<float, C - 1> breakpoints =
+  detail::make_breakpoints<C>();
+
+/**
+ * C * C table of lowerbounding distances between symbols of cardinality C,
+ * identical to the one of sts_mindist
+ */
+template <unsigned int C>
+inline constexpr std::array<float, C * C> distances =
+  detail::make_distances<C>();
+
+/**
+ * SAX word of W symbols of cardinality C stored inline, so it's copied and
+ * moved without allocations
+ */
+template <std::size_t W, unsigned int C>
+class Word {
+  static_assert(W > 0, "word needs at least one symbol");
+  static_assert(C >= STS_MIN_CARDINALITY && C <= STS_MAX_CARDINALITY,
+                "cardinality out of range");
+
+public:
+  Word() = default;
+
+  /**
+   * Encodes series, same as sts_from_double_array
+   * @param series
+   * @param n_values should be a multiple of W
+   * @return std::nullopt on failure or the word
+   */
+  static std::optional<Word> encode(const double* series,
+                                    std::size_t n_values) noexcept
+  {
+    Word word;
+    struct sts_word view = word.view();
+    if (!sts_from_double_array_into(series, n_values, W, C, &view)) {
+      return std::nullopt;
+    }
+    word.n_values_ = n_values;
+    return word;
+  }
+
+  /**
+   * Copies symbols of a C word, e.g. the current word of a window
+   * @param word SAX word of W symbols of cardinality C
+   * @return false if the word doesn't fit and true otherwise
+   */
+  bool assign(const struct sts_word& word) noexcept
+  {
+    if (word.w != W || word.c != C || word.encoding != STS_ENC_SAX
+        || word.symbols == nullptr) {
+      return false;
+    }
+    for (std::size_t i = 0; i < W; ++i) {
+      symbols_[i] = word.symbols[i];
+    }
+    n_values_ = word.n_values;
+    return true;
+  }
+
+  static constexpr std::size_t size() noexcept { return W; }
+  static constexpr unsigned int cardinality() noexcept { return C; }
+  std::size_t n_values() const noexcept { return n_values_; }
+  sts_symbol operator[](std::size_t i) const noexcept { return symbols_[i]; }
+  const sts_symbol* data() const noexcept { return symbols_.data(); }
+  const sts_symbol* begin() const noexcept { return symbols_.data(); }
+  const sts_symbol* end() const noexcept { return symbols_.data() + W; }
+
+  /**
+   * @return C word pointing into this one, valid while it's alive and
+   * unmodified
+   */
+  struct sts_word view() const noexcept
+  {
+    struct sts_word word;
+    word.symbols = const_cast<sts_symbol*>(symbols_.data());
+    word.n_values = n_values_;
+    word.w = W;
+    word.c = C;
+    word.encoding = STS_ENC_SAX;
+    word.c_slope = 1;
+    word.breaks = nullptr;
+    return word;
+  }
+
+  /**
+   * @return SAX string of the word, '#' for NaN frames
+   */
+  std::string to_string() const
+  {
+    static_assert(C <= STS_MAX_SAX_CARDINALITY,
+                  "SAX notation is limited to STS_MAX_SAX_CARDINALITY");
+    std::string str(W, '#');
+    for (std::size_t i = 0; i < W; ++i) {
+      if (symbols_[i] < C) {
+        str[i] = static_cast<char>(C - symbols_[i] - 1 + 'A');
+      }
+    }
+    return str;
+  }
+
+  /**
+   * Same as sts_mindist, SAX cardinalities use the constexpr distance table
+   * @param other
+   * @return NaN if the words are of different n, otherwise the distance
+   */
+  double mindist(const Word& other) const noexcept
+  {
+    if constexpr (C <= STS_MAX_SAX_CARDINALITY) {
+      if (n_values_ != other.n_values_ && n_values_ != 0
+          && other.n_values_ != 0) {
+        return NAN;
+      }
+      std::size_t n = n_values_ > 0 ? n_values_ : other.n_values_;
+      if (n == 0) n = W;
+      double above = 0, below = 0;
+      for (std::size_t i = 0; i < W; ++i) {
+        unsigned int sa = symbols_[i], sb = other.symbols_[i];
+        if (sa == sb) continue;
+        if (sa == C) { // if NaN use the maximum mindist
+          sa = sb > C - 1 - sb ? 0 : C - 1;
+        } else if (sb == C) {
+          sb = sa > C - 1 - sa ? 0 : C - 1;
+        }
+        double d = distances<C>[sa * C + sb];
+        if (sa < sb) {
+          above += d * d;
+        } else {
+          below += d * d;
+        }
+      }
+      return std::sqrt(static_cast<double>(n) / static_cast<double>(W))
+             * std::sqrt(above + below);
+    } else {
+      struct sts_word a = view(), b = other.view();
+      return sts_mindist(&a, &b);
+    }
+  }
+
+  friend bool operator==(const Word& a, const Word& b) noexcept
+  {
+    return a.symbols_ == b.symbols_;
+  }
+
+  friend bool operator!=(const Word& a, const Word& b) noexcept
+  {
+    return !(a == b);
+  }
+
+private:
+  std::array<sts_symbol, W> symbols_{};
+  std::size_t n_values_ = 0;
+};
+
+/**
+ * Encodes any contiguous range of doubles (std::vector, std::array,
+ * std::span...), see Word::encode
+ */
+template <std::size_t W, unsigned int C, class Range>
+std::optional<Word<W, C>> encode(const Range& series) noexcept
+{
+  return Word<W, C>::encode(std::data(series), std::size(series));
+}
+
+/**
+ * Owning handle of a sliding window of N values encoded into W symbols of
+ * cardinality C. Move-only, the C window is freed with the last owner
+ */
+template <std::size_t N, std::size_t W, unsigned int C>
+class Window {
+  static_assert(W > 0 && N % W == 0, "w should be a divisor of n");
+  static_assert(C >= STS_MIN_CARDINALITY && C <= STS_MAX_CARDINALITY,
+                "cardinality out of range");
+
+public:
+  using word_type = Word<W, C>;
+
+  /**
+   * @throw std::bad_alloc if the window can't be allocated
+   */
+  Window() : window_(sts_new_window(N, W, C))
+  {
+    if (!window_) throw std::bad_alloc();
+  }
+
+  ~Window() { sts_free_window(window_); }
+
+  Window(Window&& other) noexcept
+    : window_(std::exchange(other.window_, nullptr)),
+      filled_(std::exchange(other.filled_, 0)) {}
+
+  Window& operator=(Window&& other) noexcept
+  {
+    std::swap(window_, other.window_);
+    std::swap(filled_, other.filled_);
+    return *this;
+  }
+
+  Window(const Window&) = delete;
+  Window& operator=(const Window&) = delete;
+
+  /**
+   * Appends values, see sts_append_value and sts_append_array. The word is
+   * updated after every append, frames of values not appended yet are NaN
+   * symbols until the window is full()
+   * @return false if the window has been moved from and true otherwise
+   */
+  bool append(double value) noexcept
+  {
+    return filled(sts_append_value(window_, value), 1);
+  }
+
+  bool append(const double* values, std::size_t n_values) noexcept
+  {
+    return filled(sts_append_array(window_, values, n_values), n_values);
+  }
+
+  bool append(const float* values, std::size_t n_values) noexcept
+  {
+    return filled(sts_append_float_array(window_, values, n_values),
+                  n_values);
+  }
+
+  bool append(const int32_t* values, std::size_t n_values) noexcept
+  {
+    return filled(sts_append_int32_array(window_, values, n_values),
+                  n_values);
+  }
+
+  bool append(const int64_t* values, std::size_t n_values) noexcept
+  {
+    return filled(sts_append_int64_array(window_, values, n_values),
+                  n_values);
+  }
+
+  /**
+   * Appends a contiguous range (std::vector, std::array, std::span...) of
+   * doubles, floats, int32_t or int64_t
+   */
+  template <class Range>
+  auto append(const Range& values) noexcept
+    -> decltype(append(std::data(values), std::size(values)))
+  {
+    return append(std::data(values), std::size(values));
+  }
+
+  /**
+   * @return whether N values have been appended through this handle since
+   * it was created or reset
+   */
+  bool full() const noexcept { return window_ && filled_ == N; }
+
+  /**
+   * @return copy of the current word, see append
+   */
+  word_type word() const noexcept
+  {
+    word_type word;
+    if (window_) word.assign(window_->current_word);
+    return word;
+  }
+
+  /**
+   * @return current word of the C window, valid until the next append, or
+   * nullptr if the window has been moved from
+   */
+  const struct sts_word* current() const noexcept
+  {
+    return window_ ? &window_->current_word : nullptr;
+  }
+
+  bool reset() noexcept
+  {
+    filled_ = 0;
+    return sts_reset_window(window_);
+  }
+
+  struct sts_window* get() const noexcept { return window_; }
+
+  /**
+   * Gives up ownership, the caller frees the window with sts_free_window
+   */
+  struct sts_window* release() noexcept
+  {
+    return std::exchange(window_, nullptr);
+  }
+
+private:
+  bool filled(const struct sts_word* word, std::size_t n_values) noexcept
+  {
+    if (!word) return false;
+    filled_ = n_values < N - filled_ ? filled_ + n_values : N;
+    return true;
+  }
+
+  struct sts_window* window_;
+  std::size_t filled_ = 0; // appended values, up to N
+};
+
+} // namespace sts
+
+#endif
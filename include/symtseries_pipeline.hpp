@@ -0,0 +1,530 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* C++20 coroutine pipeline over symtseries.hpp: ingest -> encode -> match ->
+ * emit. Every stage is a coroutine resumed on a small thread pool, stages
+ * pass batches through bounded channels, so a slow stage suspends the ones
+ * feeding it instead of buffering without limit. */
+
+#ifndef _SYMTSERIES_PIPELINE_HPP_
+#define _SYMTSERIES_PIPELINE_HPP_
+#if __cplusplus < 202002L
+#error "symtseries_pipeline.hpp requires C++20"
+#endif
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "symtseries.hpp"
+
+namespace sts::pipeline {
+
+/**
+ * Fixed set of threads resuming coroutines in FIFO order
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(std::size_t n_threads = 2)
+  {
+    if (n_threads == 0) n_threads = 1;
+    for (std::size_t i = 0; i < n_threads; ++i) {
+      threads_.emplace_back([this] { work(); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    ready_.notify_all();
+    for (std::thread& thread : threads_) thread.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void post(std::coroutine_handle<> handle)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(handle);
+    }
+    ready_.notify_one();
+  }
+
+  /**
+   * co_await pool.schedule() continues the coroutine on a pool thread
+   */
+  auto schedule() noexcept
+  {
+    struct Awaiter {
+      ThreadPool* pool;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> h) { pool->post(h); }
+      void await_resume() const noexcept {}
+    };
+    return Awaiter{ this };
+  }
+
+private:
+  void work()
+  {
+    for (;;) {
+      std::coroutine_handle<> handle;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+        handle = queue_.front();
+        queue_.pop_front();
+      }
+      handle.resume();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::coroutine_handle<>> queue_;
+  std::vector<std::thread> threads_;
+  bool stop_ = false;
+};
+
+/**
+ * Counts finished tasks and keeps the first error
+ */
+class Completion {
+public:
+  explicit Completion(std::size_t n_tasks) : pending_(n_tasks) {}
+
+  void finish(std::exception_ptr error) noexcept
+  {
+    // notify under the lock, the waiter may destroy this right after
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error && !error_) error_ = error;
+    if (--pending_ == 0) done_.notify_all();
+  }
+
+  /**
+   * Blocks until all tasks have finished, rethrows the first error
+   */
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+    if (error_) std::rethrow_exception(error_);
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::size_t pending_;
+  std::exception_ptr error_;
+};
+
+/**
+ * Lazily started coroutine reporting to a Completion when it's done
+ */
+class Task {
+public:
+  struct promise_type {
+    Completion* done = nullptr;
+    std::exception_ptr error;
+
+    Task get_return_object()
+    {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept
+    {
+      struct Final {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+        {
+          // the frame may be destroyed once finish returns
+          promise_type& promise = h.promise();
+          promise.done->finish(promise.error);
+        }
+        void await_resume() const noexcept {}
+      };
+      return Final{};
+    }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+  };
+
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task& operator=(Task&&) = delete;
+  ~Task()
+  {
+    if (handle_) handle_.destroy();
+  }
+
+  void start(ThreadPool& pool, Completion& done)
+  {
+    handle_.promise().done = &done;
+    pool.post(handle_);
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle)
+  {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * Bounded multi-producer multi-consumer channel. push suspends while the
+ * channel is full and pop while it's empty, suspended coroutines are resumed
+ * on the pool. After close, pushes fail and pops drain what's left
+ */
+template <class T>
+class Channel {
+  struct Waiter {
+    std::coroutine_handle<> handle;
+    std::optional<T> item;
+    bool ok = false;
+  };
+
+public:
+  Channel(ThreadPool& pool, std::size_t capacity)
+    : pool_(pool), capacity_(capacity > 0 ? capacity : 1) {}
+
+  Channel(const Channel&) = delete;
+  Channel& operator=(const Channel&) = delete;
+
+  /**
+   * co_await push(item) yields false if the channel has been closed
+   */
+  auto push(T item)
+  {
+    struct Awaiter {
+      Channel* channel;
+      Waiter waiter;
+      bool await_ready() const noexcept { return false; }
+      bool await_suspend(std::coroutine_handle<> h)
+      {
+        waiter.handle = h;
+        return channel->suspend_push(waiter);
+      }
+      bool await_resume() const noexcept { return waiter.ok; }
+    };
+    return Awaiter{ this, Waiter{ {}, std::move(item), false } };
+  }
+
+  /**
+   * co_await pop() yields std::nullopt once the channel is closed and empty
+   */
+  auto pop()
+  {
+    struct Awaiter {
+      Channel* channel;
+      Waiter waiter;
+      bool await_ready() const noexcept { return false; }
+      bool await_suspend(std::coroutine_handle<> h)
+      {
+        waiter.handle = h;
+        return channel->suspend_pop(waiter);
+      }
+      std::optional<T> await_resume() { return std::move(waiter.item); }
+    };
+    return Awaiter{ this, {} };
+  }
+
+  void close()
+  {
+    std::vector<std::coroutine_handle<>> wake;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (closed_) return;
+      closed_ = true;
+      for (Waiter* w : pushers_) {
+        w->ok = false;
+        wake.push_back(w->handle);
+      }
+      for (Waiter* w : poppers_) wake.push_back(w->handle);
+      pushers_.clear();
+      poppers_.clear();
+    }
+    for (std::coroutine_handle<> h : wake) pool_.post(h);
+  }
+
+private:
+  // return false to continue the caller without suspending
+  bool suspend_push(Waiter& w)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closed_) {
+      w.ok = false;
+      return false;
+    }
+    w.ok = true;
+    if (!poppers_.empty()) {
+      Waiter* popper = poppers_.front();
+      poppers_.pop_front();
+      popper->item = std::move(w.item);
+      lock.unlock();
+      pool_.post(popper->handle);
+      return false;
+    }
+    if (items_.size() < capacity_) {
+      items_.push_back(std::move(*w.item));
+      return false;
+    }
+    pushers_.push_back(&w);
+    return true;
+  }
+
+  bool suspend_pop(Waiter& w)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!items_.empty()) {
+      w.item = std::move(items_.front());
+      items_.pop_front();
+      if (!pushers_.empty()) {
+        Waiter* pusher = pushers_.front();
+        pushers_.pop_front();
+        items_.push_back(std::move(*pusher->item));
+        lock.unlock();
+        pool_.post(pusher->handle);
+      }
+      return false;
+    }
+    if (closed_) return false;
+    poppers_.push_back(&w);
+    return true;
+  }
+
+  ThreadPool& pool_;
+  std::size_t capacity_;
+  std::mutex mutex_;
+  std::deque<T> items_;
+  std::deque<Waiter*> pushers_, poppers_;
+  bool closed_ = false;
+};
+
+/**
+ * Value of series number series
+ */
+struct Sample {
+  std::size_t series;
+  double value;
+};
+
+/**
+ * Word of series matching pattern, position counts values of the series
+ * up to and including the last one of the word
+ */
+struct Alert {
+  std::size_t series;
+  std::uint64_t position;
+  std::size_t pattern;
+  double distance;
+};
+
+/**
+ * Source replaying samples kept in memory, e.g. read from a capture with
+ * from_stream
+ */
+class ReplaySource {
+public:
+  explicit ReplaySource(std::vector<Sample> samples)
+    : samples_(std::move(samples)) {}
+
+  /**
+   * Reads "series value" pairs until the end of in or the first malformed
+   * pair
+   */
+  static ReplaySource from_stream(std::istream& in)
+  {
+    std::vector<Sample> samples;
+    Sample sample;
+    while (in >> sample.series >> sample.value) samples.push_back(sample);
+    return ReplaySource(std::move(samples));
+  }
+
+  /**
+   * @return number of samples written to out, 0 at the end of the replay
+   */
+  std::size_t read(Sample* out, std::size_t max_samples)
+  {
+    std::size_t n = samples_.size() - pos_;
+    if (n > max_samples) n = max_samples;
+    for (std::size_t i = 0; i < n; ++i) out[i] = samples_[pos_ + i];
+    pos_ += n;
+    return n;
+  }
+
+private:
+  std::vector<Sample> samples_;
+  std::size_t pos_ = 0;
+};
+
+/**
+ * Sink keeping every alert, e.g. for offline tests
+ */
+class CollectSink {
+public:
+  void operator()(const Alert& alert) { alerts.push_back(alert); }
+  std::vector<Alert> alerts;
+};
+
+struct Options {
+  std::size_t batch_size = 256; // samples per ingest batch
+  std::size_t queue_capacity = 4; // batches buffered between two stages
+};
+
+/**
+ * Ingest, encode, match and emit for n_series series of the same (N, W, C).
+ * Each series has its own window. Once a window holds N samples, every word
+ * is compared with all patterns and those within threshold are emitted as
+ * alerts
+ */
+template <std::size_t N, std::size_t W, unsigned int C>
+class Pipeline {
+public:
+  using word_type = Word<W, C>;
+
+  Pipeline(ThreadPool& pool,
+           std::size_t n_series,
+           std::vector<word_type> patterns,
+           double threshold,
+           Options options = Options())
+    : pool_(pool), patterns_(std::move(patterns)), threshold_(threshold),
+      options_(options), positions_(n_series, 0)
+  {
+    if (options_.batch_size == 0) options_.batch_size = 1;
+    windows_.reserve(n_series);
+    for (std::size_t i = 0; i < n_series; ++i) windows_.emplace_back();
+  }
+
+  /**
+   * Drains source into sink and blocks until all stages have finished.
+   * Source has std::size_t read(Sample*, std::size_t), returning 0 at its
+   * end, sink is called with const Alert& from one stage at a time. Windows
+   * keep their values between runs
+   * @throw the first exception thrown by a stage, source or sink
+   */
+  template <class Source, class Sink>
+  void run(Source& source, Sink& sink)
+  {
+    Channel<std::vector<Sample>> samples(pool_, options_.queue_capacity);
+    Channel<std::vector<Encoded>> words(pool_, options_.queue_capacity);
+    Channel<std::vector<Alert>> alerts(pool_, options_.queue_capacity);
+    Completion done(4);
+    Task stages[] = { ingest(source, samples), encode(samples, words),
+                      match(words, alerts), emit(alerts, sink) };
+    for (Task& stage : stages) stage.start(pool_, done);
+    done.wait();
+  }
+
+private:
+  struct Encoded {
+    std::size_t series;
+    std::uint64_t position;
+    word_type word;
+  };
+
+  // closes both ends of a stage however it finishes, so that neighbours
+  // don't wait on it forever
+  template <class In, class Out>
+  struct CloseOnExit {
+    In* in;
+    Out* out;
+    ~CloseOnExit()
+    {
+      if (in) in->close();
+      if (out) out->close();
+    }
+  };
+
+  template <class Source>
+  Task ingest(Source& source, Channel<std::vector<Sample>>& out)
+  {
+    CloseOnExit<Channel<std::vector<Sample>>, Channel<std::vector<Sample>>>
+      guard{ nullptr, &out };
+    for (;;) {
+      std::vector<Sample> batch(options_.batch_size);
+      std::size_t n = source.read(batch.data(), batch.size());
+      if (n == 0) break;
+      batch.resize(n);
+      if (!co_await out.push(std::move(batch))) break;
+    }
+  }
+
+  Task encode(Channel<std::vector<Sample>>& in,
+              Channel<std::vector<Encoded>>& out)
+  {
+    CloseOnExit<Channel<std::vector<Sample>>, Channel<std::vector<Encoded>>>
+      guard{ &in, &out };
+    while (std::optional<std::vector<Sample>> batch = co_await in.pop()) {
+      std::vector<Encoded> encoded;
+      for (const Sample& sample : *batch) {
+        if (sample.series >= windows_.size()) continue;
+        std::uint64_t position = ++positions_[sample.series];
+        // Words of windows still padded with NaN frames aren't matched
+        if (windows_[sample.series].append(sample.value)
+            && windows_[sample.series].full()) {
+          encoded.push_back(Encoded{ sample.series, position,
+                                     windows_[sample.series].word() });
+        }
+      }
+      if (encoded.empty()) continue;
+      if (!co_await out.push(std::move(encoded))) break;
+    }
+  }
+
+  Task match(Channel<std::vector<Encoded>>& in,
+             Channel<std::vector<Alert>>& out)
+  {
+    CloseOnExit<Channel<std::vector<Encoded>>, Channel<std::vector<Alert>>>
+      guard{ &in, &out };
+    while (std::optional<std::vector<Encoded>> batch = co_await in.pop()) {
+      std::vector<Alert> matched;
+      for (const Encoded& encoded : *batch) {
+        for (std::size_t p = 0; p < patterns_.size(); ++p) {
+          double distance = encoded.word.mindist(patterns_[p]);
+          if (distance <= threshold_) {
+            matched.push_back(Alert{ encoded.series, encoded.position, p,
+                                     distance });
+          }
+        }
+      }
+      if (matched.empty()) continue;
+      if (!co_await out.push(std::move(matched))) break;
+    }
+  }
+
+  template <class Sink>
+  Task emit(Channel<std::vector<Alert>>& in, Sink& sink)
+  {
+    CloseOnExit<Channel<std::vector<Alert>>, Channel<std::vector<Alert>>>
+      guard{ &in, nullptr };
+    while (std::optional<std::vector<Alert>> batch = co_await in.pop()) {
+      for (const Alert& alert : *batch) sink(alert);
+    }
+  }
+
+  ThreadPool& pool_;
+  std::vector<word_type> patterns_;
+  double threshold_;
+  Options options_;
+  std::vector<Window<N, W, C>> windows_;
+  std::vector<std::uint64_t> positions_;
+};
+
+} // namespace sts::pipeline
+
+#endif
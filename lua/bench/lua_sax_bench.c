@@ -0,0 +1,336 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/** @brief Lua sax binding benchmarks @file */
+
+/* Embeds Lua 5.1 with the sax module and times each binding in a Lua loop
+ * next to a C loop calling the core function it wraps, so that the
+ * difference is what the binding costs per call: argument checks, userdata
+ * lookups, check_array copies and string creation. Prints one JSON document:
+ *
+ *   lua_sax_bench [--quick] [--min-time seconds]
+ *
+ * Lua allocations are counted by the allocator of the state, C allocations
+ * of the binding and the core through the linker's --wrap of malloc, calloc
+ * and realloc (null in builds without it). */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#else
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <symtseries.h>
+#include <time.h>
+
+int luaopen_sax(lua_State* lua);
+
+#define BENCH_N 256
+#define BENCH_W 16
+#define BENCH_C 8
+#define BENCH_VALUES 4096
+
+static uint64_t lua_allocs;
+
+#ifdef STS_BENCH_WRAP_MALLOC
+static uint64_t c_allocs;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+  ++c_allocs;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+  ++c_allocs;
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+  ++c_allocs;
+  return __real_realloc(ptr, size);
+}
+
+// Lua's own blocks are counted by lua_alloc only
+#define raw_realloc __real_realloc
+#else
+#define raw_realloc realloc
+#endif
+
+static void* lua_alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+  (void)ud;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  if (!ptr || nsize > osize) ++lua_allocs;
+  return raw_realloc(ptr, nsize);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double values[BENCH_VALUES];
+
+/*
+ * C baselines, same work as the Lua loops without the binding
+ */
+static sts_window core_window;
+static sts_word core_a, core_b;
+static volatile uint64_t sink;
+
+static void core_none(size_t iters)
+{
+  double sum = 0;
+  for (size_t i = 1; i <= iters; ++i) sum += values[i % BENCH_VALUES];
+  sink += sum == sum;
+}
+
+static void core_add_scalar(size_t iters)
+{
+  for (size_t i = 1; i <= iters; ++i) {
+    sts_append_value(core_window, values[i % BENCH_VALUES]);
+  }
+}
+
+static void core_add_table(size_t iters)
+{
+  for (size_t i = 1; i <= iters; ++i) {
+    sts_append_array(core_window, values, BENCH_N);
+  }
+}
+
+static void core_to_string(size_t iters)
+{
+  for (size_t i = 1; i <= iters; ++i) {
+    char* str = sts_word_to_sax_string(&core_window->current_word);
+    sink += (uint64_t)str[0];
+    free(str);
+  }
+}
+
+static void core_mindist(size_t iters)
+{
+  double above, below, sum = 0;
+  for (size_t i = 1; i <= iters; ++i) {
+    sum += sts_mindist_ab(core_a, core_b, &above, &below);
+  }
+  sink += sum == sum;
+}
+
+static void core_get_word(size_t iters)
+{
+  for (size_t i = 1; i <= iters; ++i) {
+    sts_free_word(sts_dup_word(&core_window->current_word));
+  }
+}
+
+/*
+ * Each chunk returns the loop to time, called with the number of iterations.
+ * Globals: values (BENCH_VALUES numbers), n, w, c
+ */
+static const struct {
+  const char* name;
+  const char* chunk;
+  void (*core)(size_t iters);
+} benches[] = {
+  { "loop",
+    "local v = values\n"
+    "return function(iters)\n"
+    "  local x = 0\n"
+    "  for i = 1, iters do x = x + v[i % #v + 1] end\n"
+    "end", core_none },
+  { "add_scalar",
+    "local v, win = values, sax.window.new(n, w, c)\n"
+    "return function(iters)\n"
+    "  for i = 1, iters do win:add(v[i % #v + 1]) end\n"
+    "end", core_add_scalar },
+  { "add_table",
+    "local t, win = {}, sax.window.new(n, w, c)\n"
+    "for i = 1, n do t[i] = values[i] end\n"
+    "return function(iters)\n"
+    "  for i = 1, iters do win:add(t) end\n"
+    "end", core_add_table },
+  { "to_string",
+    "local win = sax.window.new(n, w, c)\n"
+    "for i = 1, n do win:add(values[i]) end\n"
+    "return function(iters)\n"
+    "  local s\n"
+    "  for i = 1, iters do s = tostring(win) end\n"
+    "end", core_to_string },
+  { "mindist",
+    "local ta, tb = {}, {}\n"
+    "for i = 1, n do ta[i], tb[i] = values[i], values[n + i] end\n"
+    "local a, b = sax.word.new(ta, w, c), sax.word.new(tb, w, c)\n"
+    "return function(iters)\n"
+    "  local mindist = sax.mindist\n"
+    "  for i = 1, iters do mindist(a, b) end\n"
+    "end", core_mindist },
+  { "get_word",
+    "local win = sax.window.new(n, w, c)\n"
+    "for i = 1, n do win:add(values[i]) end\n"
+    "return function(iters)\n"
+    "  for i = 1, iters do win:get_word() end\n"
+    "end", core_get_word }
+};
+
+#define N_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static void check(lua_State* lua, int status)
+{
+  if (status != 0) {
+    fprintf(stderr, "lua_sax_bench: %s\n", lua_tostring(lua, -1));
+    exit(EXIT_FAILURE);
+  }
+}
+
+typedef struct {
+  double ns_per_call;
+  double lua_allocs_per_call;
+  double c_allocs_per_call;
+} timing;
+
+/*
+ * Times the Lua loop at the top of the stack (ref) or the C loop (core)
+ */
+static timing measure(lua_State* lua,
+                      int ref,
+                      void (*core)(size_t),
+                      double min_time)
+{
+  timing t;
+  size_t iters = 16;
+  for (;;) {
+    lua_gc(lua, LUA_GCCOLLECT, 0);
+    uint64_t lua_before = lua_allocs;
+#ifdef STS_BENCH_WRAP_MALLOC
+    uint64_t c_before = c_allocs;
+#endif
+    double start = now();
+    if (core) {
+      core(iters);
+    } else {
+      lua_rawgeti(lua, LUA_REGISTRYINDEX, ref);
+      lua_pushnumber(lua, (lua_Number)iters);
+      check(lua, lua_pcall(lua, 1, 0, 0));
+    }
+    double elapsed = now() - start;
+    t.ns_per_call = elapsed * 1e9 / iters;
+    t.lua_allocs_per_call = (double)(lua_allocs - lua_before) / iters;
+#ifdef STS_BENCH_WRAP_MALLOC
+    t.c_allocs_per_call = (double)(c_allocs - c_before) / iters;
+#else
+    t.c_allocs_per_call = -1;
+#endif
+    if (elapsed >= min_time) break;
+    iters *= elapsed * 4 < min_time ? 4 : 2;
+  }
+  return t;
+}
+
+static void print_number(const char* key, double value, bool last)
+{
+  if (value < 0 || value != value) {
+    printf("\"%s\": null%s", key, last ? "" : ", ");
+  } else {
+    printf("\"%s\": %.6g%s", key, value, last ? "" : ", ");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  double min_time = 0.1;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.005;
+    } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      min_time = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--min-time seconds]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (size_t i = 0; i < BENCH_VALUES; ++i) {
+    values[i] = 10 * sin(i / 10.0) + (double)(i % 7);
+  }
+  core_window = sts_new_window(BENCH_N, BENCH_W, BENCH_C);
+  core_a = sts_from_double_array(values, BENCH_N, BENCH_W, BENCH_C);
+  core_b = sts_from_double_array(values + BENCH_N, BENCH_N, BENCH_W, BENCH_C);
+  if (!core_window || !core_a || !core_b) return EXIT_FAILURE;
+  sts_append_array(core_window, values, BENCH_N);
+
+  lua_State* lua = lua_newstate(lua_alloc, NULL);
+  if (!lua) return EXIT_FAILURE;
+  luaL_openlibs(lua);
+  lua_pushcfunction(lua, luaopen_sax);
+  check(lua, lua_pcall(lua, 0, 0, 0));
+  lua_createtable(lua, BENCH_VALUES, 0);
+  for (size_t i = 0; i < BENCH_VALUES; ++i) {
+    lua_pushnumber(lua, values[i]);
+    lua_rawseti(lua, -2, (int)i + 1);
+  }
+  lua_setglobal(lua, "values");
+  lua_pushnumber(lua, BENCH_N);
+  lua_setglobal(lua, "n");
+  lua_pushnumber(lua, BENCH_W);
+  lua_setglobal(lua, "w");
+  lua_pushnumber(lua, BENCH_C);
+  lua_setglobal(lua, "c");
+
+  timing loop = { 0, 0, 0 };
+  printf("{\n  \"n\": %d, \"w\": %d, \"c\": %d,\n  \"results\": [",
+         BENCH_N, BENCH_W, BENCH_C);
+  for (size_t k = 0; k < N_BENCHES; ++k) {
+    check(lua, luaL_loadstring(lua, benches[k].chunk));
+    check(lua, lua_pcall(lua, 0, 1, 0));
+    int ref = luaL_ref(lua, LUA_REGISTRYINDEX);
+    timing in_lua = measure(lua, ref, NULL, min_time);
+    timing core = measure(lua, 0, benches[k].core, min_time);
+    luaL_unref(lua, LUA_REGISTRYINDEX, ref);
+    if (k == 0) loop = in_lua;
+
+    printf("%s\n    {\"bench\": \"%s\", ", k == 0 ? "" : ",", benches[k].name);
+    print_number("lua_ns_per_call", in_lua.ns_per_call, false);
+    print_number("core_ns_per_call", core.ns_per_call, false);
+    // what's left after the work of the core and the bare Lua loop
+    print_number("overhead_ns_per_call",
+                 k == 0 ? in_lua.ns_per_call - core.ns_per_call
+                        : in_lua.ns_per_call - core.ns_per_call
+                          - loop.ns_per_call,
+                 false);
+    print_number("lua_allocs_per_call", in_lua.lua_allocs_per_call, false);
+    print_number("c_allocs_per_call", in_lua.c_allocs_per_call, false);
+    print_number("core_c_allocs_per_call", core.c_allocs_per_call, true);
+    printf("}");
+  }
+  printf("\n  ]\n}\n");
+
+  lua_close(lua);
+  sts_free_window(core_window);
+  sts_free_word(core_a);
+  sts_free_word(core_b);
+  return EXIT_SUCCESS;
+}
@@ -20,8 +20,10 @@
 static const char* mozsvc_sax_table = "sax";
 static const char* mozsvc_sax_window = "mozsvc.sax.window";
 static const char* mozsvc_sax_word = "mozsvc.sax.word";
+static const char* mozsvc_sax_library = "mozsvc.sax.library";
 static const char* mozsvc_sax_win_suffix = "window";
 static const char* mozsvc_sax_word_suffix = "word";
+static const char* mozsvc_sax_library_suffix = "library";
 
 static void check_nwc(lua_State* lua, int n, int w, int c, int offset)
 {
@@ -30,16 +32,26 @@ static void check_nwc(lua_State* lua, int n, int w, int c, int offset)
   luaL_argcheck(lua, w > 1 && w <= 2048, offset, "w is out of range");
   luaL_argcheck(lua, n % w == 0, offset,
                 "n must be evenly divisible by w");
-  luaL_argcheck(lua, 1 < c && c <= STS_MAX_CARDINALITY, offset,
+  luaL_argcheck(lua, 1 < c && c <= STS_MAX_SAX_CARDINALITY, offset,
                 "cardinality is out of range");
 }
 
-static sts_word check_sax_word(lua_State* lua, int ind)
+/*
+ * Word userdata, symbols follow the header in the same block so that a word
+ * is a single object accounted by Lua
+ */
+typedef struct {
+  struct sts_word word;
+  sts_symbol symbols[];
+} word_storage;
+
+#ifdef LUA_SANDBOX
+static struct sts_word* check_sax_word(lua_State* lua, int ind)
 {
-  // word was previously successfully constructed -> No need to check for NULLs
-  sts_word* ud = luaL_checkudata(lua, ind, mozsvc_sax_word);
-  return *ud;
+  word_storage* ud = luaL_checkudata(lua, ind, mozsvc_sax_word);
+  return &ud->word;
 }
+#endif
 
 typedef enum {SAX_WORD, SAX_WINDOW} sax_type;
 
@@ -71,32 +83,16 @@ static const struct sts_word* check_word_or_window(lua_State* lua, int ind)
   sax_type type = sax_gettype(lua, ind);
   void* ud = lua_touserdata(lua, ind);
   if (type == SAX_WORD) {
-    return *((sts_word*)ud);
+    return &((word_storage*)ud)->word;
   } else {
-    sts_window window = *((struct sts_window**)ud);
-    return &window->current_word;
+    // the window, its ring buffer and symbols are the userdata
+    return &((struct sts_window*)ud)->current_word;
   }
 }
 
 static sts_window check_sax_window(lua_State* lua, int ind)
 {
-  /* same as with check_sax_word - no need to check for NULLs */
-  sts_window* ud = luaL_checkudata(lua, ind, mozsvc_sax_window);
-  return *ud;
-}
-
-static void push_window(lua_State* lua, sts_window win)
-{
-  sts_window* ud = lua_newuserdata(lua, sizeof*ud);
-  if (!ud) {
-    luaL_error(lua, "memory allocation failed");
-    // never reached since error long jumps but aids static analysis
-    return;
-  }
-
-  *ud = win;
-  luaL_getmetatable(lua, mozsvc_sax_window);
-  lua_setmetatable(lua, -2);
+  return luaL_checkudata(lua, ind, mozsvc_sax_window);
 }
 
 static int sax_new_window(lua_State* lua)
@@ -107,27 +103,41 @@ static int sax_new_window(lua_State* lua)
   int c = luaL_checkint(lua, 3);
   check_nwc(lua, n, w, c, 1);
 
-  sts_window win = sts_new_window(n, w, c);
-  if (!win) {
+  void* ud = lua_newuserdata(lua, sts_window_storage_size(n, w));
+  if (!ud || !sts_init_window(ud, n, w, c)) {
     return luaL_error(lua, "memory allocation failed");
   }
-
-  push_window(lua, win);
+  luaL_getmetatable(lua, mozsvc_sax_window);
+  lua_setmetatable(lua, -2);
   return 1;
 }
 
-static void push_word(lua_State* lua, const struct sts_word* a)
+/*
+ * Pushes a word with storage for w symbols, the caller fills it in
+ */
+static struct sts_word* new_word(lua_State* lua, size_t w)
 {
-  const struct sts_word** ud = lua_newuserdata(lua, sizeof*ud);
+  word_storage* ud = lua_newuserdata(lua, sizeof*ud + w * sizeof(sts_symbol));
   if (!ud) {
     luaL_error(lua, "memory allocation failed");
     // never reached since error long jumps but aids static analysis
-    return;
+    return NULL;
   }
 
-  *ud = a;
+  ud->word.symbols = ud->symbols;
+  ud->word.w = w;
   luaL_getmetatable(lua, mozsvc_sax_word);
   lua_setmetatable(lua, -2);
+  return &ud->word;
+}
+
+static void push_word(lua_State* lua, const struct sts_word* a)
+{
+  struct sts_word* word = new_word(lua, a->w);
+  sts_symbol* symbols = word->symbols;
+  *word = *a;
+  word->symbols = symbols;
+  memcpy(symbols, a->symbols, a->w * sizeof*symbols);
 }
 
 static double* check_array(lua_State* lua, int ind, size_t size)
@@ -152,25 +162,253 @@ static double* check_array(lua_State* lua, int ind, size_t size)
   return buf;
 }
 
+/* Number of table values copied to the stack per sts_append_array call */
+#define SAX_ADD_CHUNK 256
+
+/*
+ * Streams the array at ind into the window without touching the heap. All
+ * the values are checked first, so that the window is left unchanged on
+ * error, but only the last n are copied, the window would drop the others
+ */
+static void add_array(lua_State* lua, sts_window win, int ind)
+{
+  double chunk[SAX_ADD_CHUNK];
+  size_t size = lua_objlen(lua, ind);
+  size_t n = win->current_word.n_values;
+  for (size_t i = 1; i <= size; ++i) {
+    lua_rawgeti(lua, ind, (int)i);
+    if (!lua_isnumber(lua, -1)) {
+      luaL_argerror(lua, ind, "expected array of numbers as input");
+      // never reached since argerror long jumps but aids static analysis
+      return;
+    }
+    lua_pop(lua, 1);
+  }
+  size_t i = size > n ? size - n + 1 : 1;
+  while (i <= size) {
+    size_t len = 0;
+    for (; len < SAX_ADD_CHUNK && i <= size; ++len, ++i) {
+      lua_rawgeti(lua, ind, (int)i);
+      chunk[len] = lua_tonumber(lua, -1);
+      lua_pop(lua, 1);
+    }
+    sts_append_array(win, chunk, len);
+  }
+}
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) \
+    || defined(_MSC_VER)
+#define SAX_LITTLE_ENDIAN
+#endif
+
+/*
+ * Little-endian doubles ("d") or floats ("f") packed into a Lua string
+ */
+typedef struct {
+  const unsigned char* data;
+  size_t count;
+  bool single; // floats
+} packed_values;
+
+static packed_values check_packed(lua_State* lua, int ind, int format_ind)
+{
+  packed_values pv;
+  size_t len;
+  pv.data = (const unsigned char*)luaL_checklstring(lua, ind, &len);
+  const char* format = luaL_optstring(lua, format_ind, "d");
+  luaL_argcheck(lua, (format[0] == 'd' || format[0] == 'f') && !format[1],
+                format_ind, "format should be \"d\" or \"f\"");
+  pv.single = format[0] == 'f';
+  size_t size = pv.single ? sizeof(float) : sizeof(double);
+  luaL_argcheck(lua, len % size == 0, ind,
+                "length of packed values should be a multiple of their size");
+  pv.count = len / size;
+  return pv;
+}
+
+/*
+ * Whether packed values can be passed to the library in place
+ */
+static bool is_native(const packed_values* pv)
+{
+#ifdef SAX_LITTLE_ENDIAN
+  size_t align = pv->single ? sizeof(float) : sizeof(double);
+  return (uintptr_t)pv->data % align == 0;
+#else
+  (void)pv;
+  return false;
+#endif
+}
+
+static double packed_value(const packed_values* pv, size_t i)
+{
+  if (pv->single) {
+    const unsigned char* p = pv->data + i * sizeof(float);
+    uint32_t bits = 0;
+    for (size_t j = 0; j < sizeof(bits); ++j) bits |= (uint32_t)p[j] << 8 * j;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+  const unsigned char* p = pv->data + i * sizeof(double);
+  uint64_t bits = 0;
+  for (size_t j = 0; j < sizeof(bits); ++j) bits |= (uint64_t)p[j] << 8 * j;
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+/*
+ * Appends packed values of the string at ind, in place if possible and
+ * through stack chunks otherwise
+ */
+static void add_packed(lua_State* lua, sts_window win, int ind, int format_ind)
+{
+  packed_values pv = check_packed(lua, ind, format_ind);
+  if (pv.count == 0) return;
+  if (is_native(&pv)) {
+    if (pv.single) {
+      sts_append_float_array(win, (const float*)pv.data, pv.count);
+    } else {
+      sts_append_array(win, (const double*)pv.data, pv.count);
+    }
+    return;
+  }
+  double chunk[SAX_ADD_CHUNK];
+  size_t n = win->current_word.n_values;
+  size_t i = pv.count > n ? pv.count - n : 0;
+  while (i < pv.count) {
+    size_t len = 0;
+    for (; len < SAX_ADD_CHUNK && i < pv.count; ++len, ++i) {
+      chunk[len] = packed_value(&pv, i);
+    }
+    sts_append_array(win, chunk, len);
+  }
+}
+
 static int sax_add(lua_State* lua)
 {
-  luaL_argcheck(lua, lua_gettop(lua) == 2, 0, "incorrect number of args");
+  int argc = lua_gettop(lua);
+  luaL_argcheck(lua, argc == 2 || argc == 3, 0, "incorrect number of args");
   sts_window win = check_sax_window(lua, 1);
-  if (lua_isnumber(lua, 2)) {
-    double d = lua_tonumber(lua, 2);
-    sts_append_value(win, d);
+  if (argc == 3) {
+    // packed values only with an explicit format, so that numeric strings
+    // stay numbers
+    luaL_checkstring(lua, 3);
+    add_packed(lua, win, 2, 3);
+  } else if (lua_isnumber(lua, 2)) {
+    sts_append_value(win, lua_tonumber(lua, 2));
+  } else if (lua_istable(lua, 2)) {
+    add_array(lua, win, 2);
   } else {
-    if (!lua_istable(lua, 2)) {
-      return luaL_argerror(lua, 2, "number or array-like table expected");
+    return luaL_argerror(lua, 2, "number or array-like table expected");
+  }
+  return 0;
+}
+
+/*
+ * Values of the array-like table or packed doubles at ind, read in place or
+ * into a userdata pushed on the stack
+ */
+static const double* check_series(lua_State* lua, int ind, size_t* count)
+{
+  if (lua_type(lua, ind) == LUA_TSTRING) {
+    packed_values pv = check_packed(lua, ind, lua_gettop(lua) + 1);
+    *count = pv.count;
+    if (is_native(&pv)) return (const double*)pv.data;
+    double* buf = lua_newuserdata(lua, pv.count * sizeof*buf);
+    for (size_t i = 0; i < pv.count; ++i) buf[i] = packed_value(&pv, i);
+    return buf;
+  }
+  luaL_argcheck(lua, lua_istable(lua, ind), ind,
+                "array-like table or packed values expected");
+  *count = lua_objlen(lua, ind);
+  double* buf = lua_newuserdata(lua, *count * sizeof*buf);
+  for (size_t i = 0; i < *count; ++i) {
+    lua_rawgeti(lua, ind, (int)i + 1);
+    if (!lua_isnumber(lua, -1)) {
+      luaL_argerror(lua, ind, "expected array of numbers as input");
+      // never reached since argerror long jumps but aids static analysis
+      return NULL;
     }
-    size_t size = lua_objlen(lua, 2);
-    if (size) {
-      double* vals = check_array(lua, 2, size);
-      sts_append_array(win, vals, size);
-      free(vals);
+    buf[i] = lua_tonumber(lua, -1);
+    lua_pop(lua, 1);
+  }
+  return buf;
+}
+
+/*
+ * Pushes count words of w symbols as one concatenated SAX string or, if the
+ * option at ind is "table", as a table of words
+ */
+static void push_words(lua_State* lua,
+                       const sts_symbol* symbols,
+                       size_t count,
+                       size_t n,
+                       size_t w,
+                       unsigned int c,
+                       int ind)
+{
+  static const char* const options[] = { "string", "table", NULL };
+  if (luaL_checkoption(lua, ind, "string", options) == 0) {
+    luaL_Buffer b;
+    luaL_buffinit(lua, &b);
+    for (size_t i = 0; i < count * w; ++i) {
+      // as sts_word_to_sax_string, without a string per word
+      luaL_addchar(&b, symbols[i] == c ? '#' : 'A' + c - 1 - symbols[i]);
     }
+    luaL_pushresult(&b);
+    return;
   }
-  return 0;
+  lua_createtable(lua, (int)count, 0);
+  for (size_t i = 0; i < count; ++i) {
+    struct sts_word* word = new_word(lua, w);
+    memcpy(word->symbols, symbols + i * w, w * sizeof*word->symbols);
+    word->n_values = n;
+    word->c = c;
+    word->encoding = STS_ENC_SAX;
+    word->c_slope = 1;
+    word->breaks = NULL;
+    lua_rawseti(lua, -2, (int)i + 1);
+  }
+}
+
+static int sax_sliding_words(lua_State* lua)
+{
+  int argc = lua_gettop(lua);
+  luaL_argcheck(lua, argc >= 4 && argc <= 6, 0, "incorrect number of args");
+  int n = luaL_checkint(lua, 2);
+  int w = luaL_checkint(lua, 3);
+  int c = luaL_checkint(lua, 4);
+  int stride = luaL_optint(lua, 5, 1);
+  check_nwc(lua, n, w, c, 2);
+  luaL_argcheck(lua, stride > 0, 5, "stride should be positive");
+  size_t count;
+  const double* series = check_series(lua, 1, &count);
+  size_t words = count < (size_t)n ? 0 : (count - n) / stride + 1;
+  sts_symbol* symbols = lua_newuserdata(lua, words * w * sizeof*symbols);
+  if (words) {
+    sts_sliding_words(series, count, n, w, c, stride, symbols);
+  }
+  push_words(lua, symbols, words, n, w, c, 6);
+  return 1;
+}
+
+static int sax_add_collect(lua_State* lua)
+{
+  int argc = lua_gettop(lua);
+  luaL_argcheck(lua, argc == 2 || argc == 3, 0, "incorrect number of args");
+  sts_window win = check_sax_window(lua, 1);
+  size_t count;
+  const double* values = check_series(lua, 2, &count);
+  size_t w = win->current_word.w;
+  sts_symbol* symbols = lua_newuserdata(lua, count * w * sizeof*symbols);
+  if (!sts_append_collect(win, values, count, symbols)) {
+    return luaL_error(lua, "memory allocation failed");
+  }
+  push_words(lua, symbols, count, win->current_word.n_values, w,
+             win->current_word.c, 3);
+  return 1;
 }
 
 static int sax_mindist(lua_State* lua)
@@ -219,7 +457,43 @@ static int sax_window_get_word(lua_State* lua)
 {
   luaL_argcheck(lua, lua_gettop(lua) == 1, 0, "incorrect number of args");
   sts_window window = check_sax_window(lua, 1);
-  push_word(lua, sts_dup_word(&window->current_word));
+  push_word(lua, &window->current_word);
+  return 1;
+}
+
+static int sax_from_packed(lua_State* lua)
+{
+  int w = luaL_checkint(lua, 2);
+  int c = luaL_checkint(lua, 3);
+  packed_values pv = check_packed(lua, 1, 4);
+  check_nwc(lua, (int)pv.count, w, c, 2);
+
+  struct sts_word* word = new_word(lua, w);
+  if (is_native(&pv) && !pv.single) {
+    sts_from_double_array_into((const double*)pv.data, pv.count, w, c, word);
+    return 1;
+  }
+  if (is_native(&pv)) {
+    sts_word a = sts_from_float_array((const float*)pv.data, pv.count, w, c);
+    if (!a) {
+      return luaL_error(lua, "memory allocation failed");
+    }
+    memcpy(word->symbols, a->symbols, w * sizeof*word->symbols);
+    word->n_values = a->n_values;
+    word->c = a->c;
+    word->encoding = a->encoding;
+    word->c_slope = a->c_slope;
+    word->breaks = NULL;
+    sts_free_word(a);
+    return 1;
+  }
+  double* buf = malloc(pv.count * sizeof*buf);
+  if (!buf) {
+    return luaL_error(lua, "memory allocation failed");
+  }
+  for (size_t i = 0; i < pv.count; ++i) buf[i] = packed_value(&pv, i);
+  sts_from_double_array_into(buf, pv.count, w, c, word);
+  free(buf);
   return 1;
 }
 
@@ -227,20 +501,20 @@ static int sax_from_double_array(lua_State* lua)
 {
   int w = luaL_checkint(lua, 2);
   int c = luaL_checkint(lua, 3);
+  if (lua_type(lua, 1) == LUA_TSTRING) {
+    return sax_from_packed(lua);
+  }
   if (!lua_istable(lua, 1)) {
-    return luaL_argerror(lua, 1, "array-like table expected");
+    return luaL_argerror(lua, 1, "array-like table or packed values expected");
   }
 
   size_t size = lua_objlen(lua, 1);
   check_nwc(lua, (int)size, w, c, 2);
 
   double* buf = check_array(lua, 1, size);
-  sts_word a = sts_from_double_array(buf, size, w, c);
+  struct sts_word* word = new_word(lua, w);
+  sts_from_double_array_into(buf, size, w, c, word);
   free(buf);
-  if (!a) {
-    return luaL_error(lua, "memory allocation failed");
-  }
-  push_word(lua, a);
   return 1;
 }
 
@@ -250,12 +524,11 @@ static int sax_from_string(lua_State* lua)
   const char* s = luaL_checklstring(lua, 1, &len);
   luaL_argcheck(lua, len > 1, 1, "length of SAX string should be > 1");
   int c = luaL_checkint(lua, 2);
-  sts_word a = sts_from_sax_string(s, c);
-  if (!a) {
+  struct sts_word* word = new_word(lua, len);
+  if (!sts_from_sax_string_into(s, c, word)) {
     return luaL_argerror(lua, 1, "illegal symbols for given cardinality "
                          "or bad cardinality itself");
   }
-  push_word(lua, a);
   return 1;
 }
 
@@ -267,6 +540,8 @@ static int sax_new_word(lua_State* lua)
     return sax_from_string(lua);
   case 3:
     return sax_from_double_array(lua);
+  case 4:
+    return sax_from_packed(lua);
   default:
     return luaL_argerror(lua, 0, "incorrect number of arguments");
   }
@@ -280,6 +555,165 @@ static int sax_clear(lua_State* lua)
   return 0;
 }
 
+/*
+ * Library userdata, parameters are kept to tell mismatching words apart
+ * from searches that found nothing
+ */
+typedef struct {
+  sts_library lib;
+  size_t n, w;
+  unsigned int c;
+} library;
+
+static library* check_library(lua_State* lua, int ind)
+{
+  return luaL_checkudata(lua, ind, mozsvc_sax_library);
+}
+
+static library* push_library(lua_State* lua,
+                             size_t n,
+                             size_t w,
+                             unsigned int c)
+{
+  library* ud = lua_newuserdata(lua, sizeof*ud);
+  ud->lib = NULL; // safe to collect if allocation below fails
+  luaL_getmetatable(lua, mozsvc_sax_library);
+  lua_setmetatable(lua, -2);
+  ud->lib = sts_new_library(n, w, c);
+  if (!ud->lib) {
+    luaL_error(lua, "memory allocation failed");
+    // never reached since error long jumps but aids static analysis
+    return NULL;
+  }
+  ud->n = n;
+  ud->w = w;
+  ud->c = c;
+  return ud;
+}
+
+static bool fits_library(const library* ud, const struct sts_word* a)
+{
+  return a->w == ud->w && a->c == ud->c
+         && (a->n_values == 0 || a->n_values == ud->n);
+}
+
+static void add_to_library(lua_State* lua, library* ud, int ind)
+{
+  const struct sts_word* a = check_word_or_window(lua, ind);
+  luaL_argcheck(lua, fits_library(ud, a), ind,
+                "word doesn't fit the library");
+  if (!sts_library_add(ud->lib, a)) {
+    luaL_error(lua, "memory allocation failed");
+  }
+}
+
+/*
+ * Pushes a library of the words in the table at ind, of n values or, if n is
+ * 0, of the first word telling it (w for SAX strings)
+ */
+static library* push_table_library(lua_State* lua, int ind, size_t n)
+{
+  size_t size = lua_objlen(lua, ind);
+  luaL_argcheck(lua, size > 0, ind, "non-empty array of words expected");
+  lua_rawgeti(lua, ind, 1);
+  const struct sts_word* first = check_word_or_window(lua, -1);
+  size_t w = first->w;
+  unsigned int c = first->c;
+  lua_pop(lua, 1);
+  for (size_t i = 1; i <= size && n == 0; ++i) {
+    lua_rawgeti(lua, ind, (int)i);
+    n = check_word_or_window(lua, -1)->n_values;
+    lua_pop(lua, 1);
+  }
+  library* ud = push_library(lua, n ? n : w, w, c);
+  for (size_t i = 1; i <= size; ++i) {
+    lua_rawgeti(lua, ind, (int)i);
+    add_to_library(lua, ud, lua_gettop(lua));
+    lua_pop(lua, 1);
+  }
+  return ud;
+}
+
+static int sax_new_library(lua_State* lua)
+{
+  int argc = lua_gettop(lua);
+  if (argc == 1) {
+    luaL_checktype(lua, 1, LUA_TTABLE);
+    push_table_library(lua, 1, 0);
+    return 1;
+  }
+  luaL_argcheck(lua, argc == 3, 0, "incorrect number of args");
+  int n = luaL_checkint(lua, 1);
+  int w = luaL_checkint(lua, 2);
+  int c = luaL_checkint(lua, 3);
+  check_nwc(lua, n, w, c, 1);
+  push_library(lua, n, w, c);
+  return 1;
+}
+
+static int sax_library_add(lua_State* lua)
+{
+  luaL_argcheck(lua, lua_gettop(lua) == 2, 0, "incorrect number of args");
+  library* ud = check_library(lua, 1);
+  add_to_library(lua, ud, 2);
+  lua_pushnumber(lua, (lua_Number)sts_library_size(ud->lib));
+  return 1;
+}
+
+static int sax_library_clear(lua_State* lua)
+{
+  library* ud = check_library(lua, 1);
+  sts_library_clear(ud->lib);
+  return 0;
+}
+
+static int sax_library_len(lua_State* lua)
+{
+  library* ud = check_library(lua, 1);
+  lua_pushnumber(lua, (lua_Number)sts_library_size(ud->lib));
+  return 1;
+}
+
+static int sax_gc_library(lua_State* lua)
+{
+  library* ud = check_library(lua, 1);
+  sts_free_library(ud->lib);
+  ud->lib = NULL;
+  return 0;
+}
+
+static int sax_nearest(lua_State* lua)
+{
+  int argc = lua_gettop(lua);
+  luaL_argcheck(lua, argc == 3 || argc == 4, 0, "incorrect number of args");
+  const struct sts_word* query = check_word_or_window(lua, 1);
+  int k = luaL_checkint(lua, 3);
+  double threshold = luaL_optnumber(lua, 4, HUGE_VAL);
+  luaL_argcheck(lua, k > 0, 3, "k should be positive");
+  luaL_argcheck(lua, threshold >= 0, 4, "threshold should be non-negative");
+  library* ud = lua_istable(lua, 2)
+                ? push_table_library(lua, 2, query->n_values)
+                : check_library(lua, 2);
+  luaL_argcheck(lua, fits_library(ud, query), 1,
+                "query doesn't fit the words");
+  size_t size = sts_library_size(ud->lib);
+  if ((size_t)k > size) k = (int)size;
+  size_t* indices = lua_newuserdata(lua, k * (sizeof(size_t)
+                                              + sizeof(double)));
+  double* distances = (double*)(indices + k);
+  size_t found = sts_library_nearest(ud->lib, query, k, threshold, indices,
+                                     distances);
+  lua_createtable(lua, (int)found, 0);
+  lua_createtable(lua, (int)found, 0);
+  for (size_t i = 0; i < found; ++i) {
+    lua_pushnumber(lua, (lua_Number)indices[i] + 1);
+    lua_rawseti(lua, -3, (int)i + 1);
+    lua_pushnumber(lua, distances[i]);
+    lua_rawseti(lua, -2, (int)i + 1);
+  }
+  return 2;
+}
+
 #ifdef LUA_SANDBOX
 
 static bool all_nans(double* array, size_t size)
@@ -290,12 +724,50 @@ static bool all_nans(double* array, size_t size)
   return true;
 }
 
+static bool is_library(lua_State* lua, int ind)
+{
+  if (!lua_getmetatable(lua, ind)) return false;
+  lua_getfield(lua, LUA_REGISTRYINDEX, mozsvc_sax_library);
+  bool equal = lua_rawequal(lua, -1, -2);
+  lua_pop(lua, 2);
+  return equal;
+}
+
+/*
+ * Restores a library word by word from SAX strings
+ */
+static int serialize_library(lua_State* lua,
+                             lsb_output_buffer* ob,
+                             const char* key)
+{
+  const library* ud = lua_touserdata(lua, -3);
+  if (lsb_outputf(ob,
+                  "if %s == nil then %s = sax.library.new(%" PRIuSIZE
+                  ", %" PRIuSIZE ", %" PRIuSIZE ") end\n%s:clear()\n",
+                  key, key, ud->n, ud->w, (size_t)ud->c, key)) return 1;
+  struct sts_word view;
+  for (size_t i = 0; sts_library_word(ud->lib, i, &view); ++i) {
+    char* sax = sts_word_to_sax_string(&view);
+    if (!sax) {
+      return luaL_error(lua, "memory allocation failed");
+    }
+    if (lsb_outputf(ob, "%s:add(sax.word.new(\"%s\", %" PRIuSIZE "))\n",
+                    key, sax, (size_t)ud->c)) {
+      free(sax);
+      return 1;
+    }
+    free(sax);
+  }
+  return 0;
+}
+
 static int serialize_sax(lua_State* lua)
 {
   lsb_output_buffer* ob = lua_touserdata(lua, -1);
   const char* key = lua_touserdata(lua, -2);
-  sax_type type = sax_gettype(lua, -3);
   if (!key || !ob) return 1;
+  if (is_library(lua, -3)) return serialize_library(lua, ob, key);
+  sax_type type = sax_gettype(lua, -3);
   switch (type) {
   case SAX_WINDOW:
     {
@@ -330,7 +802,7 @@ static int serialize_sax(lua_State* lua)
       if (lsb_outputf(ob,
                       "if %s == nil then %s = sax.word.new(\"%s\", %" PRIuSIZE
                       ") end\n",
-                      key, key, sax, a->c)) {
+                      key, key, sax, (size_t)a->c)) {
         free(sax);
         return 1;
       }
@@ -362,22 +834,6 @@ static int output_sax(lua_State* lua)
 
 #endif // LUA_SANDBOX
 
-static int sax_gc_window(lua_State* lua)
-{
-  luaL_argcheck(lua, lua_gettop(lua) == 1, 0, "incorrect number of arguments");
-  sts_window win = check_sax_window(lua, 1);
-  sts_free_window(win);
-  return 0;
-}
-
-static int sax_gc_word(lua_State* lua)
-{
-  luaL_argcheck(lua, lua_gettop(lua) == 1, 0, "incorrect number of arguments");
-  sts_word a = check_sax_word(lua, 1);
-  sts_free_word(a);
-  return 0;
-}
-
 static int sax_version(lua_State* lua)
 {
   lua_pushstring(lua, DIST_VERSION);
@@ -387,22 +843,32 @@ static int sax_version(lua_State* lua)
 static const struct luaL_Reg saxlib_f[] =
 {
   { "mindist", sax_mindist }
+  , { "sliding_words", sax_sliding_words }
+  , { "nearest", sax_nearest }
   , { "version", sax_version }
   , { NULL, NULL }
 };
 
 static const struct luaL_Reg saxlib_word[] =
 {
-  { "__gc", sax_gc_word }
-  , { "__tostring", sax_to_string }
+  { "__tostring", sax_to_string }
+  , { NULL, NULL }
+};
+
+static const struct luaL_Reg saxlib_library[] =
+{
+  { "add", sax_library_add }
+  , { "clear", sax_library_clear }
+  , { "__len", sax_library_len }
+  , { "__gc", sax_gc_library }
   , { NULL, NULL }
 };
 
 static const struct luaL_Reg saxlib_win[] =
 {
   { "add", sax_add }
+  , { "add_collect", sax_add_collect }
   , { "clear", sax_clear }
-  , { "__gc", sax_gc_window }
   , { "__tostring", sax_to_string }
   , { "get_word", sax_window_get_word }
   , { NULL, NULL }
@@ -445,6 +911,13 @@ int luaopen_sax(lua_State* lua)
    * (otherwise it doesn't get called on different object types) */
   lua_pushcfunction(lua, sax_equal);
 
+  // libraries are compared by identity, without sax_equal
+  luaL_newmetatable(lua, mozsvc_sax_library);
+  lua_pushvalue(lua, -1);
+  lua_setfield(lua, -2, "__index");
+  luaL_register(lua, NULL, saxlib_library);
+  lua_pop(lua, 1);
+
   reg_class(lua, mozsvc_sax_window, saxlib_win);
   reg_class(lua, mozsvc_sax_word, saxlib_word);
 
@@ -452,6 +925,7 @@ int luaopen_sax(lua_State* lua)
   luaL_register(lua, NULL, saxlib_f);
   reg_module(lua, mozsvc_sax_word_suffix, sax_new_word);
   reg_module(lua, mozsvc_sax_win_suffix, sax_new_window);
+  reg_module(lua, mozsvc_sax_library_suffix, sax_new_library);
   lua_pushvalue(lua, -1);
   lua_setfield(lua, LUA_GLOBALSINDEX, mozsvc_sax_table);
 
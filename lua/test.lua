@@ -64,6 +64,138 @@ for i=1,5 do
     assert(a == window)
 end
 
+-- words and windows own their storage, a copy outlives its window
+local copy = window:get_word()
+window:clear()
+window = nil
+collectgarbage()
+assert(copy == a and tostring(copy) == tostring(a), "word copy changed")
+
+local window = sax.window.new(1024, 8, 4)
+local window1 = sax.window.new(1024, 8, 4)
+local values = {}
+for i=1,3000 do values[i] = math.sin(i / 50) + i % 7 end
+window:add(values) -- longer than n and than a stack chunk
+for i=1,3000 do window1:add(values[i]) end
+assert(window == window1, "table add differs from value adds")
+values[2500] = "a" -- past the first stack chunk
+assert(not pcall(window.add, window, values), "invalid value added")
+assert(window == window1, "failed add changed the window")
+values[2500] = math.sin(2500 / 50) + 2500 % 7
+values[1] = "x" -- before the last n values, checked though not copied
+assert(not pcall(window.add, window, values), "invalid leading value added")
+assert(window == window1, "failed add changed the window")
+values[1] = math.sin(1 / 50) + 1 % 7
+
+-- packs normal numbers and zero into little-endian IEEE 754 strings
+local function pack(x, mantissa_bits, exponent_bias, size)
+    local sign = 0
+    if x < 0 then sign, x = 1, -x end
+    local mantissa, exponent = 0, 0
+    if x ~= 0 then
+        local m, e = math.frexp(x)
+        mantissa = (m * 2 - 1) * 2^mantissa_bits
+        exponent = e - 1 + exponent_bias
+    end
+    local bytes = {}
+    local whole = math.floor(mantissa_bits / 8)
+    for i=1,whole do
+        bytes[i] = mantissa % 256
+        mantissa = math.floor(mantissa / 256)
+    end
+    -- the top byte of the mantissa, exponent and sign fit a double exactly
+    local exponent_bits = size * 8 - 1 - mantissa_bits
+    local rest = mantissa + (exponent + sign * 2^exponent_bits)
+                 * 2^(mantissa_bits % 8)
+    for i=whole + 1,size do
+        bytes[i] = rest % 256
+        rest = math.floor(rest / 256)
+    end
+    return string.char(unpack(bytes))
+end
+
+local values = {1, 2, 3, 10.5, -4, 7, 0, 2.25}
+local doubles, floats = {}, {}
+for i=1,#values do
+    doubles[i] = pack(values[i], 52, 1023, 8)
+    floats[i] = pack(values[i], 23, 127, 4)
+end
+doubles, floats = table.concat(doubles), table.concat(floats)
+local expected = sax.word.new(values, 4, 8)
+assert(sax.word.new(doubles, 4, 8) == expected, "packed doubles differ")
+assert(sax.word.new(floats, 4, 8, "f") == expected, "packed floats differ")
+local window = sax.window.new(8, 4, 8)
+window:add(doubles .. doubles, "d") -- longer than n
+assert(window == expected, "added packed doubles differ")
+window:clear()
+window:add(floats, "f")
+assert(window == expected, "added packed floats differ")
+window:clear()
+local numbers = sax.window.new(8, 4, 8)
+for i=1,8 do
+    window:add("1234567" .. i) -- numeric strings aren't packed values
+    numbers:add(12345670 + i)
+end
+assert(window == numbers, "numeric strings weren't added as numbers")
+
+local values = {}
+for i=1,200 do values[i] = math.sin(i / 10) * 5 + i % 3 end
+values[50] = 0/0
+local words = sax.sliding_words(values, 20, 4, 6, 3)
+local list = sax.sliding_words(values, 20, 4, 6, 3, "table")
+assert(#words == 61 * 4 and #list == 61, "wrong number of sliding words")
+for k=0,60 do
+    local slice = {}
+    for i=1,20 do slice[i] = values[3 * k + i] end
+    local expected = sax.word.new(slice, 4, 6)
+    assert(words:sub(4 * k + 1, 4 * k + 4) == tostring(expected)
+           and list[k + 1] == expected, "sliding word " .. k .. " differs")
+end
+assert(sax.sliding_words(doubles, 4, 2, 8) ==
+       sax.sliding_words({1, 2, 3, 10.5, -4, 7, 0, 2.25}, 4, 2, 8),
+       "packed sliding words differ")
+
+local window, window1 = sax.window.new(20, 4, 6), sax.window.new(20, 4, 6)
+window:add({1, 2, 3})
+window1:add({1, 2, 3})
+local collected = window:add_collect(values)
+for i=1,#values do
+    window1:add(values[i])
+    assert(collected:sub(4 * i - 3, 4 * i) == tostring(window1),
+           "collected word " .. i .. " differs")
+end
+assert(window == window1, "add_collect didn't append")
+
+local references = sax.sliding_words(values, 20, 4, 6, 2, "table")
+local library = sax.library.new(references)
+assert(#library == #references, "wrong library size")
+local query = sax.word.new("ABFC", 6)
+for _, words in ipairs({references, library}) do
+    local indices, distances = sax.nearest(query, words, 5)
+    assert(#indices == 5 and #distances == 5, "wrong number of neighbours")
+    for r=1,5 do
+        local d = sax.mindist(query, references[indices[r]])
+        assert(math.abs(d - distances[r]) < 1e-9, "wrong distance")
+        assert(r == 1 or distances[r - 1] <= distances[r], "not sorted")
+        local closer = 0
+        for i=1,#references do
+            if sax.mindist(query, references[i]) < d - 1e-9 then
+                closer = closer + 1
+            end
+        end
+        assert(closer < r, "missed a closer word")
+    end
+end
+local indices, distances = sax.nearest(query, library, #library, 1)
+for r=1,#distances do assert(distances[r] <= 1, "threshold ignored") end
+assert(library:add(query) == #references + 1, "word not added")
+local indices = sax.nearest(query, library, #library, 0) -- ties by index
+assert(indices[#indices] == #library, "added word not found")
+library:clear()
+assert(#library == 0, "library not cleared")
+assert(#sax.nearest(query, library, 5) == 0, "cleared library found words")
+assert(library:add(query) == 1, "word not added after clear")
+
 local errors = {
     function() local sw = sax.window.new() end, -- new() incorrect # args
     function() local sw = sax.window.new(nil, 2, 2) end, -- invalid parameters types
@@ -99,10 +231,25 @@ local errors = {
     function() sax.mindist(1, word) end,
     function(win) win:add() end,
     function(win) win:add("a") end,
+    function(win) win:add(string.rep("a", 8)) end, -- packed without format
+    function(win) win:add(string.rep("a", 8), nil) end,
+    function(win) win:add(string.rep("a", 8), "x") end, -- unknown format
+    function(win) win:add(string.rep("a", 8), "f", 1) end,
+    function(win) local w = sax.word.new(string.rep("a", 12), 3, 4) end,
     function(win) win:add({1, "a"}) end,
     function(win) win.add(w1, 1) end,
     function(win) win.get_word(w1) end,
     function(win) win.clear(w1) end,
+    function() sax.sliding_words({1, 2, 3, 4}, 4, 2) end,
+    function() sax.sliding_words({1, 2, 3, 4}, 4, 2, 4, 0) end,
+    function() sax.sliding_words({1, 2, 3, 4}, 4, 2, 4, 1, "list") end,
+    function(win) win:add_collect(1) end,
+    function() sax.library.new({}) end,
+    function() sax.library.new({sax.word.new("AB", 4), sax.word.new("ABC", 4)}) end,
+    function() sax.nearest(sax.word.new("AB", 4), {sax.word.new("AB", 4)}, 0) end,
+    function() sax.nearest(sax.word.new("AB", 4), {sax.word.new("AB", 5)}, 1) end,
+    function() sax.nearest(sax.word.new("AB", 4), {sax.word.new("AB", 4)}, 1, -1) end,
+    function() sax.library.new(4, 2, 4):add(sax.word.new("ABC", 4)) end,
 }
 
 local function test_errors()
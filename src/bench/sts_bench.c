@@ -0,0 +1,380 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Kernel benchmarks of the public API. Sweeps n, w, c and NaN density over
+ * synthetic series and prints one JSON document to stdout:
+ *
+ *   sts_bench [--quick] [--min-time seconds]
+ *
+ * Cycles come from perf_event_open when the kernel allows it and are null
+ * otherwise. Allocations are counted through the linker's --wrap of malloc,
+ * calloc and realloc, and are null in builds without it. */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#else
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "symtseries.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef STS_BENCH_WRAP_MALLOC
+static uint64_t allocations;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+  ++allocations;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+  ++allocations;
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+  ++allocations;
+  return __real_realloc(ptr, size);
+}
+#endif
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Cycle counter of this thread or -1 if perf events aren't available
+ */
+static int open_cycles(void)
+{
+#if defined(__linux__)
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof attr;
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+static void start_cycles(int fd)
+{
+#if defined(__linux__)
+  if (fd < 0) return;
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#else
+  (void)fd;
+#endif
+}
+
+static double stop_cycles(int fd)
+{
+#if defined(__linux__)
+  uint64_t count;
+  if (fd < 0) return -1;
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(fd, &count, sizeof count) != sizeof count) return -1;
+  return (double)count;
+#else
+  (void)fd;
+  return -1;
+#endif
+}
+
+/*
+ * xorshift64*, deterministic across platforms unlike rand()
+ */
+static uint64_t rng_state;
+
+static double uniform(void)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  uint64_t x = rng_state * 2685821657736338717ULL;
+  return ((x >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gaussian(void)
+{
+  return sqrt(-2 * log(uniform())) * cos(6.283185307179586 * uniform());
+}
+
+typedef enum {
+  DATA_RANDOM_WALK,
+  DATA_SEASONAL,
+  DATA_HEAVY_TAILED
+} data_kind;
+
+static const char* data_names[] = { "random_walk", "seasonal",
+                                    "heavy_tailed" };
+
+static void generate(data_kind kind,
+                     double nan_density,
+                     double* series,
+                     size_t n_values)
+{
+  rng_state = 0x9E3779B97F4A7C15ULL + kind;
+  double level = 0;
+  for (size_t i = 0; i < n_values; ++i) {
+    switch (kind) {
+    case DATA_RANDOM_WALK:
+      level += gaussian();
+      series[i] = level;
+      break;
+    case DATA_SEASONAL:
+      series[i] = 10 * sin(6.283185307179586 * i / 96)
+                  + 3 * sin(6.283185307179586 * i / 7) + gaussian();
+      break;
+    case DATA_HEAVY_TAILED:
+      // Cauchy
+      series[i] = tan(3.141592653589793 * (uniform() - 0.5));
+      break;
+    }
+    if (uniform() < nan_density) series[i] = NAN;
+  }
+}
+
+typedef struct {
+  size_t n, w;
+  unsigned int c;
+  double nan_density;
+  data_kind data;
+  const double* series;
+  size_t n_series;
+  sts_window window;
+  sts_word a, b;
+  size_t pos;
+  volatile uint64_t sink;
+} bench_state;
+
+typedef void (*bench_op)(bench_state* s, size_t n_ops);
+
+static void op_append_value(bench_state* s, size_t n_ops)
+{
+  for (size_t i = 0; i < n_ops; ++i) {
+    const struct sts_word* word = sts_append_value(s->window,
+                                                   s->series[s->pos]);
+    if (word) s->sink += word->symbols[0];
+    if (++s->pos == s->n_series) s->pos = 0;
+  }
+}
+
+static void op_append_array(bench_state* s, size_t n_ops)
+{
+  for (size_t i = 0; i < n_ops; ++i) {
+    if (s->pos + s->n > s->n_series) s->pos = 0;
+    const struct sts_word* word = sts_append_array(s->window,
+                                                   s->series + s->pos, s->n);
+    if (word) s->sink += word->symbols[0];
+    s->pos += s->n;
+  }
+}
+
+static void op_from_double_array(bench_state* s, size_t n_ops)
+{
+  for (size_t i = 0; i < n_ops; ++i) {
+    if (s->pos + s->n > s->n_series) s->pos = 0;
+    sts_word word = sts_from_double_array(s->series + s->pos, s->n, s->w,
+                                          s->c);
+    if (word) s->sink += word->symbols[0];
+    sts_free_word(word);
+    s->pos += s->w;
+  }
+}
+
+static void op_mindist_ab(bench_state* s, size_t n_ops)
+{
+  double above, below, sum = 0;
+  for (size_t i = 0; i < n_ops; ++i) {
+    sum += sts_mindist_ab(s->a, s->b, &above, &below);
+  }
+  s->sink += (uint64_t)(sum == sum);
+}
+
+static void op_word_to_sax_string(bench_state* s, size_t n_ops)
+{
+  for (size_t i = 0; i < n_ops; ++i) {
+    char* str = sts_word_to_sax_string(s->a);
+    if (str) s->sink += (uint64_t)str[0];
+    free(str);
+  }
+}
+
+static const struct {
+  const char* name;
+  bench_op op;
+  bool per_value; // an op covers one value instead of n
+  bool sax_only; // needs c <= STS_MAX_SAX_CARDINALITY
+} ops[] = {
+  { "sts_append_value", op_append_value, true, false },
+  { "sts_append_array", op_append_array, false, false },
+  { "sts_from_double_array", op_from_double_array, false, false },
+  { "sts_mindist_ab", op_mindist_ab, false, false },
+  { "sts_word_to_sax_string", op_word_to_sax_string, false, true }
+};
+
+#define N_OPS (sizeof(ops) / sizeof(ops[0]))
+
+static bool first_result = true;
+
+static void print_number(const char* key, double value, bool last)
+{
+  if (value < 0 || value != value) {
+    printf("\"%s\": null%s", key, last ? "" : ", ");
+  } else {
+    printf("\"%s\": %.6g%s", key, value, last ? "" : ", ");
+  }
+}
+
+static void run_op(size_t k, bench_state* s, double min_time, int cycles_fd)
+{
+  s->window = sts_new_window(s->n, s->w, s->c);
+  s->a = sts_from_double_array(s->series, s->n, s->w, s->c);
+  s->b = sts_from_double_array(s->series + s->n, s->n, s->w, s->c);
+  s->pos = 0;
+  if (!s->window || !s->a || !s->b) {
+    fprintf(stderr, "sts_bench: can't set up n = %" PRIuSIZE ", w = %"
+            PRIuSIZE ", c = %u\n", s->n, s->w, s->c);
+    exit(EXIT_FAILURE);
+  }
+  // warm up, fills the window
+  ops[k].op(s, ops[k].per_value ? s->n : 1);
+
+  size_t n_ops = 1;
+  double elapsed, cycles;
+  uint64_t allocs = 0;
+  for (;;) {
+#ifdef STS_BENCH_WRAP_MALLOC
+    uint64_t allocs_before = allocations;
+#endif
+    start_cycles(cycles_fd);
+    double start = now();
+    ops[k].op(s, n_ops);
+    elapsed = now() - start;
+    cycles = stop_cycles(cycles_fd);
+#ifdef STS_BENCH_WRAP_MALLOC
+    allocs = allocations - allocs_before;
+#endif
+    if (elapsed >= min_time) break;
+    n_ops *= elapsed * 4 < min_time ? 4 : 2;
+  }
+  double samples = (double)n_ops * (ops[k].per_value ? 1 : s->n);
+
+  printf("%s\n    {", first_result ? "" : ",");
+  first_result = false;
+  printf("\"op\": \"%s\", \"data\": \"%s\", \"n\": %" PRIuSIZE ", \"w\": %"
+         PRIuSIZE ", \"c\": %u, ", ops[k].name, data_names[s->data], s->n,
+         s->w, s->c);
+  print_number("nan_density", s->nan_density, false);
+  print_number("ops", (double)n_ops, false);
+  print_number("ns_per_op", elapsed * 1e9 / n_ops, false);
+  print_number("ns_per_sample", elapsed * 1e9 / samples, false);
+  print_number("samples_per_s", samples / elapsed, false);
+  print_number("cycles_per_sample", cycles < 0 ? -1 : cycles / samples,
+               false);
+#ifdef STS_BENCH_WRAP_MALLOC
+  print_number("allocs_per_op", (double)allocs / n_ops, true);
+#else
+  (void)allocs;
+  print_number("allocs_per_op", -1, true);
+#endif
+  printf("}");
+
+  sts_free_window(s->window);
+  sts_free_word(s->a);
+  sts_free_word(s->b);
+}
+
+int main(int argc, char** argv)
+{
+  static const size_t ns[] = { 64, 256, 1024 };
+  static const size_t ws[] = { 8, 32 };
+  static const unsigned int cs[] = { 4, 16, 64 };
+  static const double nan_densities[] = { 0, 0.01, 0.1 };
+  double min_time = 0.05;
+  bool quick = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+      min_time = 0.002;
+    } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      min_time = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--min-time seconds]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  const size_t n_series = 1 << 16;
+  double* series = malloc(n_series * sizeof*series);
+  if (!series) return EXIT_FAILURE;
+  int cycles_fd = open_cycles();
+
+  printf("{\n  \"kernel\": \"%s\",\n  \"cycles\": %s,\n  \"allocs\": %s,\n"
+         "  \"results\": [", sts_active_kernel(),
+         cycles_fd < 0 ? "false" : "true",
+#ifdef STS_BENCH_WRAP_MALLOC
+         "true"
+#else
+         "false"
+#endif
+        );
+  for (int d = DATA_RANDOM_WALK; d <= DATA_HEAVY_TAILED; ++d) {
+    for (size_t di = 0; di < sizeof nan_densities / sizeof *nan_densities;
+         ++di) {
+      if (quick && di > 1) break;
+      generate((data_kind)d, nan_densities[di], series, n_series);
+      for (size_t ni = 0; ni < sizeof ns / sizeof *ns; ++ni) {
+        for (size_t wi = 0; wi < sizeof ws / sizeof *ws; ++wi) {
+          for (size_t ci = 0; ci < sizeof cs / sizeof *cs; ++ci) {
+            bench_state s = { ns[ni], ws[wi], cs[ci], nan_densities[di],
+                              (data_kind)d, series, n_series, NULL, NULL,
+                              NULL, 0, 0 };
+            for (size_t k = 0; k < N_OPS; ++k) {
+              if (ops[k].sax_only && s.c > STS_MAX_SAX_CARDINALITY) continue;
+              run_op(k, &s, min_time, cycles_fd);
+            }
+          }
+        }
+      }
+    }
+  }
+  printf("\n  ]\n}\n");
+
+#if defined(__linux__)
+  if (cycles_fd >= 0) close(cycles_fd);
+#endif
+  free(series);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,273 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/* Replays a recording of sts_start_recording into fresh windows at full
+ * speed, checks every returned word against the recorded one and prints one
+ * JSON document to stdout:
+ *
+ *   sts_replay recording.bin
+ *
+ * The recording is decoded into memory before the clock starts. Windows whose
+ * kind can't be recreated from the recording (fixed, adaptive and SFA ones)
+ * are skipped together with their calls, untracked windows from their 'U'
+ * record on. Exits with failure if a word differs. */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#else
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "symtseries.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+  uint32_t window; // id
+  unsigned char tag; // 'V', 'A', 'R' or 'U' record
+  size_t offset, count; // values of the call
+  uint64_t hash;
+} call;
+
+typedef struct {
+  unsigned char* data;
+  size_t size, pos;
+  sts_window* windows; // by id, NULL if not recreated
+  size_t n_windows, windows_cap, unsupported, untracked;
+  call* calls;
+  size_t n_calls, calls_cap;
+  double* values;
+  size_t n_values, values_cap;
+  uint64_t last_ns;
+} recording;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t word_hash(const struct sts_word* word)
+{
+  if (!word) return 0;
+  uint64_t hash = 14695981039346656037u;
+  for (size_t i = 0; i < word->w; ++i) {
+    hash = (hash ^ (word->symbols[i] & 0xff)) * 1099511628211u;
+    hash = (hash ^ (word->symbols[i] >> 8)) * 1099511628211u;
+  }
+  return hash;
+}
+
+static bool get_le(recording* rec, size_t size, uint64_t* value)
+{
+  if (rec->size - rec->pos < size) return false;
+  *value = 0;
+  for (size_t i = 0; i < size; ++i) {
+    *value |= (uint64_t)rec->data[rec->pos + i] << (8 * i);
+  }
+  rec->pos += size;
+  return true;
+}
+
+static bool get_double(recording* rec, double* value)
+{
+  uint64_t bits;
+  if (!get_le(rec, 8, &bits)) return false;
+  memcpy(value, &bits, sizeof(*value));
+  return true;
+}
+
+static bool grow(void** items, size_t* cap, size_t need, size_t item_size)
+{
+  if (need <= *cap) return true;
+  size_t cap_new = *cap ? *cap : 1024;
+  while (cap_new < need) cap_new *= 2;
+  void* grown = realloc(*items, cap_new * item_size);
+  if (!grown) return false;
+  *items = grown;
+  *cap = cap_new;
+  return true;
+}
+
+static sts_window recreate_window(uint64_t n,
+                                  uint64_t w,
+                                  uint64_t c,
+                                  uint64_t c_slope,
+                                  uint64_t normalization,
+                                  uint64_t encoding,
+                                  uint64_t adaptive)
+{
+  if (adaptive) return NULL;
+  if (normalization == STS_NORM_ZSCORE) {
+    switch (encoding) {
+    case STS_ENC_SAX:
+      return sts_new_window(n, w, (unsigned int)c);
+    case STS_ENC_ESAX:
+      return sts_new_esax_window(n, w, (unsigned int)c);
+    case STS_ENC_1DSAX:
+      return sts_new_1dsax_window(n, w, (unsigned int)c,
+                                  (unsigned int)c_slope);
+    default:
+      return NULL;
+    }
+  }
+  if (normalization == STS_NORM_ROBUST && encoding == STS_ENC_SAX) {
+    return sts_new_robust_window(n, w, (unsigned int)c);
+  }
+  return NULL;
+}
+
+static bool decode_window(recording* rec)
+{
+  uint64_t id, n, w, c, c_slope, normalization, encoding, adaptive;
+  if (!get_le(rec, 4, &id) || !get_le(rec, 8, &n) || !get_le(rec, 8, &w)
+      || !get_le(rec, 4, &c) || !get_le(rec, 4, &c_slope)
+      || !get_le(rec, 1, &normalization) || !get_le(rec, 1, &encoding)
+      || !get_le(rec, 1, &adaptive)) {
+    return false;
+  }
+  if (id != rec->n_windows + 1
+      || !grow((void**)&rec->windows, &rec->windows_cap, id,
+               sizeof*rec->windows)) {
+    return false;
+  }
+  sts_window window = recreate_window(n, w, c, c_slope, normalization,
+                                      encoding, adaptive);
+  rec->windows[rec->n_windows++] = window;
+  if (!window) ++rec->unsupported;
+  return true;
+}
+
+static bool decode_call(recording* rec, unsigned char tag)
+{
+  uint64_t id, ns, count = tag == 'V';
+  if (!get_le(rec, 4, &id) || !get_le(rec, 8, &ns)
+      || (tag == 'A' && !get_le(rec, 8, &count))
+      || id == 0 || id > rec->n_windows
+      || count > (rec->size - rec->pos) / 8
+      || !grow((void**)&rec->calls, &rec->calls_cap, rec->n_calls + 1,
+               sizeof*rec->calls)
+      || !grow((void**)&rec->values, &rec->values_cap,
+               rec->n_values + count, sizeof*rec->values)) {
+    return false;
+  }
+  call* cl = rec->calls + rec->n_calls++;
+  cl->window = (uint32_t)id;
+  cl->offset = rec->n_values;
+  cl->tag = tag;
+  cl->count = (size_t)count;
+  cl->hash = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    if (!get_double(rec, rec->values + rec->n_values++)) return false;
+  }
+  rec->last_ns = ns;
+  return tag == 'R' || tag == 'U' || get_le(rec, 8, &cl->hash);
+}
+
+static bool decode(recording* rec)
+{
+  if (rec->size < 8 || memcmp(rec->data, STS_RECORD_MAGIC, 8) != 0) {
+    return false;
+  }
+  rec->pos = 8;
+  while (rec->pos < rec->size) {
+    unsigned char tag = rec->data[rec->pos++];
+    bool decoded = tag == 'W' ? decode_window(rec)
+                   : tag == 'V' || tag == 'A' || tag == 'R' || tag == 'U'
+                   ? decode_call(rec, tag)
+                   : false;
+    if (!decoded) return false;
+  }
+  return true;
+}
+
+static bool read_file(const char* path, recording* rec)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file) return false;
+  bool read = fseek(file, 0, SEEK_END) == 0;
+  long size = read ? ftell(file) : -1;
+  read = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+  rec->data = read ? malloc((size_t)size + 1) : NULL;
+  rec->size = (size_t)size;
+  read = rec->data && fread(rec->data, 1, rec->size, file) == rec->size;
+  fclose(file);
+  return read;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s recording.bin\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  recording rec;
+  memset(&rec, 0, sizeof(rec));
+  if (!read_file(argv[1], &rec)) {
+    fprintf(stderr, "sts_replay: can't read %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  if (!decode(&rec)) {
+    fprintf(stderr, "sts_replay: %s is corrupt at byte %" PRIuSIZE "\n",
+            argv[1], rec.pos);
+    return EXIT_FAILURE;
+  }
+
+  size_t replayed = 0, values = 0, mismatches = 0, first_mismatch = 0;
+  double start = now();
+  for (size_t i = 0; i < rec.n_calls; ++i) {
+    const call* cl = rec.calls + i;
+    sts_window window = rec.windows[cl->window - 1];
+    if (!window) continue;
+    if (cl->tag == 'U') {
+      sts_free_window(window);
+      rec.windows[cl->window - 1] = NULL;
+      ++rec.untracked;
+      continue;
+    }
+    if (cl->tag == 'R') {
+      sts_reset_window(window);
+      ++replayed;
+      continue;
+    }
+    const double* vals = rec.values + cl->offset;
+    const struct sts_word* word = cl->tag == 'A'
+                                  ? sts_append_array(window, vals, cl->count)
+                                  : sts_append_value(window, vals[0]);
+    if (word_hash(word) != cl->hash && mismatches++ == 0) first_mismatch = i;
+    ++replayed;
+    values += cl->count;
+  }
+  double elapsed = now() - start;
+
+  printf("{\n  \"file\": \"%s\",\n  \"kernel\": \"%s\",\n", argv[1],
+         sts_active_kernel());
+  printf("  \"windows\": %" PRIuSIZE ", \"unsupported_windows\": %" PRIuSIZE
+         ", \"untracked_windows\": %" PRIuSIZE ",\n", rec.n_windows,
+         rec.unsupported, rec.untracked);
+  printf("  \"calls\": %" PRIuSIZE ", \"skipped_calls\": %" PRIuSIZE
+         ", \"values\": %" PRIuSIZE ",\n", replayed, rec.n_calls - replayed,
+         values);
+  printf("  \"recorded_s\": %.6f, \"replay_s\": %.6f, \"speedup\": %.3g,\n",
+         rec.last_ns * 1e-9, elapsed,
+         elapsed > 0 ? rec.last_ns * 1e-9 / elapsed : 0);
+  printf("  \"calls_per_s\": %.6g, \"values_per_s\": %.6g,\n",
+         elapsed > 0 ? replayed / elapsed : 0,
+         elapsed > 0 ? values / elapsed : 0);
+  printf("  \"mismatches\": %" PRIuSIZE, mismatches);
+  if (mismatches) printf(", \"first_mismatch\": %" PRIuSIZE, first_mismatch);
+  printf("\n}\n");
+
+  for (size_t i = 0; i < rec.n_windows; ++i) sts_free_window(rec.windows[i]);
+  free(rec.windows);
+  free(rec.calls);
+  free(rec.values);
+  free(rec.data);
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
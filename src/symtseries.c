@@ -6,13 +6,26 @@
  * the latest of which can be found here:
  * http://www.cs.ucr.edu/~eamonn/iSAX_2.0.pdf */
 
+#if (defined(STS_ENABLE_STATS) || defined(STS_ENABLE_RECORDING)) \
+    && !defined(_MSC_VER)
+// clock_gettime
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include "symtseries.h"
 
+#include <assert.h>
 #include <float.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include <stdbool.h>
+#if defined(STS_ENABLE_STATS) || defined(STS_ENABLE_RECORDING)
+#include <time.h>
+#endif
+#ifdef STS_ENABLE_RECORDING
+#include <stdio.h>
+#endif
 
 #ifdef _MSC_VER
 // To silence the +INFINITY warning
@@ -22,235 +35,276 @@
 #pragma warning( disable : 4305 )
 #endif
 
-/* Breakpoints used in iSAX symbol estimation */
-static const float breaks[STS_MAX_CARDINALITY - 1][STS_MAX_CARDINALITY - 1] =
-{
-  { 0.0 },
-  { -0.430, 0.430 },
-  { -0.674, 0.0, 0.674 },
-  { -0.841, -0.253, 0.253, 0.841 },
-  { -0.967, -0.430, 0.0, 0.430, 0.967 },
-  { -1.067, -0.565, -0.180, 0.180, 0.565, 1.067 },
-  { -1.150, -0.674, -0.318, 0.0, 0.318, 0.674, 1.150 },
-  { -1.220, -0.764, -0.430, -0.139, 0.139, 0.430, 0.764, 1.220 },
-  { -1.281, -0.841, -0.524, -0.253, 0.0, 0.253, 0.524, 0.841, 1.281 },
-  { -1.335, -0.908, -0.604, -0.348, -0.114, 0.114, 0.348, 0.604, 0.908, 1.335 },
-  { -1.382, -0.967, -0.674, -0.430, -0.210, 0.0, 0.210, 0.430, 0.674, 0.967,
-    1.382 },
-  { -1.426, -1.020, -0.736, -0.502, -0.293, -0.096, 0.096, 0.293, 0.502, 0.736,
-    1.020, 1.426 },
-  { -1.465, -1.067, -0.791, -0.565, -0.366, -0.180, 0.0, 0.180, 0.366, 0.565,
-    0.791, 1.067, 1.465, },
-  { -1.501, -1.110, -0.841, -0.622, -0.430, -0.253, -0.083, 0.083, 0.253, 0.430,
-    0.622, 0.841, 1.110, 1.501 },
-  { -1.534, -1.150, -0.887, -0.674, -0.488, -0.318, -0.157, 0.0, 0.157, 0.318,
-    0.488, 0.674, 0.887, 1.150, 1.534 }
-};
-
-static const float mindist_2[4] = { 0 };
+/*
+ * Runs f once when the library is loaded, before any of its functions can be
+ * called, so that tables it fills are read-only afterwards
+ */
+#if defined(__GNUC__)
+#define STS_CONSTRUCTOR(f)                                                     \
+  static void f(void) __attribute__((constructor));                            \
+  static void f(void)
+#elif defined(_MSC_VER)
+#pragma section(".CRT$XCU", read)
+#ifdef _WIN64
+#define STS_CONSTRUCTOR_PREFIX ""
+#else
+#define STS_CONSTRUCTOR_PREFIX "_"
+#endif
+#define STS_CONSTRUCTOR(f)                                                     \
+  static void f(void);                                                         \
+  __declspec(allocate(".CRT$XCU")) void (*f##_)(void) = f;                     \
+  __pragma(comment(linker, "/include:" STS_CONSTRUCTOR_PREFIX #f "_"))         \
+  static void f(void)
+#else
+#error "symtseries needs load-time initialization, see STS_CONSTRUCTOR"
+#endif
 
-static const float mindist_3[] = {
-  0.000, 0.000, 0.861,
-  0.000, 0.000, 0.000,
-  0.861, 0.000, 0.000
-};
+/*
+ * Breakpoints used in iSAX symbol estimation. Row of cardinality c holds c - 1
+ * ascending breakpoints splitting N(0, 1) into c equiprobable regions and
+ * starts at breaks_table[(c - 2) * (c - 1) / 2]. Rows are generated from the
+ * inverse normal CDF: up to STS_LEGACY_CARDINALITY when the library is loaded,
+ * larger ones by get_breaks the first time they are used
+ */
+#define STS_BREAKS_TABLE_SIZE \
+  ((STS_MAX_CARDINALITY - 1) * STS_MAX_CARDINALITY / 2)
+static float breaks_table[STS_BREAKS_TABLE_SIZE];
 
-static const float mindist_4[] = {
-  0.000, 0.000, 0.674, 1.349,
-  0.000, 0.000, 0.000, 0.674,
-  0.674, 0.000, 0.000, 0.000,
-  1.349, 0.674, 0.000, 0.000
-};
+// Largest symbol value, bounds packed 1d-SAX symbols
+#define STS_MAX_SYMBOL ((sts_symbol)~(sts_symbol)0)
 
-static const float mindist_5[] = {
-  0.000, 0.000, 0.588, 1.095, 1.683,
-  0.000, 0.000, 0.000, 0.507, 1.095,
-  0.588, 0.000, 0.000, 0.000, 0.588,
-  1.095, 0.507, 0.000, 0.000, 0.000,
-  1.683, 1.095, 0.588, 0.000, 0.000
-};
+/*
+ * Published iSAX tables truncate breakpoints to 3 digits and round symbol
+ * distances to 3 digits. Cardinalities up to 16 keep these values, so that
+ * existing words and distances don't change, and are the only ones with
+ * a c * c distance table. Larger cardinalities take distances straight from
+ * the breakpoint row, which is c floats instead of c * c.
+ */
+#define STS_LEGACY_CARDINALITY 16
+static float legacy_dist[STS_LEGACY_CARDINALITY - 1]
+[STS_LEGACY_CARDINALITY * STS_LEGACY_CARDINALITY];
 
-static const float mindist_6[] = {
-  0.000, 0.000, 0.537, 0.967, 1.398, 1.935,
-  0.000, 0.000, 0.000, 0.431, 0.861, 1.398,
-  0.537, 0.000, 0.000, 0.000, 0.431, 0.967,
-  0.967, 0.431, 0.000, 0.000, 0.000, 0.537,
-  1.398, 0.861, 0.431, 0.000, 0.000, 0.000,
-  1.935, 1.398, 0.967, 0.537, 0.000, 0.000
-};
+/*
+ * Acklam's rational approximation of the inverse normal CDF refined with one
+ * step of Halley's method, which gives full double precision
+ */
+static double normal_quantile(double p)
+{
+  static const double a[] = { -3.969683028665376e+01, 2.209460984245205e+02,
+    -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01,
+    2.506628277459239e+00 };
+  static const double b[] = { -5.447609879822406e+01, 1.615858368580409e+02,
+    -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01 };
+  static const double c[] = { -7.784894002430293e-03, -3.223964580411365e-01,
+    -2.400758277161838e+00, -2.549671348171257e+00, 4.374664141464968e+00,
+    2.938163982698783e+00 };
+  static const double d[] = { 7.784695709041462e-03, 3.224671290700398e-01,
+    2.445134137142996e+00, 3.754408661907416e+00 };
+  static const double p_low = 0.02425;
+  double x;
+  if (p < p_low) {
+    double q = sqrt(-2 * log(p));
+    x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5])
+      / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+  } else if (p <= 1 - p_low) {
+    double q = p - 0.5;
+    double r = q * q;
+    x = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5])
+      * q / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+  } else {
+    double q = sqrt(-2 * log(1 - p));
+    x = -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5])
+      / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+  }
+  if (x != 0) {
+    double e = 0.5 * erfc(-x / sqrt(2)) - p;
+    double u = e * 2.50662827463100050242 * exp(x * x / 2);
+    x = x - u / (1 + x * u / 2);
+  }
+  return x;
+}
 
-static const float mindist_7[] = {
-  0.000, 0.000, 0.502, 0.888, 1.248, 1.634, 2.135,
-  0.000, 0.000, 0.000, 0.386, 0.746, 1.132, 1.634,
-  0.502, 0.000, 0.000, 0.000, 0.360, 0.746, 1.248,
-  0.888, 0.386, 0.000, 0.000, 0.000, 0.386, 0.888,
-  1.248, 0.746, 0.360, 0.000, 0.000, 0.000, 0.502,
-  1.634, 1.132, 0.746, 0.386, 0.000, 0.000, 0.000,
-  2.135, 1.634, 1.248, 0.888, 0.502, 0.000, 0.000
-};
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+  while (b != 0) {
+    unsigned int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
 
-static const float mindist_8[] = {
-  0.000, 0.000, 0.476, 0.832, 1.150, 1.469, 1.825, 2.301,
-  0.000, 0.000, 0.000, 0.356, 0.674, 0.993, 1.349, 1.825,
-  0.476, 0.000, 0.000, 0.000, 0.319, 0.637, 0.993, 1.469,
-  0.832, 0.356, 0.000, 0.000, 0.000, 0.319, 0.674, 1.150,
-  1.150, 0.674, 0.319, 0.000, 0.000, 0.000, 0.356, 0.832,
-  1.469, 0.993, 0.637, 0.319, 0.000, 0.000, 0.000, 0.476,
-  1.825, 1.349, 0.993, 0.674, 0.356, 0.000, 0.000, 0.000,
-  2.301, 1.825, 1.469, 1.150, 0.832, 0.476, 0.000, 0.000
-};
+/*
+ * i-th breakpoint of cardinality c, i.e. the i / c quantile of N(0, 1).
+ * The fraction is reduced first, so that nested breakpoints (i / c == j / C)
+ * are bit-identical across cardinalities
+ */
+static double exact_break(unsigned int i, unsigned int c)
+{
+  unsigned int g = gcd(i, c);
+  i /= g;
+  c /= g;
+  if (2 * i == c) return 0;
+  // Computing the lower half only keeps rows exactly symmetric
+  return 2 * i < c ? normal_quantile((double)i / c)
+                   : -normal_quantile((double)(c - i) / c);
+}
 
-static const float mindist_9[] = {
-  0.000, 0.000, 0.456, 0.790, 1.081, 1.360, 1.651, 1.985, 2.441,
-  0.000, 0.000, 0.000, 0.334, 0.625, 0.904, 1.195, 1.529, 1.985,
-  0.456, 0.000, 0.000, 0.000, 0.291, 0.570, 0.861, 1.195, 1.651,
-  0.790, 0.334, 0.000, 0.000, 0.000, 0.279, 0.570, 0.904, 1.360,
-  1.081, 0.625, 0.291, 0.000, 0.000, 0.000, 0.291, 0.625, 1.081,
-  1.360, 0.904, 0.570, 0.279, 0.000, 0.000, 0.000, 0.334, 0.790,
-  1.651, 1.195, 0.861, 0.570, 0.291, 0.000, 0.000, 0.000, 0.456,
-  1.985, 1.529, 1.195, 0.904, 0.625, 0.334, 0.000, 0.000, 0.000,
-  2.441, 1.985, 1.651, 1.360, 1.081, 0.790, 0.456, 0.000, 0.000
-};
+static double generated_break(unsigned int i, unsigned int c)
+{
+  double value = exact_break(i, c);
+  if (c / gcd(i, c) <= STS_LEGACY_CARDINALITY) {
+    value = trunc(value * 1000) / 1000;
+  }
+  return value;
+}
 
-static const float mindist_10[] = {
-  0.000, 0.000, 0.440, 0.757, 1.028, 1.282, 1.535, 1.806, 2.123, 2.563,
-  0.000, 0.000, 0.000, 0.317, 0.588, 0.842, 1.095, 1.366, 1.683, 2.123,
-  0.440, 0.000, 0.000, 0.000, 0.271, 0.524, 0.778, 1.049, 1.366, 1.806,
-  0.757, 0.317, 0.000, 0.000, 0.000, 0.253, 0.507, 0.778, 1.095, 1.535,
-  1.028, 0.588, 0.271, 0.000, 0.000, 0.000, 0.253, 0.524, 0.842, 1.282,
-  1.282, 0.842, 0.524, 0.253, 0.000, 0.000, 0.000, 0.271, 0.588, 1.028,
-  1.535, 1.095, 0.778, 0.507, 0.253, 0.000, 0.000, 0.000, 0.317, 0.757,
-  1.806, 1.366, 1.049, 0.778, 0.524, 0.271, 0.000, 0.000, 0.000, 0.440,
-  2.123, 1.683, 1.366, 1.095, 0.842, 0.588, 0.317, 0.000, 0.000, 0.000,
-  2.563, 2.123, 1.806, 1.535, 1.282, 1.028, 0.757, 0.440, 0.000, 0.000
-};
+static void fill_breaks(unsigned int c)
+{
+  float* row = breaks_table + (c - 2) * (c - 1) / 2;
+  for (unsigned int i = 1; i < c; ++i) {
+    row[i - 1] = (float)generated_break(i, c);
+  }
+}
 
-static const float mindist_11[] = {
-  0.000, 0.000, 0.427, 0.731, 0.986, 1.221, 1.449, 1.684, 1.940, 2.244, 2.670,
-  0.000, 0.000, 0.000, 0.304, 0.560, 0.794, 1.023, 1.257, 1.513, 1.817, 2.244,
-  0.427, 0.000, 0.000, 0.000, 0.256, 0.490, 0.719, 0.953, 1.209, 1.513, 1.940,
-  0.731, 0.304, 0.000, 0.000, 0.000, 0.235, 0.463, 0.698, 0.953, 1.257, 1.684,
-  0.986, 0.560, 0.256, 0.000, 0.000, 0.000, 0.228, 0.463, 0.719, 1.023, 1.449,
-  1.221, 0.794, 0.490, 0.235, 0.000, 0.000, 0.000, 0.235, 0.490, 0.794, 1.221,
-  1.449, 1.023, 0.719, 0.463, 0.228, 0.000, 0.000, 0.000, 0.256, 0.560, 0.986,
-  1.684, 1.257, 0.953, 0.698, 0.463, 0.235, 0.000, 0.000, 0.000, 0.304, 0.731,
-  1.940, 1.513, 1.209, 0.953, 0.719, 0.490, 0.256, 0.000, 0.000, 0.000, 0.427,
-  2.244, 1.817, 1.513, 1.257, 1.023, 0.794, 0.560, 0.304, 0.000, 0.000, 0.000,
-  2.670, 2.244, 1.940, 1.684, 1.449, 1.221, 0.986, 0.731, 0.427, 0.000, 0.000
-};
+STS_CONSTRUCTOR(init_breaks)
+{
+  for (unsigned int c = STS_MIN_CARDINALITY; c <= STS_LEGACY_CARDINALITY; ++c) {
+    fill_breaks(c);
+    float* dist = legacy_dist[c - STS_MIN_CARDINALITY];
+    for (unsigned int sa = 0; sa < c; ++sa) {
+      for (unsigned int sb = 0; sb < c; ++sb) {
+        // internally we use the reversed iSAX ordering
+        unsigned int lo = c - 1 - (sa > sb ? sa : sb);
+        unsigned int hi = c - 1 - (sa > sb ? sb : sa);
+        double d = hi - lo > 1
+                   ? exact_break(hi, c) - exact_break(lo + 1, c) : 0;
+        dist[sa * c + sb] = (float)(floor(d * 1000 + 0.5) / 1000);
+      }
+    }
+  }
+}
 
-static const float mindist_12[] = {
-  0.000, 0.000, 0.416, 0.709, 0.952, 1.173, 1.383, 1.593, 1.814, 2.057, 2.350, 2.766,
-  0.000, 0.000, 0.000, 0.293, 0.537, 0.757, 0.967, 1.178, 1.398, 1.642, 1.935, 2.350,
-  0.416, 0.000, 0.000, 0.000, 0.244, 0.464, 0.674, 0.885, 1.105, 1.349, 1.642, 2.057,
-  0.709, 0.293, 0.000, 0.000, 0.000, 0.220, 0.431, 0.641, 0.861, 1.105, 1.398, 1.814,
-  0.952, 0.537, 0.244, 0.000, 0.000, 0.000, 0.210, 0.421, 0.641, 0.885, 1.178, 1.593,
-  1.173, 0.757, 0.464, 0.220, 0.000, 0.000, 0.000, 0.210, 0.431, 0.674, 0.967, 1.383,
-  1.383, 0.967, 0.674, 0.431, 0.210, 0.000, 0.000, 0.000, 0.220, 0.464, 0.757, 1.173,
-  1.593, 1.178, 0.885, 0.641, 0.421, 0.210, 0.000, 0.000, 0.000, 0.244, 0.537, 0.952,
-  1.814, 1.398, 1.105, 0.861, 0.641, 0.431, 0.220, 0.000, 0.000, 0.000, 0.293, 0.709,
-  2.057, 1.642, 1.349, 1.105, 0.885, 0.674, 0.464, 0.244, 0.000, 0.000, 0.000, 0.416,
-  2.350, 1.935, 1.642, 1.398, 1.178, 0.967, 0.757, 0.537, 0.293, 0.000, 0.000, 0.000,
-  2.766, 2.350, 2.057, 1.814, 1.593, 1.383, 1.173, 0.952, 0.709, 0.416, 0.000, 0.000
-};
+/*
+ * Rows above STS_LEGACY_CARDINALITY are filled once under breaks_lock and
+ * published by setting their breaks_ready flag, so that the hundreds of rows
+ * nobody uses don't slow down loading the library
+ */
+static char breaks_ready[STS_MAX_CARDINALITY + 1];
+static char breaks_lock;
 
-static const float mindist_13[] = {
-  0.000, 0.000, 0.406, 0.690, 0.924, 1.133, 1.330, 1.523, 1.719, 1.928, 2.162, 2.446, 2.852,
-  0.000, 0.000, 0.000, 0.284, 0.518, 0.727, 0.924, 1.117, 1.313, 1.522, 1.756, 2.040, 2.446,
-  0.406, 0.000, 0.000, 0.000, 0.234, 0.443, 0.640, 0.833, 1.030, 1.239, 1.473, 1.756, 2.162,
-  0.690, 0.284, 0.000, 0.000, 0.000, 0.209, 0.406, 0.599, 0.796, 1.005, 1.239, 1.522, 1.928,
-  0.924, 0.518, 0.234, 0.000, 0.000, 0.000, 0.197, 0.390, 0.587, 0.796, 1.030, 1.313, 1.719,
-  1.133, 0.727, 0.443, 0.209, 0.000, 0.000, 0.000, 0.193, 0.390, 0.599, 0.833, 1.117, 1.523,
-  1.330, 0.924, 0.640, 0.406, 0.197, 0.000, 0.000, 0.000, 0.197, 0.406, 0.640, 0.924, 1.330,
-  1.523, 1.117, 0.833, 0.599, 0.390, 0.193, 0.000, 0.000, 0.000, 0.209, 0.443, 0.727, 1.133,
-  1.719, 1.313, 1.030, 0.796, 0.587, 0.390, 0.197, 0.000, 0.000, 0.000, 0.234, 0.518, 0.924,
-  1.928, 1.522, 1.239, 1.005, 0.796, 0.599, 0.406, 0.209, 0.000, 0.000, 0.000, 0.284, 0.690,
-  2.162, 1.756, 1.473, 1.239, 1.030, 0.833, 0.640, 0.443, 0.234, 0.000, 0.000, 0.000, 0.406,
-  2.446, 2.040, 1.756, 1.522, 1.313, 1.117, 0.924, 0.727, 0.518, 0.284, 0.000, 0.000, 0.000,
-  2.852, 2.446, 2.162, 1.928, 1.719, 1.523, 1.330, 1.133, 0.924, 0.690, 0.406, 0.000, 0.000
-};
+#if defined(__GNUC__)
+#define STS_BREAKS_READY(c) __atomic_load_n(&breaks_ready[c], __ATOMIC_ACQUIRE)
+#define STS_BREAKS_PUBLISH(c)                                                  \
+  __atomic_store_n(&breaks_ready[c], 1, __ATOMIC_RELEASE)
+#define STS_BREAKS_LOCK()                                                      \
+  while (__atomic_test_and_set(&breaks_lock, __ATOMIC_ACQUIRE))
+#define STS_BREAKS_UNLOCK() __atomic_clear(&breaks_lock, __ATOMIC_RELEASE)
+#else
+#include <intrin.h>
+// volatile accesses have acquire and release semantics on the x86 MSVC targets
+#define STS_BREAKS_READY(c) (*(volatile char*)&breaks_ready[c])
+#define STS_BREAKS_PUBLISH(c) (*(volatile char*)&breaks_ready[c] = 1)
+#define STS_BREAKS_LOCK() while (_InterlockedExchange8(&breaks_lock, 1))
+#define STS_BREAKS_UNLOCK() _InterlockedExchange8(&breaks_lock, 0)
+#endif
 
-static const float mindist_14[] = {
-  0.000, 0.000, 0.398, 0.674, 0.899, 1.099, 1.285, 1.465, 1.645, 1.831, 2.031, 2.257, 2.533, 2.930,
-  0.000, 0.000, 0.000, 0.276, 0.502, 0.701, 0.888, 1.068, 1.248, 1.434, 1.634, 1.859, 2.135, 2.533,
-  0.398, 0.000, 0.000, 0.000, 0.226, 0.426, 0.612, 0.792, 0.972, 1.158, 1.358, 1.583, 1.859, 2.257,
-  0.674, 0.276, 0.000, 0.000, 0.000, 0.200, 0.386, 0.566, 0.746, 0.932, 1.132, 1.358, 1.634, 2.031,
-  0.899, 0.502, 0.226, 0.000, 0.000, 0.000, 0.186, 0.366, 0.546, 0.732, 0.932, 1.158, 1.434, 1.831,
-  1.099, 0.701, 0.426, 0.200, 0.000, 0.000, 0.000, 0.180, 0.360, 0.546, 0.746, 0.972, 1.248, 1.645,
-  1.285, 0.888, 0.612, 0.386, 0.186, 0.000, 0.000, 0.000, 0.180, 0.366, 0.566, 0.792, 1.068, 1.465,
-  1.465, 1.068, 0.792, 0.566, 0.366, 0.180, 0.000, 0.000, 0.000, 0.186, 0.386, 0.612, 0.888, 1.285,
-  1.645, 1.248, 0.972, 0.746, 0.546, 0.360, 0.180, 0.000, 0.000, 0.000, 0.200, 0.426, 0.701, 1.099,
-  1.831, 1.434, 1.158, 0.932, 0.732, 0.546, 0.366, 0.186, 0.000, 0.000, 0.000, 0.226, 0.502, 0.899,
-  2.031, 1.634, 1.358, 1.132, 0.932, 0.746, 0.566, 0.386, 0.200, 0.000, 0.000, 0.000, 0.276, 0.674,
-  2.257, 1.859, 1.583, 1.358, 1.158, 0.972, 0.792, 0.612, 0.426, 0.226, 0.000, 0.000, 0.000, 0.398,
-  2.533, 2.135, 1.859, 1.634, 1.434, 1.248, 1.068, 0.888, 0.701, 0.502, 0.276, 0.000, 0.000, 0.000,
-  2.930, 2.533, 2.257, 2.031, 1.831, 1.645, 1.465, 1.285, 1.099, 0.899, 0.674, 0.398, 0.000, 0.000
-};
+static const float* get_breaks(unsigned int c)
+{
+  if (c > STS_LEGACY_CARDINALITY && !STS_BREAKS_READY(c)) {
+    STS_BREAKS_LOCK();
+    if (!breaks_ready[c]) {
+      fill_breaks(c);
+      STS_BREAKS_PUBLISH(c);
+    }
+    STS_BREAKS_UNLOCK();
+  }
+  return breaks_table + (c - 2) * (c - 1) / 2;
+}
 
-static const float mindist_15[] = {
-  0.000, 0.000, 0.390, 0.659, 0.878, 1.070, 1.248, 1.417, 1.585, 1.754, 1.932, 2.124, 2.343, 2.612, 3.002,
-  0.000, 0.000, 0.000, 0.269, 0.488, 0.680, 0.857, 1.027, 1.194, 1.364, 1.541, 1.734, 1.952, 2.222, 2.612,
-  0.390, 0.000, 0.000, 0.000, 0.219, 0.411, 0.588, 0.758, 0.925, 1.095, 1.272, 1.465, 1.683, 1.952, 2.343,
-  0.659, 0.269, 0.000, 0.000, 0.000, 0.192, 0.370, 0.539, 0.707, 0.876, 1.054, 1.246, 1.465, 1.734, 2.124,
-  0.878, 0.488, 0.219, 0.000, 0.000, 0.000, 0.177, 0.347, 0.514, 0.684, 0.861, 1.054, 1.272, 1.541, 1.932,
-  1.070, 0.680, 0.411, 0.192, 0.000, 0.000, 0.000, 0.170, 0.337, 0.507, 0.684, 0.876, 1.095, 1.364, 1.754,
-  1.248, 0.857, 0.588, 0.370, 0.177, 0.000, 0.000, 0.000, 0.167, 0.337, 0.514, 0.707, 0.925, 1.194, 1.585,
-  1.417, 1.027, 0.758, 0.539, 0.347, 0.170, 0.000, 0.000, 0.000, 0.170, 0.347, 0.539, 0.758, 1.027, 1.417,
-  1.585, 1.194, 0.925, 0.707, 0.514, 0.337, 0.167, 0.000, 0.000, 0.000, 0.177, 0.370, 0.588, 0.857, 1.248,
-  1.754, 1.364, 1.095, 0.876, 0.684, 0.507, 0.337, 0.170, 0.000, 0.000, 0.000, 0.192, 0.411, 0.680, 1.070,
-  1.932, 1.541, 1.272, 1.054, 0.861, 0.684, 0.514, 0.347, 0.177, 0.000, 0.000, 0.000, 0.219, 0.488, 0.878,
-  2.124, 1.734, 1.465, 1.246, 1.054, 0.876, 0.707, 0.539, 0.370, 0.192, 0.000, 0.000, 0.000, 0.269, 0.659,
-  2.343, 1.952, 1.683, 1.465, 1.272, 1.095, 0.925, 0.758, 0.588, 0.411, 0.219, 0.000, 0.000, 0.000, 0.390,
-  2.612, 2.222, 1.952, 1.734, 1.541, 1.364, 1.194, 1.027, 0.857, 0.680, 0.488, 0.269, 0.000, 0.000, 0.000,
-  3.002, 2.612, 2.343, 2.124, 1.932, 1.754, 1.585, 1.417, 1.248, 1.070, 0.878, 0.659, 0.390, 0.000, 0.000
-};
+/*
+ * c * c distance table of the Gaussian breakpoints of c or NULL if c has none
+ */
+static const float* get_dist(unsigned int c)
+{
+  return c <= STS_LEGACY_CARDINALITY ? legacy_dist[c - STS_MIN_CARDINALITY]
+                                     : NULL;
+}
 
-static const float mindist_16[] = {
-  0.000, 0.000, 0.384, 0.647, 0.860, 1.045, 1.215, 1.377, 1.534, 1.691, 1.853, 2.023, 2.209, 2.421, 2.684, 3.068,
-  0.000, 0.000, 0.000, 0.263, 0.476, 0.662, 0.832, 0.993, 1.150, 1.308, 1.469, 1.639, 1.825, 2.037, 2.301, 2.684,
-  0.384, 0.000, 0.000, 0.000, 0.213, 0.398, 0.569, 0.730, 0.887, 1.044, 1.206, 1.376, 1.562, 1.774, 2.037, 2.421,
-  0.647, 0.263, 0.000, 0.000, 0.000, 0.186, 0.356, 0.517, 0.674, 0.832, 0.993, 1.163, 1.349, 1.562, 1.825, 2.209,
-  0.860, 0.476, 0.213, 0.000, 0.000, 0.000, 0.170, 0.331, 0.489, 0.646, 0.807, 0.978, 1.163, 1.376, 1.639, 2.023,
-  1.045, 0.662, 0.398, 0.186, 0.000, 0.000, 0.000, 0.161, 0.319, 0.476, 0.637, 0.807, 0.993, 1.206, 1.469, 1.853,
-  1.215, 0.832, 0.569, 0.356, 0.170, 0.000, 0.000, 0.000, 0.157, 0.315, 0.476, 0.646, 0.832, 1.044, 1.308, 1.691,
-  1.377, 0.993, 0.730, 0.517, 0.331, 0.161, 0.000, 0.000, 0.000, 0.157, 0.319, 0.489, 0.674, 0.887, 1.150, 1.534,
-  1.534, 1.150, 0.887, 0.674, 0.489, 0.319, 0.157, 0.000, 0.000, 0.000, 0.161, 0.331, 0.517, 0.730, 0.993, 1.377,
-  1.691, 1.308, 1.044, 0.832, 0.646, 0.476, 0.315, 0.157, 0.000, 0.000, 0.000, 0.170, 0.356, 0.569, 0.832, 1.215,
-  1.853, 1.469, 1.206, 0.993, 0.807, 0.637, 0.476, 0.319, 0.161, 0.000, 0.000, 0.000, 0.186, 0.398, 0.662, 1.045,
-  2.023, 1.639, 1.376, 1.163, 0.978, 0.807, 0.646, 0.489, 0.331, 0.170, 0.000, 0.000, 0.000, 0.213, 0.476, 0.860,
-  2.209, 1.825, 1.562, 1.349, 1.163, 0.993, 0.832, 0.674, 0.517, 0.356, 0.186, 0.000, 0.000, 0.000, 0.263, 0.647,
-  2.421, 2.037, 1.774, 1.562, 1.376, 1.206, 1.044, 0.887, 0.730, 0.569, 0.398, 0.213, 0.000, 0.000, 0.000, 0.384,
-  2.684, 2.301, 2.037, 1.825, 1.639, 1.469, 1.308, 1.150, 0.993, 0.832, 0.662, 0.476, 0.263, 0.000, 0.000, 0.000,
-  3.068, 2.684, 2.421, 2.209, 2.023, 1.853, 1.691, 1.534, 1.377, 1.215, 1.045, 0.860, 0.647, 0.384, 0.000, 0.000
-};
+/*
+ * Lowerbounding distance between regions of two symbols of cardinality c,
+ * taken from the c * c table dist if there is one or from the breakpoints
+ */
+static double symbol_distance(const float* dist,
+                              const float* breaks,
+                              unsigned int c,
+                              sts_symbol sa,
+                              sts_symbol sb)
+{
+  if (dist) {
+    return dist[sa * c + sb];
+  }
+  // internally we use the reversed iSAX ordering
+  unsigned int lo = c - 1 - (sa > sb ? sa : sb);
+  unsigned int hi = c - 1 - (sa > sb ? sb : sa);
+  return hi - lo > 1 ? (double)breaks[hi - 1] - breaks[lo] : 0;
+}
 
-static const float* dist_table[STS_MAX_CARDINALITY - 1] = {
-  mindist_2,
-  mindist_3,
-  mindist_4,
-  mindist_5,
-  mindist_6,
-  mindist_7,
-  mindist_8,
-  mindist_9,
-  mindist_10,
-  mindist_11,
-  mindist_12,
-  mindist_13,
-  mindist_14,
-  mindist_15,
-  mindist_16
-};
+/*
+ * Binary search for the region of value, symbol 0 being the highest one
+ */
+static sts_symbol get_symbol(double value, const float* breaks, unsigned int c)
+{
+  if (isnan(value)) return (sts_symbol)c;
+  // number of breakpoints <= value
+  size_t lo = 0, len = c - 1;
+  while (len > 0) {
+    size_t half = len / 2;
+    if (breaks[lo + half] <= value) {
+      lo += half + 1;
+      len -= half + 1;
+    } else {
+      len = half;
+    }
+  }
+  return (sts_symbol)(c - 1 - lo);
+}
 
-static sts_symbol get_symbol(double value, unsigned char c)
+/*
+ * Same as get_symbol for breakpoints pre-scaled into the units of value
+ */
+static sts_symbol get_scaled_symbol(double value,
+                                    const double* thresholds,
+                                    unsigned int c)
 {
-  if (isnan(value)) return c;
-  for (int i = 0; i < c - 1; ++i) {
-    if (value < breaks[c - STS_MIN_CARDINALITY][i]) {
-      return c - i - 1;
+  if (isnan(value)) return (sts_symbol)c;
+  size_t lo = 0, len = c - 1;
+  while (len > 0) {
+    size_t half = len / 2;
+    if (thresholds[lo + half] <= value) {
+      lo += half + 1;
+      len -= half + 1;
+    } else {
+      len = half;
     }
   }
-  return 0;
+  return (sts_symbol)(c - 1 - lo);
+}
+
+/*
+ * Scales breakpoints of c from N(0, 1) to sums of frame_size values drawn from
+ * N(mu, sigma^2), so that raw frame sums are quantized without normalization
+ */
+static void scale_breaks(unsigned int c,
+                         size_t frame_size,
+                         double mu,
+                         double sigma,
+                         double* thresholds)
+{
+  const float* breaks = get_breaks(c);
+  for (unsigned int i = 0; i < c - 1; ++i) {
+    thresholds[i] = (breaks[i] * sigma + mu) * frame_size;
+  }
 }
 
 // On-line estimation for better precision
@@ -279,237 +333,2719 @@ static void estimate_mu_and_std(const double* series,
   }
 }
 
-static sts_window new_window(size_t n,
-                             size_t w,
-                             unsigned char c,
-                             struct sts_ring_buffer* values)
+/*
+ * Scales median absolute deviation to the standard deviation of N(0, 1)
+ */
+#define STS_MAD_TO_STD 1.482602218505602
+
+static int compare_doubles(const void* a, const void* b)
 {
-  sts_window window = malloc(sizeof*window);
-  window->current_word.n_values = n;
-  window->current_word.w = w;
-  window->current_word.c = c;
-  window->current_word.symbols =
-    malloc(w * sizeof*window->current_word.symbols);
-  if (window->current_word.symbols == NULL) return NULL;
-  for (size_t i = 0; i < w; ++i) {
-    window->current_word.symbols[i] = c;
-  }
-  window->values = values;
-  return window;
+  double da = *(const double*)a;
+  double db = *(const double*)b;
+  return (da > db) - (da < db);
 }
 
-sts_window sts_new_window(size_t n, size_t w, unsigned char c)
+/*
+ * Median and scaled MAD of the finite values of series
+ */
+static bool estimate_median_and_mad(const double* series,
+                                    size_t n_values,
+                                    double* median,
+                                    double* std)
 {
-  if (n % w != 0 || c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY) {
-    return NULL;
+  double* sorted = malloc((n_values ? n_values : 1) * sizeof*sorted);
+  if (!sorted) return false;
+  size_t n = 0;
+  for (size_t i = 0; i < n_values; ++i) {
+    if (isfinite(series[i])) sorted[n++] = series[i];
   }
-  struct sts_ring_buffer* values = malloc(sizeof*values);
-  if (!values) return NULL;
-  values->buffer = malloc(n * sizeof*values->buffer);
-  if (!values->buffer) {
-    free(values);
-    return NULL;
+  if (n == 0) {
+    *median = 0;
+    *std = 0;
+    free(sorted);
+    return true;
   }
+  qsort(sorted, n, sizeof*sorted, compare_doubles);
+  *median = (sorted[(n - 1) / 2] + sorted[n / 2]) / 2;
   for (size_t i = 0; i < n; ++i) {
-    values->buffer[i] = NAN;
+    sorted[i] = fabs(sorted[i] - *median);
   }
-  values->buffer_end = values->buffer + n;
-  values->head = values->buffer;
-  values->tail = values->buffer_end - 1;
-  values->mu = 0;
-  values->s2 = 0;
-  values->finite_cnt = 0;
-  return new_window(n, w, c, values);
+  qsort(sorted, n, sizeof*sorted, compare_doubles);
+  *std = STS_MAD_TO_STD * (sorted[(n - 1) / 2] + sorted[n / 2]) / 2;
+  free(sorted);
+  return true;
 }
 
 /*
- * Apend to circular buffer, updates finite_cnt
+ * Adaptive breakpoints: P^2 estimators (Jain & Chlamtac, 1985) of the i / c
+ * quantiles of the observed normalized frame averages. Every estimator keeps
+ * 5 markers: heights, actual and desired positions. Quantization uses the
+ * published row which is only replaced when an estimate drifts further than
+ * tolerance from it, so that the distance table isn't rebuilt on every value
  */
-static double rb_push(struct sts_ring_buffer* rb, double value)
+#define STS_P2_MARKERS 5
+// Observations per symbol before estimates are published, at first all the
+// markers hold the same few values
+#define STS_P2_WARMUP 10
+
+struct sts_breakpoints {
+  unsigned int c;
+  double tolerance;
+  size_t count; // finite values observed
+  double* heights; // STS_P2_MARKERS per breakpoint
+  double* positions;
+  double* desired;
+  float* published; // c - 1 ascending breakpoints used for quantization
+  float* dist; // c * c distance table for c <= STS_LEGACY_CARDINALITY
+  bool dist_stale;
+};
+
+static void p2_init(struct sts_breakpoints* bp)
 {
-  double prev_head = 0;
-  if (isfinite(value)) {
-    ++rb->finite_cnt;
-  }
-  ++rb->tail;
-  if (rb->tail == rb->buffer_end) {
-    rb->tail = rb->buffer;
+  // first STS_P2_MARKERS observations are kept in the heights of estimator 0
+  double* first = bp->heights;
+  qsort(first, STS_P2_MARKERS, sizeof*first, compare_doubles);
+  for (unsigned int i = 0; i < bp->c - 1; ++i) {
+    double p = (double)(i + 1) / bp->c;
+    double* q = bp->heights + i * STS_P2_MARKERS;
+    double* pos = bp->positions + i * STS_P2_MARKERS;
+    double* des = bp->desired + i * STS_P2_MARKERS;
+    for (unsigned int j = 0; j < STS_P2_MARKERS; ++j) {
+      q[j] = first[j];
+      pos[j] = j + 1;
+    }
+    des[0] = 1;
+    des[1] = 1 + 2 * p;
+    des[2] = 1 + 4 * p;
+    des[3] = 3 + 2 * p;
+    des[4] = 5;
   }
+}
 
-  if (rb->tail == rb->head) {
-    prev_head = *rb->head;
-    if (isfinite(*rb->head)) {
-      --rb->finite_cnt;
-    }
-    if (++rb->head == rb->buffer_end) {
-      rb->head = rb->buffer;
+static void p2_add(double* q, double* pos, double* des, double p, double value)
+{
+  unsigned int k;
+  if (value < q[0]) {
+    q[0] = value;
+    k = 0;
+  } else if (value >= q[4]) {
+    q[4] = value;
+    k = 3;
+  } else {
+    for (k = 0; value >= q[k + 1]; ++k) ;
+  }
+  for (unsigned int j = k + 1; j < STS_P2_MARKERS; ++j) {
+    ++pos[j];
+  }
+  des[1] += p / 2;
+  des[2] += p;
+  des[3] += (1 + p) / 2;
+  des[4] += 1;
+  for (unsigned int j = 1; j < STS_P2_MARKERS - 1; ++j) {
+    double d = des[j] - pos[j];
+    if ((d >= 1 && pos[j + 1] - pos[j] > 1)
+        || (d <= -1 && pos[j - 1] - pos[j] < -1)) {
+      d = d > 0 ? 1 : -1;
+      // piecewise-parabolic prediction, linear one if it isn't monotonic
+      double h = q[j] + d / (pos[j + 1] - pos[j - 1])
+                 * ((pos[j] - pos[j - 1] + d) * (q[j + 1] - q[j])
+                    / (pos[j + 1] - pos[j])
+                    + (pos[j + 1] - pos[j] - d) * (q[j] - q[j - 1])
+                    / (pos[j] - pos[j - 1]));
+      if (q[j - 1] < h && h < q[j + 1]) {
+        q[j] = h;
+      } else {
+        unsigned int n = d > 0 ? j + 1 : j - 1;
+        q[j] += d * (q[n] - q[j]) / (pos[n] - pos[j]);
+      }
+      pos[j] += d;
     }
   }
-  *rb->tail = value;
-
-  return prev_head;
 }
 
 /*
- * Given code params, mu and std of series + buffer where that series lies
- * writes SAX-representation of the series into *out
+ * Replaces published breakpoints with the estimates if any of them drifted
+ * further than tolerance, keeps the row strictly ascending
  */
-
-static void apply_sax_transform(size_t n,
-                                size_t w,
-                                unsigned char c,
-                                double mu,
-                                double std,
-                                sts_symbol* out,
-                                const double* series_begin,
-                                const double* buffer_start,
-                                const double* buffer_break)
+static bool publish_breaks(struct sts_breakpoints* bp)
 {
-  size_t frame_size = n / w;
-  const double* val = series_begin;
-  for (unsigned int i = 0; i < w; ++i) {
-    double average = 0;
-    size_t current_frame_size = frame_size;
-    for (size_t j = 0; j < frame_size; ++j) {
-      if (isnan(*val)) {
-        --current_frame_size;
-      } else {
-        average += *val;
-      }
-      if (++val == buffer_break) val = buffer_start;
+  if (bp->count < (size_t)STS_P2_WARMUP * bp->c) return false;
+  bool drifted = false;
+  for (unsigned int i = 0; i < bp->c - 1 && !drifted; ++i) {
+    double estimate = bp->heights[i * STS_P2_MARKERS + 2];
+    drifted = fabs(estimate - bp->published[i]) > bp->tolerance;
+  }
+  if (!drifted) return false;
+  for (unsigned int i = 0; i < bp->c - 1; ++i) {
+    float estimate = (float)bp->heights[i * STS_P2_MARKERS + 2];
+    if (i > 0 && estimate <= bp->published[i - 1]) {
+      estimate = nextafterf(bp->published[i - 1], INFINITY);
     }
-    if (current_frame_size == 0 || isnan(average)) {
-      // All NaNs or (-INF + INF)
-      average = NAN;
-    } else {
-      if (isfinite(average)) {
-        if (std < STS_STAT_EPS) {
-          average = 0;
-        } else {
-          average = (average - (current_frame_size * mu))
-            / (current_frame_size * std);
-        }
+    bp->published[i] = estimate;
+  }
+  bp->dist_stale = true;
+  return true;
+}
+
+/*
+ * Distance table of the published breakpoints, rebuilt if they've changed
+ */
+static const float* get_adaptive_dist(struct sts_breakpoints* bp)
+{
+  if (bp->dist && bp->dist_stale) {
+    unsigned int c = bp->c;
+    for (unsigned int sa = 0; sa < c; ++sa) {
+      for (unsigned int sb = 0; sb < c; ++sb) {
+        bp->dist[sa * c + sb] =
+          (float)symbol_distance(NULL, bp->published, c, sa, sb);
       }
     }
-    out[i] = get_symbol(average, c);
   }
+  bp->dist_stale = false;
+  return bp->dist;
 }
 
-static sts_word new_word(size_t n, size_t w, unsigned char c,
-                         sts_symbol* symbols)
+sts_breakpoints sts_new_adaptive_breakpoints(unsigned int c, double tolerance)
 {
-  sts_word new = malloc(sizeof*new);
-  new->n_values = n;
-  new->w = w;
-  new->c = c;
-  new->symbols = symbols;
-  return new;
+  if (c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY
+      || !(tolerance >= 0) || !isfinite(tolerance)) {
+    return NULL;
+  }
+  sts_breakpoints bp = calloc(1, sizeof*bp);
+  if (!bp) return NULL;
+  size_t n_markers = (c - 1) * STS_P2_MARKERS;
+  bp->c = c;
+  bp->tolerance = tolerance;
+  bp->heights = malloc(n_markers * sizeof*bp->heights);
+  bp->positions = malloc(n_markers * sizeof*bp->positions);
+  bp->desired = malloc(n_markers * sizeof*bp->desired);
+  bp->published = malloc((c - 1) * sizeof*bp->published);
+  if (c <= STS_LEGACY_CARDINALITY) {
+    bp->dist = malloc(c * c * sizeof*bp->dist);
+  }
+  if (!bp->heights || !bp->positions || !bp->desired || !bp->published
+      || (c <= STS_LEGACY_CARDINALITY && !bp->dist)) {
+    sts_free_breakpoints(bp);
+    return NULL;
+  }
+  // Gaussian breakpoints until STS_P2_WARMUP observations per symbol
+  memcpy(bp->published, get_breaks(c), (c - 1) * sizeof*bp->published);
+  bp->dist_stale = true;
+  return bp;
 }
 
-static double get_window_std(sts_window window)
+bool sts_breakpoints_add(sts_breakpoints bp, double value)
 {
-  return window->values->finite_cnt == 0
-         ? 0
-         : sqrt(window->values->s2 / window->values->finite_cnt);
+  if (!bp || !isfinite(value)) return false;
+  if (bp->count < STS_P2_MARKERS) {
+    bp->heights[bp->count++] = value;
+    if (bp->count < STS_P2_MARKERS) return false;
+    p2_init(bp);
+  } else {
+    ++bp->count;
+    for (unsigned int i = 0; i < bp->c - 1; ++i) {
+      p2_add(bp->heights + i * STS_P2_MARKERS,
+             bp->positions + i * STS_P2_MARKERS,
+             bp->desired + i * STS_P2_MARKERS,
+             (double)(i + 1) / bp->c, value);
+    }
+  }
+  return publish_breaks(bp);
 }
 
-static sts_word update_current_word(sts_window window)
+const float* sts_breakpoints_values(const struct sts_breakpoints* bp)
 {
-  apply_sax_transform(window->current_word.n_values,
-                      window->current_word.w,
-                      window->current_word.c,
-                      window->values->mu,
-                      get_window_std(window),
-                      window->current_word.symbols,
-                      window->values->head,
-                      window->values->buffer,
-                      window->values->buffer_end);
-  return &window->current_word;
+  return bp ? bp->published : NULL;
+}
+
+void sts_free_breakpoints(sts_breakpoints bp)
+{
+  if (!bp) return;
+  free(bp->heights);
+  free(bp->positions);
+  free(bp->desired);
+  free(bp->published);
+  free(bp->dist);
+  free(bp);
 }
 
 /*
- * Appends value, updates mu and s2 in on-line fashion, but doesn't update word
- * itself
+ * Order statistics over the finite values of a window: a treap which nodes
+ * are preallocated along with the window, so that appends never allocate.
+ * Node 0 is the empty tree.
  */
-static void append_value(sts_window window, double value)
+struct sts_treap_node {
+  double key;
+  uint32_t left, right, size, priority;
+};
+
+struct sts_order_stats {
+  struct sts_treap_node* nodes;
+  size_t capacity;
+  uint32_t root, free_list, seed;
+};
+
+static void os_clear(struct sts_order_stats* os)
 {
-  size_t prev_finite = window->values->finite_cnt;
-  double head = rb_push(window->values, value);
-  size_t new_finite = window->values->finite_cnt;
-  // Update mu and s2
-  if (prev_finite == new_finite) {
-    // either
-    // 1) added finite and removed finite from head or
-    // 2) added non-finite and removed non-finite or
-    // 3) added non-finite on an empty place
-    // update only in case 1 (size remained the same)
-    if (isfinite(value)) {
-      double diff = value - head;
-      window->values->mu += diff / prev_finite;
-      double a = value - window->values->mu;
-      double b = head - window->values->mu;
-      window->values->s2 += diff * diff / new_finite + a * a - b * b;
-    }
-  } else if (new_finite < prev_finite) {
-    // added non-finite in place of finite (size decreased)
-    if (new_finite == 0) {
-      window->values->mu = 0;
-      window->values->s2 = 0;
-    } else {
-      double prev_mu = window->values->mu;
-      window->values->mu = (prev_mu * prev_finite - head) / new_finite;
-      double old_diff = prev_mu - head;
-      double new_diff = window->values->mu - head;
-      window->values->s2 += ((old_diff * old_diff * prev_finite)
-                             / (new_finite * new_finite)) - new_diff * new_diff;
-    }
-  } else {
-    // added new finite either on the empty place
-    // or in place of non-finite head
-    // size increased in any case -> update
-    window->values->s2 += ((value - window->values->mu)
-                           * (value - window->values->mu)
-                           * prev_finite) / new_finite;
-    window->values->mu += (value - window->values->mu) / new_finite;
-  }
-  if (window->values->s2 < 0 && window->values->s2 > -STS_STAT_EPS) {
-    // to fight sqrt(-0)
-    window->values->s2 = 0;
+  os->root = 0;
+  os->free_list = 1;
+  for (size_t i = 1; i <= os->capacity; ++i) {
+    os->nodes[i].left = i == os->capacity ? 0 : (uint32_t)i + 1;
   }
+  os->nodes[0].size = 0;
 }
 
-const struct sts_word* sts_append_value(sts_window window, double value)
+static struct sts_order_stats* os_new(size_t capacity)
 {
-  if (window == NULL
-      || window->values == NULL
-      || window->values->buffer == NULL
-      || window->current_word.c < STS_MIN_CARDINALITY
-      || window->current_word.c > STS_MAX_CARDINALITY) {
+  struct sts_order_stats* os = malloc(sizeof*os);
+  if (!os) return NULL;
+  os->nodes = malloc((capacity + 1) * sizeof*os->nodes);
+  if (!os->nodes) {
+    free(os);
     return NULL;
   }
-  append_value(window, value);
-  return update_current_word(window);
+  os->capacity = capacity;
+  os->seed = 2463534242u;
+  os_clear(os);
+  return os;
 }
 
-const struct sts_word* sts_append_array(sts_window window,
+static void os_free(struct sts_order_stats* os)
+{
+  if (!os) return;
+  free(os->nodes);
+  free(os);
+}
+
+static void treap_update(struct sts_treap_node* t, uint32_t x)
+{
+  t[x].size = 1 + t[t[x].left].size + t[t[x].right].size;
+}
+
+/*
+ * Splits x into l with keys < key and r with keys >= key
+ */
+static void treap_split(struct sts_treap_node* t,
+                        uint32_t x,
+                        double key,
+                        uint32_t* l,
+                        uint32_t* r)
+{
+  if (!x) {
+    *l = *r = 0;
+    return;
+  }
+  if (t[x].key < key) {
+    treap_split(t, t[x].right, key, &t[x].right, r);
+    *l = x;
+  } else {
+    treap_split(t, t[x].left, key, l, &t[x].left);
+    *r = x;
+  }
+  treap_update(t, x);
+}
+
+/*
+ * Merges a and b given that no key of a is greater than any key of b
+ */
+static uint32_t treap_merge(struct sts_treap_node* t, uint32_t a, uint32_t b)
+{
+  if (!a) return b;
+  if (!b) return a;
+  if (t[a].priority > t[b].priority) {
+    t[a].right = treap_merge(t, t[a].right, b);
+    treap_update(t, a);
+    return a;
+  }
+  t[b].left = treap_merge(t, a, t[b].left);
+  treap_update(t, b);
+  return b;
+}
+
+static uint32_t treap_erase(struct sts_treap_node* t,
+                            uint32_t x,
+                            double key,
+                            uint32_t* removed)
+{
+  if (!x) return 0;
+  if (key == t[x].key) {
+    *removed = x;
+    return treap_merge(t, t[x].left, t[x].right);
+  }
+  if (key < t[x].key) {
+    t[x].left = treap_erase(t, t[x].left, key, removed);
+  } else {
+    t[x].right = treap_erase(t, t[x].right, key, removed);
+  }
+  treap_update(t, x);
+  return x;
+}
+
+static void os_insert(struct sts_order_stats* os, double key)
+{
+  uint32_t x = os->free_list;
+  os->free_list = os->nodes[x].left;
+  // xorshift32
+  os->seed ^= os->seed << 13;
+  os->seed ^= os->seed >> 17;
+  os->seed ^= os->seed << 5;
+  os->nodes[x].key = key;
+  os->nodes[x].priority = os->seed;
+  os->nodes[x].left = os->nodes[x].right = 0;
+  os->nodes[x].size = 1;
+  uint32_t l, r;
+  treap_split(os->nodes, os->root, key, &l, &r);
+  os->root = treap_merge(os->nodes, treap_merge(os->nodes, l, x), r);
+}
+
+static void os_erase(struct sts_order_stats* os, double key)
+{
+  uint32_t removed = 0;
+  os->root = treap_erase(os->nodes, os->root, key, &removed);
+  if (removed) {
+    os->nodes[removed].left = os->free_list;
+    os->free_list = removed;
+  }
+}
+
+static size_t os_count(const struct sts_order_stats* os)
+{
+  return os->nodes[os->root].size;
+}
+
+/*
+ * k-th smallest key, 0-based
+ */
+static double os_kth(const struct sts_order_stats* os, size_t k)
+{
+  const struct sts_treap_node* t = os->nodes;
+  uint32_t x = os->root;
+  for (;;) {
+    size_t left = t[t[x].left].size;
+    if (k < left) {
+      x = t[x].left;
+    } else if (k == left) {
+      return t[x].key;
+    } else {
+      k -= left + 1;
+      x = t[x].right;
+    }
+  }
+}
+
+static size_t os_count_less(const struct sts_order_stats* os, double key)
+{
+  const struct sts_treap_node* t = os->nodes;
+  size_t cnt = 0;
+  uint32_t x = os->root;
+  while (x) {
+    if (t[x].key < key) {
+      cnt += t[t[x].left].size + 1;
+      x = t[x].right;
+    } else {
+      x = t[x].left;
+    }
+  }
+  return cnt;
+}
+
+/*
+ * t-th smallest absolute deviation from median. Deviations of the keys below
+ * and above median form two ascending sequences, which are searched for the
+ * split point, so that it takes O(log^2 n)
+ */
+static double os_kth_deviation(const struct sts_order_stats* os,
+                               double median,
+                               size_t below,
+                               size_t t)
+{
+  size_t above = os_count(os) - below;
+#define STS_DEV_BELOW(j) (median - os_kth(os, below - 1 - (j)))
+#define STS_DEV_ABOVE(j) (os_kth(os, below + (j)) - median)
+  // i deviations are taken from below and t + 1 - i from above
+  size_t lo = t + 1 > above ? t + 1 - above : 0;
+  size_t hi = t + 1 < below ? t + 1 : below;
+  while (lo < hi) {
+    size_t i = lo + (hi - lo) / 2;
+    if (STS_DEV_BELOW(i) < STS_DEV_ABOVE(t - i)) {
+      lo = i + 1;
+    } else {
+      hi = i;
+    }
+  }
+  double dev = lo > 0 ? STS_DEV_BELOW(lo - 1) : 0;
+  if (t + 1 - lo > 0 && STS_DEV_ABOVE(t - lo) > dev) {
+    dev = STS_DEV_ABOVE(t - lo);
+  }
+#undef STS_DEV_BELOW
+#undef STS_DEV_ABOVE
+  return dev;
+}
+
+static void os_median_and_mad(const struct sts_order_stats* os,
+                              double* median,
+                              double* std)
+{
+  size_t n = os_count(os);
+  if (n == 0) {
+    *median = 0;
+    *std = 0;
+    return;
+  }
+  *median = (os_kth(os, (n - 1) / 2) + os_kth(os, n / 2)) / 2;
+  size_t below = os_count_less(os, *median);
+  *std = STS_MAD_TO_STD * (os_kth_deviation(os, *median, below, (n - 1) / 2)
+                           + os_kth_deviation(os, *median, below, n / 2)) / 2;
+}
+
+/*
+ * Sliding minima and maxima of every frame of a window. Frame j is a sliding
+ * window of frame_size values delayed by (w - 1 - j) frames, its extrema are
+ * kept in monotonic deques of {value, index} (ascending values for minima,
+ * descending for maxima), so that an append costs amortized O(1) per frame.
+ * Deque 2 * j holds minima of frame j and deque 2 * j + 1 its maxima.
+ */
+struct sts_deque_entry {
+  double value;
+  size_t index;
+};
+
+struct sts_deque {
+  size_t begin, size;
+};
+
+struct sts_frame_extrema {
+  size_t w, frame_size;
+  size_t index; // index of the newest value
+  struct sts_deque* deques;
+  struct sts_deque_entry* entries; // frame_size per deque
+};
+
+static void fe_clear(struct sts_frame_extrema* fe)
+{
+  // Indices start at n so that delayed indices never wrap
+  fe->index = fe->w * fe->frame_size;
+  for (size_t i = 0; i < 2 * fe->w; ++i) {
+    fe->deques[i].begin = 0;
+    fe->deques[i].size = 0;
+  }
+}
+
+static struct sts_frame_extrema* fe_new(size_t w, size_t frame_size)
+{
+  struct sts_frame_extrema* fe = malloc(sizeof*fe);
+  if (!fe) return NULL;
+  fe->w = w;
+  fe->frame_size = frame_size;
+  fe->deques = malloc(2 * w * sizeof*fe->deques);
+  fe->entries = malloc(2 * w * frame_size * sizeof*fe->entries);
+  if (!fe->deques || !fe->entries) {
+    free(fe->deques);
+    free(fe->entries);
+    free(fe);
+    return NULL;
+  }
+  fe_clear(fe);
+  return fe;
+}
+
+static void fe_free(struct sts_frame_extrema* fe)
+{
+  if (!fe) return;
+  free(fe->deques);
+  free(fe->entries);
+  free(fe);
+}
+
+/*
+ * Drops entries which left the frame and pushes value, unless it's NaN,
+ * after dropping the entries it dominates
+ */
+static void deque_push(struct sts_deque* dq,
+                       struct sts_deque_entry* entries,
+                       size_t capacity,
+                       bool minima,
+                       double value,
+                       size_t index)
+{
+  while (dq->size > 0 && entries[dq->begin].index + capacity <= index) {
+    if (++dq->begin == capacity) dq->begin = 0;
+    --dq->size;
+  }
+  if (isnan(value)) return;
+  while (dq->size > 0) {
+    double back = entries[(dq->begin + dq->size - 1) % capacity].value;
+    if (minima ? back < value : back > value) break;
+    --dq->size;
+  }
+  struct sts_deque_entry* entry = entries + (dq->begin + dq->size) % capacity;
+  entry->value = value;
+  entry->index = index;
+  ++dq->size;
+}
+
+/*
+ * Feeds every frame with the value which has just entered it, rb->tail
+ * should point to the newest value
+ */
+static void fe_push(struct sts_frame_extrema* fe,
+                    const struct sts_ring_buffer* rb)
+{
+  size_t n = fe->w * fe->frame_size;
+  size_t tail = rb->tail - rb->buffer;
+  ++fe->index;
+  for (size_t j = 0; j < fe->w; ++j) {
+    size_t delay = (fe->w - 1 - j) * fe->frame_size;
+    double value = rb->buffer[(tail + n - delay) % n];
+    struct sts_deque_entry* entries = fe->entries + 2 * j * fe->frame_size;
+    deque_push(fe->deques + 2 * j, entries, fe->frame_size, true, value,
+               fe->index - delay);
+    deque_push(fe->deques + 2 * j + 1, entries + fe->frame_size,
+               fe->frame_size, false, value, fe->index - delay);
+  }
+}
+
+/*
+ * Minimum or maximum of frame j, NaN if it has no values besides NaNs
+ */
+static double fe_get(const struct sts_frame_extrema* fe, size_t j, bool minima)
+{
+  const struct sts_deque* dq = fe->deques + 2 * j + (minima ? 0 : 1);
+  if (dq->size == 0) return NAN;
+  return fe->entries[(2 * j + (minima ? 0 : 1)) * fe->frame_size
+                     + dq->begin].value;
+}
+
+/*
+ * Linear regression sums of every frame of a window over its finite values,
+ * t being the position within the frame. Frames slide like the ones of
+ * sts_frame_extrema: the value leaving frame j enters frame j - 1, so that an
+ * append costs O(w). Sums are recomputed from the ring buffer once per n
+ * appends to keep rounding errors from accumulating.
+ */
+struct sts_regression_sums {
+  double cnt, s_t, s_tt, s_y, s_ty;
+  size_t pos_inf, neg_inf;
+};
+
+struct sts_frame_regression {
+  size_t w, frame_size;
+  size_t since_refresh;
+  struct sts_regression_sums* sums;
+  double* slope_breaks; // c_slope - 1 slope breakpoints
+};
+
+/*
+ * Variance of slopes of frames of z-normalized series is estimated as
+ * 0.03 / frame_size in the 1d-SAX paper
+ */
+static void scale_slope_breaks(unsigned int c_slope,
+                               size_t frame_size,
+                               double* slope_breaks)
+{
+  const float* breaks = get_breaks(c_slope);
+  double sigma = sqrt(0.03 / frame_size);
+  for (unsigned int i = 0; i < c_slope - 1; ++i) {
+    slope_breaks[i] = breaks[i] * sigma;
+  }
+}
+
+static void regression_add(struct sts_regression_sums* s, double t, double y)
+{
+  if (isnan(y)) return;
+  if (isinf(y)) {
+    if (y > 0) ++s->pos_inf;
+    else ++s->neg_inf;
+    return;
+  }
+  s->cnt += 1;
+  s->s_t += t;
+  s->s_tt += t * t;
+  s->s_y += y;
+  s->s_ty += t * y;
+}
+
+/*
+ * Sums of the frame starting at *val, moves *val to the next frame
+ */
+static void frame_regression(size_t frame_size,
+                             struct sts_regression_sums* s,
+                             const double** val,
+                             const double* buffer_start,
+                             const double* buffer_break)
+{
+  memset(s, 0, sizeof*s);
+  for (size_t t = 0; t < frame_size; ++t) {
+    regression_add(s, (double)t, **val);
+    if (++*val == buffer_break) *val = buffer_start;
+  }
+}
+
+static void fr_refresh(struct sts_frame_regression* fr,
+                       const struct sts_ring_buffer* rb)
+{
+  const double* val = rb->head;
+  for (size_t j = 0; j < fr->w; ++j) {
+    frame_regression(fr->frame_size, fr->sums + j, &val, rb->buffer,
+                     rb->buffer_end);
+  }
+  fr->since_refresh = 0;
+}
+
+static struct sts_frame_regression* fr_new(size_t w,
+                                           size_t frame_size,
+                                           unsigned int c_slope)
+{
+  struct sts_frame_regression* fr = malloc(sizeof*fr);
+  if (!fr) return NULL;
+  fr->w = w;
+  fr->frame_size = frame_size;
+  fr->since_refresh = 0;
+  fr->sums = calloc(w, sizeof*fr->sums);
+  fr->slope_breaks = malloc((c_slope - 1) * sizeof*fr->slope_breaks);
+  if (!fr->sums || !fr->slope_breaks) {
+    free(fr->sums);
+    free(fr->slope_breaks);
+    free(fr);
+    return NULL;
+  }
+  scale_slope_breaks(c_slope, frame_size, fr->slope_breaks);
+  return fr;
+}
+
+static void fr_free(struct sts_frame_regression* fr)
+{
+  if (!fr) return;
+  free(fr->sums);
+  free(fr->slope_breaks);
+  free(fr);
+}
+
+/*
+ * Slides every frame by one value, head is the value evicted from the ring
+ * buffer and rb->tail points to the newest one
+ */
+static void fr_push(struct sts_frame_regression* fr,
+                    const struct sts_ring_buffer* rb,
+                    double head)
+{
+  size_t n = fr->w * fr->frame_size;
+  if (++fr->since_refresh == n) {
+    fr_refresh(fr, rb);
+    return;
+  }
+  size_t tail = rb->tail - rb->buffer;
+  double last = (double)(fr->frame_size - 1);
+  for (size_t j = 0; j < fr->w; ++j) {
+    struct sts_regression_sums* s = fr->sums + j;
+    size_t delay = (fr->w - 1 - j) * fr->frame_size;
+    // the value leaving frame j has entered frame j - 1
+    double leaving = j == 0 ? head : rb->buffer[(tail + n - delay
+                                                 - fr->frame_size) % n];
+    if (isinf(leaving)) {
+      if (leaving > 0) --s->pos_inf;
+      else --s->neg_inf;
+    } else if (!isnan(leaving)) {
+      s->cnt -= 1;
+      s->s_y -= leaving;
+    }
+    // the rest moves one position back
+    s->s_tt += s->cnt - 2 * s->s_t;
+    s->s_t -= s->cnt;
+    s->s_ty -= s->s_y;
+    regression_add(s, last, rb->buffer[(tail + n - delay) % n]);
+  }
+}
+
+/*
+ * Packs mean and slope symbols of a frame, all-NaN frames are encoded with
+ * c * c_slope
+ */
+static sts_symbol encode_1dsax_frame(const struct sts_regression_sums* s,
+                                     const float* breaks,
+                                     unsigned int c,
+                                     const double* slope_breaks,
+                                     unsigned int c_slope,
+                                     double mu,
+                                     double std)
+{
+  double mean;
+  if (s->pos_inf > 0 || s->neg_inf > 0) {
+    mean = s->neg_inf == 0 ? INFINITY : s->pos_inf == 0 ? -INFINITY : NAN;
+  } else if (s->cnt == 0) {
+    mean = NAN;
+  } else {
+    mean = std < STS_STAT_EPS ? 0 : (s->s_y / s->cnt - mu) / std;
+  }
+  if (isnan(mean)) return (sts_symbol)(c * c_slope);
+  double slope = 0;
+  double den = s->cnt * s->s_tt - s->s_t * s->s_t;
+  if (s->cnt >= 2 && den > 0 && std >= STS_STAT_EPS) {
+    slope = (s->cnt * s->s_ty - s->s_t * s->s_y) / den / std;
+  }
+  return (sts_symbol)(get_symbol(mean, breaks, c) * c_slope
+                      + get_scaled_symbol(slope, slope_breaks, c_slope));
+}
+
+/*
+ * Symbolic Fourier Approximation model: word of w values holds real and
+ * imaginary parts of DFT coefficients 1, 2, ... of the z-normalized window
+ * scaled by sqrt(2 / n), so that the sum of their squared differences lower
+ * bounds the squared euclidean distance. Every position has its own row of
+ * c - 1 breakpoints (Multiple Coefficient Binning), N(0, 1) ones until the
+ * model is trained.
+ */
+struct sts_sfa {
+  size_t n, w;
+  unsigned int c;
+  float* breaks; // w rows of c - 1 breakpoints
+};
+
+/*
+ * Sliding DFT of coefficients 1..k of the last n values, non-finite values
+ * enter it as zeros. Coefficients are rotated in O(k) per value and
+ * recomputed from scratch once per n values to stop rounding errors from
+ * accumulating.
+ */
+struct sts_sliding_dft {
+  size_t n, k;
+  size_t since_refresh;
+  double* re, * im;
+  double* rot_re, * rot_im; // e^(2 * pi * i * j / n), j = 1..k
+};
+
+#define STS_TWO_PI 6.28318530717958647693
+
+static void sdft_refresh(struct sts_sliding_dft* sd,
+                         const double* series_begin,
+                         const double* buffer_start,
+                         const double* buffer_break)
+{
+  for (size_t j = 0; j < sd->k; ++j) {
+    sd->re[j] = 0;
+    sd->im[j] = 0;
+  }
+  const double* val = series_begin;
+  for (size_t t = 0; t < sd->n; ++t) {
+    double value = isfinite(*val) ? *val : 0;
+    if (value != 0) {
+      for (size_t j = 0; j < sd->k; ++j) {
+        double angle = STS_TWO_PI * (double)((j + 1) * t % sd->n) / sd->n;
+        sd->re[j] += value * cos(angle);
+        sd->im[j] -= value * sin(angle);
+      }
+    }
+    if (++val == buffer_break) val = buffer_start;
+  }
+  sd->since_refresh = 0;
+}
+
+static void sdft_free(struct sts_sliding_dft* sd)
+{
+  if (!sd) return;
+  free(sd->re);
+  free(sd->im);
+  free(sd->rot_re);
+  free(sd->rot_im);
+  free(sd);
+}
+
+static struct sts_sliding_dft* sdft_new(size_t n, size_t k)
+{
+  struct sts_sliding_dft* sd = calloc(1, sizeof*sd);
+  if (!sd) return NULL;
+  sd->n = n;
+  sd->k = k;
+  sd->re = calloc(k, sizeof*sd->re);
+  sd->im = calloc(k, sizeof*sd->im);
+  sd->rot_re = malloc(k * sizeof*sd->rot_re);
+  sd->rot_im = malloc(k * sizeof*sd->rot_im);
+  if (!sd->re || !sd->im || !sd->rot_re || !sd->rot_im) {
+    sdft_free(sd);
+    return NULL;
+  }
+  for (size_t j = 0; j < k; ++j) {
+    sd->rot_re[j] = cos(STS_TWO_PI * (j + 1) / n);
+    sd->rot_im[j] = sin(STS_TWO_PI * (j + 1) / n);
+  }
+  return sd;
+}
+
+/*
+ * X_j <- (X_j - leaving + entering) * e^(2 * pi * i * j / n)
+ */
+static void sdft_slide(struct sts_sliding_dft* sd,
+                       double leaving,
+                       double entering)
+{
+  double diff = (isfinite(entering) ? entering : 0)
+                - (isfinite(leaving) ? leaving : 0);
+  for (size_t j = 0; j < sd->k; ++j) {
+    double re = sd->re[j] + diff;
+    double im = sd->im[j];
+    sd->re[j] = re * sd->rot_re[j] - im * sd->rot_im[j];
+    sd->im[j] = re * sd->rot_im[j] + im * sd->rot_re[j];
+  }
+}
+
+/*
+ * Slides the transform of a window, head is the value evicted from the ring
+ * buffer and rb->tail points to the newest one
+ */
+static void sdft_push(struct sts_sliding_dft* sd,
+                      const struct sts_ring_buffer* rb,
+                      double head)
+{
+  if (++sd->since_refresh == sd->n) {
+    sdft_refresh(sd, rb->head, rb->buffer, rb->buffer_end);
+  } else {
+    sdft_slide(sd, head, *rb->tail);
+  }
+}
+
+/*
+ * Quantizes w scaled coefficients with the rows of sfa. Windows with
+ * non-finite values have no meaningful spectrum and get NaN symbols
+ */
+static void apply_sfa_transform(const struct sts_sfa* sfa,
+                                const struct sts_sliding_dft* sd,
+                                double std,
+                                bool all_finite,
+                                sts_symbol* out)
+{
+  double scale = std < STS_STAT_EPS ? 0 : sqrt(2.0 / sfa->n) / std;
+  for (size_t i = 0; i < sfa->w; ++i) {
+    double value = NAN;
+    if (all_finite) {
+      value = (i % 2 == 0 ? sd->re[i / 2] : sd->im[i / 2]) * scale;
+    }
+    out[i] = get_symbol(value, sfa->breaks + i * (sfa->c - 1), sfa->c);
+  }
+}
+
+sts_sfa sts_new_sfa(size_t n, size_t w, unsigned int c)
+{
+  // Coefficients up to the Nyquist one, exclusive
+  if (n < 3 || w == 0 || (w + 1) / 2 > (n - 1) / 2
+      || c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY) {
+    return NULL;
+  }
+  sts_sfa sfa = malloc(sizeof*sfa);
+  if (!sfa) return NULL;
+  sfa->n = n;
+  sfa->w = w;
+  sfa->c = c;
+  sfa->breaks = malloc(w * (c - 1) * sizeof*sfa->breaks);
+  if (!sfa->breaks) {
+    free(sfa);
+    return NULL;
+  }
+  for (size_t i = 0; i < w; ++i) {
+    memcpy(sfa->breaks + i * (c - 1), get_breaks(c),
+           (c - 1) * sizeof*sfa->breaks);
+  }
+  return sfa;
+}
+
+bool sts_sfa_train(sts_sfa sfa, const double* series, size_t n_values)
+{
+  if (!sfa || !series || n_values < sfa->n) return false;
+  size_t n = sfa->n, w = sfa->w;
+  size_t max_samples = n_values - n + 1;
+  double* samples = malloc(w * max_samples * sizeof*samples);
+  struct sts_sliding_dft* sd = sdft_new(n, (w + 1) / 2);
+  if (!samples || !sd) {
+    free(samples);
+    sdft_free(sd);
+    return false;
+  }
+  // Equi-depth binning of the coefficients of every finite sliding window
+  size_t m = 0;
+  size_t finite_cnt = 0;
+  double mu, std;
+  for (size_t i = 0; i < n; ++i) {
+    if (isfinite(series[i])) ++finite_cnt;
+  }
+  sdft_refresh(sd, series, NULL, NULL);
+  for (size_t s = 0; s < max_samples; ++s) {
+    if (s > 0) {
+      if (isfinite(series[s - 1])) --finite_cnt;
+      if (isfinite(series[s + n - 1])) ++finite_cnt;
+      if (s % n == 0) {
+        sdft_refresh(sd, series + s, NULL, NULL);
+      } else {
+        sdft_slide(sd, series[s - 1], series[s + n - 1]);
+      }
+    }
+    if (finite_cnt != n) continue;
+    estimate_mu_and_std(series + s, n, &mu, &std);
+    double scale = std < STS_STAT_EPS ? 0 : sqrt(2.0 / n) / std;
+    for (size_t i = 0; i < w; ++i) {
+      samples[i * max_samples + m] =
+        (i % 2 == 0 ? sd->re[i / 2] : sd->im[i / 2]) * scale;
+    }
+    ++m;
+  }
+  sdft_free(sd);
+  if (m == 0) {
+    free(samples);
+    return false;
+  }
+  for (size_t i = 0; i < w; ++i) {
+    double* column = samples + i * max_samples;
+    qsort(column, m, sizeof*column, compare_doubles);
+    for (unsigned int b = 1; b < sfa->c; ++b) {
+      sfa->breaks[i * (sfa->c - 1) + b - 1] = (float)column[b * m / sfa->c];
+    }
+  }
+  free(samples);
+  return true;
+}
+
+void sts_free_sfa(sts_sfa sfa)
+{
+  if (!sfa) return;
+  free(sfa->breaks);
+  free(sfa);
+}
+
+/*
+ * Normalized average of a frame given the sum of its current_frame_size
+ * non-NaN values
+ */
+static double normalize_frame_sum(double average,
+                                  size_t current_frame_size,
+                                  double mu,
+                                  double std)
+{
+  if (current_frame_size == 0 || isnan(average)) {
+    // All NaNs or (-INF + INF)
+    return NAN;
+  }
+  if (isfinite(average)) {
+    if (std < STS_STAT_EPS) {
+      average = 0;
+    } else {
+      average = (average - (current_frame_size * mu))
+        / (current_frame_size * std);
+    }
+  }
+  return average;
+}
+
+#if defined(STS_ENABLE_STATS) || defined(STS_ENABLE_RECORDING)
+static uint64_t clock_ns(void)
+{
+  struct timespec ts;
+#ifdef _MSC_VER
+  timespec_get(&ts, TIME_UTC);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/*
+ * Append instrumentation, compiled in with STS_ENABLE_STATS. Only the thread
+ * appending to a window writes its counters, so increments are plain relaxed
+ * load-add-store pairs and snapshots read each counter atomically
+ */
+#ifdef STS_ENABLE_STATS
+struct sts_append_stats {
+  uint64_t appends, recomputes, nan_frames, word_changes;
+  uint64_t latency[STS_STATS_BUCKETS];
+  uint64_t start; // clock of the append call in progress, 0 if none
+  sts_symbol* last; // w symbols of the previous update
+  size_t w; // constructors of other encodings resize words after new_window
+};
+
+#if defined(__GNUC__)
+#define STS_STATS_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STS_STATS_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#else
+// aligned 64-bit accesses aren't torn on the 64-bit MSVC targets
+#define STS_STATS_LOAD(x) (*(volatile uint64_t*)&(x))
+#define STS_STATS_STORE(x, v) (*(volatile uint64_t*)&(x) = (v))
+#endif
+#define STS_STATS_ADD(x, v) STS_STATS_STORE(x, STS_STATS_LOAD(x) + (v))
+
+static size_t stats_bucket(uint64_t ns)
+{
+  if (ns < 8) return (size_t)ns;
+  unsigned int e = 3;
+  while (e < 63 && ns >> (e + 1)) ++e;
+  size_t bucket = (e - 2) * 8 + (size_t)((ns >> (e - 3)) & 7);
+  return bucket < STS_STATS_BUCKETS ? bucket : STS_STATS_BUCKETS - 1;
+}
+
+static struct sts_append_stats* stats_new(void)
+{
+  return calloc(1, sizeof(struct sts_append_stats));
+}
+
+static void stats_free(struct sts_append_stats* st)
+{
+  if (!st) return;
+  free(st->last);
+  free(st);
+}
+
+/*
+ * Counts the word update closing an append call started with STS_STATS_BEGIN
+ */
+static void stats_record(struct sts_append_stats* st,
+                         const struct sts_word* word)
+{
+  STS_STATS_ADD(st->recomputes, 1);
+  sts_symbol nan_symbol = (sts_symbol)(word->c * word->c_slope);
+  uint64_t nan_frames = 0;
+  for (size_t i = 0; i < word->w; ++i) {
+    nan_frames += word->symbols[i] == nan_symbol;
+  }
+  if (nan_frames) STS_STATS_ADD(st->nan_frames, nan_frames);
+  if (st->w != word->w) {
+    // first update, the previous word is the initial all-NaN one
+    sts_symbol* last = realloc(st->last, word->w * sizeof*last);
+    if (last) {
+      for (size_t i = 0; i < word->w; ++i) last[i] = nan_symbol;
+      st->last = last;
+      st->w = word->w;
+    }
+  }
+  if (st->w == word->w
+      && memcmp(st->last, word->symbols, word->w * sizeof*word->symbols)) {
+    memcpy(st->last, word->symbols, word->w * sizeof*word->symbols);
+    STS_STATS_ADD(st->word_changes, 1);
+  }
+  if (st->start) {
+    uint64_t elapsed = clock_ns() - st->start;
+    STS_STATS_ADD(st->latency[stats_bucket(elapsed)], 1);
+    st->start = 0;
+  }
+}
+
+#define STS_STATS_BEGIN(window) \
+  if ((window)->stats) (window)->stats->start = clock_ns()
+#define STS_STATS_APPENDED(window) \
+  if ((window)->stats) STS_STATS_ADD((window)->stats->appends, 1)
+#define STS_STATS_UPDATED(window) \
+  if ((window)->stats) stats_record((window)->stats, &(window)->current_word)
+#else
+#define STS_STATS_BEGIN(window) (void)0
+#define STS_STATS_APPENDED(window) (void)0
+#define STS_STATS_UPDATED(window) (void)0
+#endif
+
+bool sts_get_window_stats(const struct sts_window* window,
+                          struct sts_window_stats* stats)
+{
+#ifdef STS_ENABLE_STATS
+  if (!window || !window->stats || !stats) return false;
+  const struct sts_append_stats* st = window->stats;
+  stats->appends = STS_STATS_LOAD(st->appends);
+  stats->recomputes = STS_STATS_LOAD(st->recomputes);
+  stats->nan_frames = STS_STATS_LOAD(st->nan_frames);
+  stats->word_changes = STS_STATS_LOAD(st->word_changes);
+  for (size_t i = 0; i < STS_STATS_BUCKETS; ++i) {
+    stats->latency[i] = STS_STATS_LOAD(st->latency[i]);
+  }
+  return true;
+#else
+  (void)window;
+  (void)stats;
+  return false;
+#endif
+}
+
+uint64_t sts_stats_percentile(const struct sts_window_stats* stats, double q)
+{
+  if (!stats) return 0;
+  uint64_t total = 0;
+  for (size_t i = 0; i < STS_STATS_BUCKETS; ++i) {
+    total += stats->latency[i];
+  }
+  if (total == 0) return 0;
+  double rank = q <= 0 ? 1 : q >= 1 ? (double)total : ceil(q * total);
+  uint64_t seen = 0;
+  size_t i = 0;
+  for (; i < STS_STATS_BUCKETS - 1; ++i) {
+    seen += stats->latency[i];
+    if (seen >= rank) break;
+  }
+  if (i < 8) return i;
+  // bucket of i covers [(8 + i % 8) << e, (9 + i % 8) << e), e = i / 8 - 1
+  unsigned int e = (unsigned int)(i / 8 - 1);
+  return ((uint64_t)(9 + i % 8) << e) - 1;
+}
+
+/*
+ * Recording of append calls, compiled in with STS_ENABLE_RECORDING. Only
+ * windows created during the recording are recorded, replaying the others
+ * would need their values. record_id keeps the session of their creation in
+ * the high half and their id, given on their first recorded call, in the low
+ * one
+ */
+#ifdef STS_ENABLE_RECORDING
+static struct {
+  FILE* file;
+  bool failed; // a write failed, reported by sts_stop_recording
+  uint64_t start;
+  uint32_t session, next_id;
+  bool lock;
+} recorder;
+
+#if defined(__GNUC__)
+#define STS_RECORDER_LOCK() \
+  while (__atomic_test_and_set(&recorder.lock, __ATOMIC_ACQUIRE))
+#define STS_RECORDER_UNLOCK() __atomic_clear(&recorder.lock, __ATOMIC_RELEASE)
+#define STS_RECORDING() __atomic_load_n(&recorder.file, __ATOMIC_RELAXED)
+#define STS_SET_RECORDING(f) \
+  __atomic_store_n(&recorder.file, (f), __ATOMIC_RELAXED)
+#else
+#error "STS_ENABLE_RECORDING needs the atomic builtins of GCC or Clang"
+#endif
+
+static unsigned char* put_le(unsigned char* out, uint64_t value, size_t size)
+{
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = (unsigned char)(value >> (8 * i));
+  }
+  return out + size;
+}
+
+static unsigned char* put_double(unsigned char* out, double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return put_le(out, bits, 8);
+}
+
+static uint64_t word_hash(const struct sts_word* word)
+{
+  if (!word) return 0;
+  uint64_t hash = 14695981039346656037u;
+  for (size_t i = 0; i < word->w; ++i) {
+    hash = (hash ^ (word->symbols[i] & 0xff)) * 1099511628211u;
+    hash = (hash ^ (word->symbols[i] >> 8)) * 1099511628211u;
+  }
+  return hash;
+}
+
+static void record_bytes(const unsigned char* bytes, size_t size)
+{
+  if (fwrite(bytes, 1, size, recorder.file) != size) recorder.failed = true;
+}
+
+/*
+ * Writes the header of the call, describing the window first if needed,
+ * under the lock
+ * @return false if the window isn't recorded
+ */
+static bool record_call(sts_window window, char tag)
+{
+  unsigned char buf[48], * out = buf;
+  if (window->record_id >> 32 != recorder.session) return false;
+  if ((uint32_t)window->record_id == 0) {
+    window->record_id |= ++recorder.next_id;
+    const struct sts_word* word = &window->current_word;
+    *out++ = 'W';
+    out = put_le(out, (uint32_t)window->record_id, 4);
+    out = put_le(out, word->n_values, 8);
+    out = put_le(out, word->encoding == STS_ENC_ESAX ? word->w / 3 : word->w,
+                 8);
+    out = put_le(out, word->c, 4);
+    out = put_le(out, word->c_slope, 4);
+    *out++ = (unsigned char)window->normalization;
+    *out++ = (unsigned char)word->encoding;
+    *out++ = window->breakpoints != NULL;
+  }
+  *out++ = (unsigned char)tag;
+  out = put_le(out, (uint32_t)window->record_id, 4);
+  out = put_le(out, clock_ns() - recorder.start, 8);
+  record_bytes(buf, (size_t)(out - buf));
+  return true;
+}
+
+static void record_created(sts_window window)
+{
+  STS_RECORDER_LOCK();
+  if (recorder.file) window->record_id = (uint64_t)recorder.session << 32;
+  STS_RECORDER_UNLOCK();
+}
+
+static void record_value(sts_window window,
+                         double value,
+                         const struct sts_word* word)
+{
+  STS_RECORDER_LOCK();
+  if (recorder.file && record_call(window, 'V')) {
+    unsigned char buf[16], * out = buf;
+    out = put_double(out, value);
+    out = put_le(out, word_hash(word), 8);
+    record_bytes(buf, (size_t)(out - buf));
+  }
+  STS_RECORDER_UNLOCK();
+}
+
+static void record_array(sts_window window,
+                         const double* values,
+                         size_t n_values,
+                         const struct sts_word* word)
+{
+  STS_RECORDER_LOCK();
+  if (recorder.file && record_call(window, 'A')) {
+    unsigned char buf[8 * 32];
+    put_le(buf, n_values, 8);
+    record_bytes(buf, 8);
+    for (size_t i = 0; i < n_values; i += 32) {
+      unsigned char* out = buf;
+      for (size_t j = i; j < n_values && j < i + 32; ++j) {
+        out = put_double(out, values[j]);
+      }
+      record_bytes(buf, (size_t)(out - buf));
+    }
+    put_le(buf, word_hash(word), 8);
+    record_bytes(buf, 8);
+  }
+  STS_RECORDER_UNLOCK();
+}
+
+static void record_reset(sts_window window)
+{
+  STS_RECORDER_LOCK();
+  if (recorder.file) record_call(window, 'R');
+  STS_RECORDER_UNLOCK();
+}
+
+/*
+ * Stops recording window, which went through a call that isn't recorded, so
+ * that sts_replay stops replaying it there
+ */
+static void record_untracked(sts_window window)
+{
+  STS_RECORDER_LOCK();
+  if (recorder.file && (uint32_t)window->record_id != 0) {
+    record_call(window, 'U');
+  }
+  window->record_id = 0;
+  STS_RECORDER_UNLOCK();
+}
+
+#define STS_RECORD_CREATED(window) \
+  if (STS_RECORDING()) record_created(window)
+#define STS_RECORD_VALUE(window, value, word) \
+  if (STS_RECORDING()) record_value(window, value, word)
+#define STS_RECORD_ARRAY(window, values, n_values, word) \
+  if (STS_RECORDING()) record_array(window, values, n_values, word)
+#define STS_RECORD_RESET(window) \
+  if (STS_RECORDING()) record_reset(window)
+#define STS_RECORD_UNTRACKED(window) \
+  if ((window)->record_id) record_untracked(window)
+#else
+#define STS_RECORD_CREATED(window) (void)0
+#define STS_RECORD_VALUE(window, value, word) (void)0
+#define STS_RECORD_ARRAY(window, values, n_values, word) (void)0
+#define STS_RECORD_RESET(window) (void)0
+#define STS_RECORD_UNTRACKED(window) (void)0
+#endif
+
+bool sts_start_recording(const char* path)
+{
+#ifdef STS_ENABLE_RECORDING
+  if (!path) return false;
+  bool started = false;
+  STS_RECORDER_LOCK();
+  if (!recorder.file) {
+    FILE* file = fopen(path, "wb");
+    if (file && fwrite(STS_RECORD_MAGIC, 1, 8, file) == 8) {
+      recorder.failed = false;
+      recorder.start = clock_ns();
+      ++recorder.session;
+      recorder.next_id = 0;
+      STS_SET_RECORDING(file);
+      started = true;
+    } else if (file) {
+      fclose(file);
+    }
+  }
+  STS_RECORDER_UNLOCK();
+  return started;
+#else
+  (void)path;
+  return false;
+#endif
+}
+
+bool sts_stop_recording(void)
+{
+#ifdef STS_ENABLE_RECORDING
+  STS_RECORDER_LOCK();
+  FILE* file = recorder.file;
+  STS_SET_RECORDING(NULL);
+  bool written = file && !recorder.failed;
+  STS_RECORDER_UNLOCK();
+  return file && fclose(file) == 0 && written;
+#else
+  return false;
+#endif
+}
+
+static void init_window(sts_window window,
+                        size_t n,
+                        size_t w,
+                        unsigned int c,
+                        sts_symbol* symbols,
+                        struct sts_ring_buffer* values)
+{
+  window->current_word.n_values = n;
+  window->current_word.w = w;
+  window->current_word.c = c;
+  window->current_word.encoding = STS_ENC_SAX;
+  window->current_word.c_slope = 1;
+  window->current_word.breaks = NULL;
+  window->current_word.symbols = symbols;
+  for (size_t i = 0; i < w; ++i) {
+    window->current_word.symbols[i] = c;
+  }
+  window->values = values;
+  window->normalization = STS_NORM_ZSCORE;
+  window->thresholds = NULL;
+  window->order = NULL;
+  window->breakpoints = NULL;
+  window->extrema = NULL;
+  window->regression = NULL;
+  window->sfa = NULL;
+  window->dft = NULL;
+  window->stats = NULL;
+  window->record_id = 0;
+  STS_RECORD_CREATED(window);
+}
+
+static sts_window new_window(size_t n,
+                             size_t w,
+                             unsigned int c,
+                             struct sts_ring_buffer* values)
+{
+  sts_window window = malloc(sizeof*window);
+  if (!window) return NULL;
+  sts_symbol* symbols = malloc(w * sizeof*symbols);
+  if (!symbols) {
+    free(window);
+    return NULL;
+  }
+  init_window(window, n, w, c, symbols, values);
+#ifdef STS_ENABLE_STATS
+  window->stats = stats_new();
+#endif
+  return window;
+}
+
+static void init_ring_buffer(struct sts_ring_buffer* values,
+                             double* buffer,
+                             size_t n)
+{
+  values->buffer = buffer;
+  for (size_t i = 0; i < n; ++i) {
+    values->buffer[i] = NAN;
+  }
+  values->buffer_end = values->buffer + n;
+  values->head = values->buffer;
+  values->tail = values->buffer_end - 1;
+  values->mu = 0;
+  values->s2 = 0;
+  values->finite_cnt = 0;
+}
+
+static struct sts_ring_buffer* new_ring_buffer(size_t n)
+{
+  struct sts_ring_buffer* values = malloc(sizeof*values);
+  if (!values) return NULL;
+  double* buffer = malloc(n * sizeof*buffer);
+  if (!buffer) {
+    free(values);
+    return NULL;
+  }
+  init_ring_buffer(values, buffer, n);
+  return values;
+}
+
+sts_window sts_new_window(size_t n, size_t w, unsigned int c)
+{
+  if (n % w != 0 || c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY) {
+    return NULL;
+  }
+  struct sts_ring_buffer* values = new_ring_buffer(n);
+  if (!values) return NULL;
+  return new_window(n, w, c, values);
+}
+
+/*
+ * sts_init_window storage: the window, its ring buffer, n values and w
+ * symbols, every part starting at a multiple of sizeof(double)
+ */
+static size_t storage_offset(size_t size)
+{
+  return (size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+}
+
+size_t sts_window_storage_size(size_t n, size_t w)
+{
+  return storage_offset(sizeof(struct sts_window))
+         + storage_offset(sizeof(struct sts_ring_buffer))
+         + n * sizeof(double) + w * sizeof(sts_symbol);
+}
+
+sts_window sts_init_window(void* storage, size_t n, size_t w, unsigned int c)
+{
+  if (!storage || n == 0 || w == 0 || n % w != 0
+      || c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY) {
+    return NULL;
+  }
+  unsigned char* mem = storage;
+  size_t values_offset = storage_offset(sizeof(struct sts_window));
+  size_t buffer_offset =
+    values_offset + storage_offset(sizeof(struct sts_ring_buffer));
+  size_t symbols_offset = buffer_offset + n * sizeof(double);
+  sts_window window = storage;
+  struct sts_ring_buffer* values =
+    (struct sts_ring_buffer*)(mem + values_offset);
+  init_ring_buffer(values, (double*)(mem + buffer_offset), n);
+  init_window(window, n, w, c, (sts_symbol*)(mem + symbols_offset), values);
+  return window;
+}
+
+sts_window sts_new_fixed_window(size_t n,
+                                size_t w,
+                                unsigned int c,
+                                double mu,
+                                double sigma)
+{
+  if (!isfinite(mu) || !isfinite(sigma) || sigma <= 0) {
+    return NULL;
+  }
+  sts_window window = sts_new_window(n, w, c);
+  if (!window) return NULL;
+  window->thresholds = malloc((c - 1) * sizeof*window->thresholds);
+  if (!window->thresholds) {
+    sts_free_window(window);
+    return NULL;
+  }
+  scale_breaks(c, n / w, mu, sigma, window->thresholds);
+  window->normalization = STS_NORM_FIXED;
+  return window;
+}
+
+sts_window sts_new_robust_window(size_t n, size_t w, unsigned int c)
+{
+  sts_window window = sts_new_window(n, w, c);
+  if (!window) return NULL;
+  window->order = os_new(n);
+  if (!window->order) {
+    sts_free_window(window);
+    return NULL;
+  }
+  window->normalization = STS_NORM_ROBUST;
+  return window;
+}
+
+sts_window sts_new_adaptive_window(size_t n, size_t w, sts_breakpoints bp)
+{
+  if (!bp) return NULL;
+  sts_window window = sts_new_window(n, w, bp->c);
+  if (!window) return NULL;
+  window->breakpoints = bp;
+  return window;
+}
+
+sts_window sts_new_esax_window(size_t n, size_t w, unsigned int c)
+{
+  sts_window window = sts_new_window(n, w, c);
+  if (!window) return NULL;
+  sts_symbol* symbols = realloc(window->current_word.symbols,
+                                3 * w * sizeof*symbols);
+  if (symbols) window->current_word.symbols = symbols;
+  window->extrema = fe_new(w, n / w);
+  if (!symbols || !window->extrema) {
+    sts_free_window(window);
+    return NULL;
+  }
+  for (size_t i = 0; i < 3 * w; ++i) {
+    symbols[i] = c;
+  }
+  window->current_word.w = 3 * w;
+  window->current_word.encoding = STS_ENC_ESAX;
+  return window;
+}
+
+sts_window sts_new_sfa_window(sts_sfa sfa)
+{
+  if (!sfa) return NULL;
+  struct sts_ring_buffer* values = new_ring_buffer(sfa->n);
+  if (!values) return NULL;
+  sts_window window = new_window(sfa->n, sfa->w, sfa->c, values);
+  if (!window) return NULL;
+  window->dft = sdft_new(sfa->n, (sfa->w + 1) / 2);
+  if (!window->dft) {
+    sts_free_window(window);
+    return NULL;
+  }
+  window->sfa = sfa;
+  window->current_word.encoding = STS_ENC_SFA;
+  window->current_word.breaks = sfa->breaks;
+  return window;
+}
+
+sts_window sts_new_1dsax_window(size_t n,
+                                size_t w,
+                                unsigned int c,
+                                unsigned int c_slope)
+{
+  if (c_slope > STS_MAX_CARDINALITY
+      || c_slope < STS_MIN_CARDINALITY
+      || c * c_slope > STS_MAX_SYMBOL) {
+    return NULL;
+  }
+  sts_window window = sts_new_window(n, w, c);
+  if (!window) return NULL;
+  window->regression = fr_new(w, n / w, c_slope);
+  if (!window->regression) {
+    sts_free_window(window);
+    return NULL;
+  }
+  for (size_t i = 0; i < w; ++i) {
+    window->current_word.symbols[i] = (sts_symbol)(c * c_slope);
+  }
+  window->current_word.c_slope = c_slope;
+  window->current_word.encoding = STS_ENC_1DSAX;
+  return window;
+}
+
+/*
+ * Apend to circular buffer, updates finite_cnt
+ */
+static double rb_push(struct sts_ring_buffer* rb, double value)
+{
+  double prev_head = 0;
+  if (isfinite(value)) {
+    ++rb->finite_cnt;
+  }
+  ++rb->tail;
+  if (rb->tail == rb->buffer_end) {
+    rb->tail = rb->buffer;
+  }
+
+  if (rb->tail == rb->head) {
+    prev_head = *rb->head;
+    if (isfinite(*rb->head)) {
+      --rb->finite_cnt;
+    }
+    if (++rb->head == rb->buffer_end) {
+      rb->head = rb->buffer;
+    }
+  }
+  *rb->tail = value;
+
+  return prev_head;
+}
+
+/*
+ * Averages the frame starting at *val, normalizes the average with mu and std
+ * and moves *val to the beginning of the next frame
+ */
+static double normalized_frame_average(size_t frame_size,
+                                       double mu,
+                                       double std,
+                                       const double** val,
+                                       const double* buffer_start,
+                                       const double* buffer_break)
+{
+  double average = 0;
+  size_t current_frame_size = frame_size;
+  for (size_t j = 0; j < frame_size; ++j) {
+    if (isnan(**val)) {
+      --current_frame_size;
+    } else {
+      average += **val;
+    }
+    if (++*val == buffer_break) *val = buffer_start;
+  }
+  return normalize_frame_sum(average, current_frame_size, mu, std);
+}
+
+/*
+ * Hot loops of the SAX transform in one variant per instruction set, picked
+ * when the library is loaded, see sts_active_kernel. Variants share the body
+ * below and differ in target attributes only. Loops run over blocks of frames
+ * as vector lanes and every frame is still summed in order, so that all
+ * variants produce identical words. Statistics and mindist accumulate
+ * sequentially and stay scalar
+ */
+#define STS_KERNEL_LANES 8
+// Largest cardinality quantized by counting breakpoints instead of search
+#define STS_KERNEL_LINEAR_CARDINALITY 32
+
+#define STS_DEFINE_KERNELS(suffix, attributes)                                 \
+static attributes void frame_sums_##suffix(const double* restrict values,      \
+                                           size_t frame_size,                  \
+                                           double* restrict sums,              \
+                                           size_t* restrict sizes)             \
+{                                                                              \
+  double acc[STS_KERNEL_LANES] = { 0 };                                        \
+  size_t cnt[STS_KERNEL_LANES];                                                \
+  for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {                              \
+    cnt[k] = frame_size;                                                       \
+  }                                                                            \
+  for (size_t j = 0; j < frame_size; ++j) {                                    \
+    for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {                            \
+      double value = values[k * frame_size + j];                               \
+      bool nan = value != value;                                               \
+      /* sums never are -0, so adding 0 is the same as skipping NaN */         \
+      acc[k] += nan ? 0 : value;                                               \
+      cnt[k] -= nan;                                                           \
+    }                                                                          \
+  }                                                                            \
+  for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {                              \
+    sums[k] = acc[k];                                                          \
+    sizes[k] = cnt[k];                                                         \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+static attributes void quantize_##suffix(const double* restrict sums,          \
+                                         const size_t* restrict sizes,         \
+                                         double mu,                            \
+                                         double std,                           \
+                                         const float* restrict breaks,         \
+                                         unsigned int c,                       \
+                                         sts_symbol* restrict out)             \
+{                                                                              \
+  double values[STS_KERNEL_LANES];                                             \
+  unsigned int counts[STS_KERNEL_LANES] = { 0 };                               \
+  for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {                              \
+    values[k] = normalize_frame_sum(sums[k], sizes[k], mu, std);               \
+  }                                                                            \
+  if (c > STS_KERNEL_LINEAR_CARDINALITY) {                                     \
+    for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {                            \
+      out[k] = get_symbol(values[k], breaks, c);                               \
+    }                                                                          \
+    return;                                                                    \
+  }                                                                            \
+  /* number of breakpoints <= value, as get_symbol finds it */                 \
+  for (unsigned int i = 0; i + 1 < c; ++i) {                                   \
+    double b = breaks[i];                                                      \
+    for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {                            \
+      counts[k] += b <= values[k];                                             \
+    }                                                                          \
+  }                                                                            \
+  for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {                              \
+    out[k] = (sts_symbol)(isnan(values[k]) ? c : c - 1 - counts[k]);           \
+  }                                                                            \
+}
+
+/*
+ * Portable variant summing frame after frame, vector lanes don't pay off
+ * without wider registers
+ */
+static void frame_sums_scalar(const double* values,
+                              size_t frame_size,
+                              double* sums,
+                              size_t* sizes)
+{
+  for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {
+    double sum = 0;
+    size_t size = frame_size;
+    for (size_t j = 0; j < frame_size; ++j, ++values) {
+      if (isnan(*values)) {
+        --size;
+      } else {
+        sum += *values;
+      }
+    }
+    sums[k] = sum;
+    sizes[k] = size;
+  }
+}
+
+static void quantize_scalar(const double* sums,
+                            const size_t* sizes,
+                            double mu,
+                            double std,
+                            const float* breaks,
+                            unsigned int c,
+                            sts_symbol* out)
+{
+  for (size_t k = 0; k < STS_KERNEL_LANES; ++k) {
+    out[k] = get_symbol(normalize_frame_sum(sums[k], sizes[k], mu, std),
+                        breaks, c);
+  }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STS_KERNEL_DISPATCH
+STS_DEFINE_KERNELS(sse42, __attribute__((target("sse4.2"))))
+STS_DEFINE_KERNELS(avx2, __attribute__((target("avx2"))))
+STS_DEFINE_KERNELS(avx512, __attribute__((target("avx512f"))))
+#endif
+
+#undef STS_DEFINE_KERNELS
+
+typedef enum {
+  STS_CPU_ANY,
+  STS_CPU_SSE42,
+  STS_CPU_AVX2,
+  STS_CPU_AVX512
+} sts_cpu_feature;
+
+static const struct sts_kernel_set {
+  const char* name;
+  sts_cpu_feature feature;
+  void (*frame_sums)(const double* values,
+                     size_t frame_size,
+                     double* sums,
+                     size_t* sizes);
+  void (*quantize)(const double* sums,
+                   const size_t* sizes,
+                   double mu,
+                   double std,
+                   const float* breaks,
+                   unsigned int c,
+                   sts_symbol* out);
+} kernel_sets[] = { // best first
+#ifdef STS_KERNEL_DISPATCH
+  { "avx512", STS_CPU_AVX512, frame_sums_avx512, quantize_avx512 },
+  { "avx2", STS_CPU_AVX2, frame_sums_avx2, quantize_avx2 },
+  { "sse4.2", STS_CPU_SSE42, frame_sums_sse42, quantize_sse42 },
+#endif
+  { "scalar", STS_CPU_ANY, frame_sums_scalar, quantize_scalar }
+};
+
+#define STS_KERNEL_SETS (sizeof(kernel_sets) / sizeof(kernel_sets[0]))
+
+static const struct sts_kernel_set* active_kernels;
+
+static bool cpu_supports(sts_cpu_feature feature)
+{
+#ifdef STS_KERNEL_DISPATCH
+  __builtin_cpu_init();
+  switch (feature) {
+  case STS_CPU_SSE42:
+    return __builtin_cpu_supports("sse4.2");
+  case STS_CPU_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case STS_CPU_AVX512:
+    return __builtin_cpu_supports("avx512f");
+  default:
+    break;
+  }
+#endif
+  return feature == STS_CPU_ANY;
+}
+
+static const struct sts_kernel_set* find_kernel_set(const char* name)
+{
+  for (size_t i = 0; i < STS_KERNEL_SETS; ++i) {
+    if ((!name || strcmp(name, kernel_sets[i].name) == 0)
+        && cpu_supports(kernel_sets[i].feature)) {
+      return kernel_sets + i;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Best supported kernels or the ones named by STS_KERNEL
+ */
+STS_CONSTRUCTOR(init_kernels)
+{
+  const struct sts_kernel_set* set = find_kernel_set(getenv("STS_KERNEL"));
+  active_kernels = set ? set : find_kernel_set(NULL);
+}
+
+const char* sts_active_kernel(void)
+{
+  return active_kernels->name;
+}
+
+bool sts_select_kernel(const char* name)
+{
+  const struct sts_kernel_set* set = find_kernel_set(name);
+  if (!set || !name) return false;
+  active_kernels = set;
+  return true;
+}
+
+/*
+ * Given code params, mu and std of series + buffer where that series lies
+ * writes SAX-representation of the series into *out
+ */
+static void apply_sax_transform(size_t n,
+                                size_t w,
+                                unsigned int c,
+                                const float* breaks,
+                                double mu,
+                                double std,
+                                sts_symbol* out,
+                                const double* series_begin,
+                                const double* buffer_start,
+                                const double* buffer_break)
+{
+  size_t frame_size = n / w;
+  const struct sts_kernel_set* kernels = active_kernels;
+  double sums[STS_KERNEL_LANES];
+  size_t sizes[STS_KERNEL_LANES];
+  const double* val = series_begin;
+  size_t i = 0;
+  while (i < w) {
+    // frames left before the end of the buffer
+    size_t frames = buffer_break ? (size_t)(buffer_break - val) / frame_size
+                                 : w - i;
+    if (frames >= STS_KERNEL_LANES && w - i >= STS_KERNEL_LANES) {
+      kernels->frame_sums(val, frame_size, sums, sizes);
+      kernels->quantize(sums, sizes, mu, std, breaks, c, out + i);
+      i += STS_KERNEL_LANES;
+      val += STS_KERNEL_LANES * frame_size;
+      if (val == buffer_break) val = buffer_start;
+    } else {
+      out[i++] = get_symbol(normalized_frame_average(frame_size, mu, std, &val,
+                                                     buffer_start,
+                                                     buffer_break),
+                            breaks, c);
+    }
+  }
+}
+
+/*
+ * apply_sax_transform counterpart for pre-scaled breakpoints: compares raw frame
+ * sums against thresholds. Frames with NaNs are scaled up to the full frame
+ * size first
+ */
+static void apply_fixed_transform(size_t n,
+                                  size_t w,
+                                  unsigned int c,
+                                  const double* thresholds,
+                                  sts_symbol* out,
+                                  const double* series_begin,
+                                  const double* buffer_start,
+                                  const double* buffer_break)
+{
+  size_t frame_size = n / w;
+  const double* val = series_begin;
+  for (size_t i = 0; i < w; ++i) {
+    double sum = 0;
+    size_t current_frame_size = frame_size;
+    for (size_t j = 0; j < frame_size; ++j) {
+      if (isnan(*val)) {
+        --current_frame_size;
+      } else {
+        sum += *val;
+      }
+      if (++val == buffer_break) val = buffer_start;
+    }
+    if (current_frame_size == 0) {
+      sum = NAN;
+    } else if (current_frame_size != frame_size) {
+      sum = sum * frame_size / current_frame_size;
+    }
+    out[i] = get_scaled_symbol(sum, thresholds, c);
+  }
+}
+
+/*
+ * Normalizes a single value the way normalized_frame_average does it
+ */
+static double normalized_value(double value, double mu, double std)
+{
+  if (!isfinite(value)) return value;
+  return std < STS_STAT_EPS ? 0 : (value - mu) / std;
+}
+
+/*
+ * apply_sax_transform counterpart emitting (min, mean, max) symbols of every
+ * frame. Extrema are taken from fe if it's provided and found by scanning the
+ * frame otherwise
+ */
+static void apply_esax_transform(size_t n,
+                                 size_t w,
+                                 unsigned int c,
+                                 double mu,
+                                 double std,
+                                 sts_symbol* out,
+                                 const struct sts_frame_extrema* fe,
+                                 const double* series_begin,
+                                 const double* buffer_start,
+                                 const double* buffer_break)
+{
+  size_t frame_size = n / w;
+  const float* breaks = get_breaks(c);
+  const double* val = series_begin;
+  for (size_t i = 0; i < w; ++i) {
+    double lo = NAN, hi = NAN;
+    if (fe) {
+      lo = fe_get(fe, i, true);
+      hi = fe_get(fe, i, false);
+    } else {
+      const double* v = val;
+      for (size_t j = 0; j < frame_size; ++j) {
+        if (!isnan(*v)) {
+          if (isnan(lo) || *v < lo) lo = *v;
+          if (isnan(hi) || *v > hi) hi = *v;
+        }
+        if (++v == buffer_break) v = buffer_start;
+      }
+    }
+    double average = normalized_frame_average(frame_size, mu, std, &val,
+                                              buffer_start, buffer_break);
+    out[3 * i] = get_symbol(normalized_value(lo, mu, std), breaks, c);
+    out[3 * i + 1] = get_symbol(average, breaks, c);
+    out[3 * i + 2] = get_symbol(normalized_value(hi, mu, std), breaks, c);
+  }
+}
+
+static bool is_power_of_two(unsigned int x)
+{
+  return x != 0 && (x & (x - 1)) == 0;
+}
+
+/*
+ * Maps symbols of cardinality from_c onto cardinality to_c, to_c must divide
+ * from_c. Breakpoints of to_c are a subset of the ones of from_c in that case,
+ * so every from_c region lies within exactly one to_c region
+ */
+static void derive_symbols(const sts_symbol* in,
+                           size_t w,
+                           unsigned int from_c,
+                           unsigned int to_c,
+                           sts_symbol* out)
+{
+  unsigned int k = from_c / to_c;
+  if (is_power_of_two(from_c) && is_power_of_two(to_c)) {
+    // With the reversed ordering symbol prefixes stay prefixes
+    unsigned int shift = 0;
+    while ((1u << shift) < k) ++shift;
+    for (size_t i = 0; i < w; ++i) {
+      out[i] = in[i] == from_c ? (sts_symbol)to_c
+                               : (sts_symbol)(in[i] >> shift);
+    }
+    return;
+  }
+  sts_symbol map[STS_MAX_CARDINALITY + 1];
+  for (unsigned int s = 0; s < from_c; ++s) {
+    map[s] = (sts_symbol)(to_c - 1 - (from_c - 1 - s) / k);
+  }
+  map[from_c] = (sts_symbol)to_c;
+  for (size_t i = 0; i < w; ++i) {
+    out[i] = map[in[i]];
+  }
+}
+
+static sts_word new_word(size_t n, size_t w, unsigned int c,
+                         sts_symbol* symbols)
+{
+  sts_word new = malloc(sizeof*new);
+  new->n_values = n;
+  new->w = w;
+  new->c = c;
+  new->encoding = STS_ENC_SAX;
+  new->c_slope = 1;
+  new->breaks = NULL;
+  new->symbols = symbols;
+  return new;
+}
+
+static double get_window_std(sts_window window)
+{
+  return window->values->finite_cnt == 0
+         ? 0
+         : sqrt(window->values->s2 / window->values->finite_cnt);
+}
+
+static void get_window_stats(sts_window window, double* mu, double* std)
+{
+  if (window->normalization == STS_NORM_ROBUST) {
+    os_median_and_mad(window->order, mu, std);
+  } else {
+    *mu = window->values->mu;
+    *std = get_window_std(window);
+  }
+}
+
+/*
+ * Feeds the normalized average of the newest frame to adaptive breakpoints
+ */
+static void train_breakpoints(sts_window window)
+{
+  double mu, std;
+  get_window_stats(window, &mu, &std);
+  if (std < STS_STAT_EPS) return;
+  size_t n = window->current_word.n_values;
+  size_t frame_size = n / window->current_word.w;
+  const double* val = window->values->buffer
+    + (window->values->tail - window->values->buffer + n + 1 - frame_size) % n;
+  sts_breakpoints_add(window->breakpoints,
+                      normalized_frame_average(frame_size, mu, std, &val,
+                                               window->values->buffer,
+                                               window->values->buffer_end));
+}
+
+static sts_word encode_current_word(sts_window window)
+{
+  if (window->normalization == STS_NORM_FIXED) {
+    apply_fixed_transform(window->current_word.n_values,
+                          window->current_word.w,
+                          window->current_word.c,
+                          window->thresholds,
+                          window->current_word.symbols,
+                          window->values->head,
+                          window->values->buffer,
+                          window->values->buffer_end);
+    return &window->current_word;
+  }
+  double mu, std;
+  get_window_stats(window, &mu, &std);
+  if (window->current_word.encoding == STS_ENC_SFA) {
+    apply_sfa_transform(window->sfa, window->dft, std,
+                        window->values->finite_cnt
+                        == window->current_word.n_values,
+                        window->current_word.symbols);
+    return &window->current_word;
+  }
+  if (window->current_word.encoding == STS_ENC_1DSAX) {
+    const float* breaks = get_breaks(window->current_word.c);
+    for (size_t i = 0; i < window->current_word.w; ++i) {
+      window->current_word.symbols[i] =
+        encode_1dsax_frame(window->regression->sums + i, breaks,
+                           window->current_word.c,
+                           window->regression->slope_breaks,
+                           window->current_word.c_slope, mu, std);
+    }
+    return &window->current_word;
+  }
+  if (window->current_word.encoding == STS_ENC_ESAX) {
+    apply_esax_transform(window->current_word.n_values,
+                         window->current_word.w / 3,
+                         window->current_word.c,
+                         mu,
+                         std,
+                         window->current_word.symbols,
+                         window->extrema,
+                         window->values->head,
+                         window->values->buffer,
+                         window->values->buffer_end);
+    return &window->current_word;
+  }
+  const float* breaks = window->breakpoints
+                        ? window->breakpoints->published
+                        : get_breaks(window->current_word.c);
+  apply_sax_transform(window->current_word.n_values,
+                      window->current_word.w,
+                      window->current_word.c,
+                      breaks,
+                      mu,
+                      std,
+                      window->current_word.symbols,
+                      window->values->head,
+                      window->values->buffer,
+                      window->values->buffer_end);
+  return &window->current_word;
+}
+
+static sts_word update_current_word(sts_window window)
+{
+  sts_word word = encode_current_word(window);
+  STS_STATS_UPDATED(window);
+  return word;
+}
+
+/*
+ * Updates mu and s2 in on-line fashion after value has replaced head, given
+ * the numbers of finite values before and after
+ */
+static void update_mu_and_s2(double* mu,
+                             double* s2,
+                             size_t prev_finite,
+                             size_t new_finite,
+                             double value,
+                             double head)
+{
+  if (prev_finite == new_finite) {
+    // either
+    // 1) added finite and removed finite from head or
+    // 2) added non-finite and removed non-finite or
+    // 3) added non-finite on an empty place
+    // update only in case 1 (size remained the same)
+    if (isfinite(value)) {
+      double diff = value - head;
+      *mu += diff / prev_finite;
+      double a = value - *mu;
+      double b = head - *mu;
+      *s2 += diff * diff / new_finite + a * a - b * b;
+    }
+  } else if (new_finite < prev_finite) {
+    // added non-finite in place of finite (size decreased)
+    if (new_finite == 0) {
+      *mu = 0;
+      *s2 = 0;
+    } else {
+      double prev_mu = *mu;
+      *mu = (prev_mu * prev_finite - head) / new_finite;
+      double old_diff = prev_mu - head;
+      double new_diff = *mu - head;
+      *s2 += ((old_diff * old_diff * prev_finite) / (new_finite * new_finite))
+             - new_diff * new_diff;
+    }
+  } else {
+    // added new finite either on the empty place
+    // or in place of non-finite head
+    // size increased in any case -> update
+    *s2 += ((value - *mu) * (value - *mu) * prev_finite) / new_finite;
+    *mu += (value - *mu) / new_finite;
+  }
+  if (*s2 < 0 && *s2 > -STS_STAT_EPS) {
+    // to fight sqrt(-0)
+    *s2 = 0;
+  }
+}
+
+/*
+ * Appends value, updates mu and s2 in on-line fashion, but doesn't update word
+ * itself
+ */
+static void append_value(sts_window window, double value)
+{
+  STS_STATS_APPENDED(window);
+  if (window->normalization == STS_NORM_FIXED) {
+    // Statistics aren't used
+    rb_push(window->values, value);
+    return;
+  }
+  if (window->normalization == STS_NORM_ROBUST) {
+    double head = rb_push(window->values, value);
+    if (isfinite(head)) os_erase(window->order, head);
+    if (isfinite(value)) os_insert(window->order, value);
+    return;
+  }
+  size_t prev_finite = window->values->finite_cnt;
+  double head = rb_push(window->values, value);
+  size_t new_finite = window->values->finite_cnt;
+  update_mu_and_s2(&window->values->mu, &window->values->s2, prev_finite,
+                   new_finite, value, head);
+  if (window->breakpoints) train_breakpoints(window);
+  if (window->extrema) fe_push(window->extrema, window->values);
+  if (window->regression) fr_push(window->regression, window->values, head);
+  if (window->dft) sdft_push(window->dft, window->values, head);
+}
+
+const struct sts_word* sts_append_value(sts_window window, double value)
+{
+  if (window == NULL
+      || window->values == NULL
+      || window->values->buffer == NULL
+      || window->current_word.c < STS_MIN_CARDINALITY
+      || window->current_word.c > STS_MAX_CARDINALITY) {
+    return NULL;
+  }
+  STS_STATS_BEGIN(window);
+  append_value(window, value);
+  const struct sts_word* word = update_current_word(window);
+  STS_RECORD_VALUE(window, value, word);
+  return word;
+}
+
+const struct sts_word* sts_append_array(sts_window window,
                                         const double* values,
                                         size_t n_values)
 {
-  if (window == NULL
-      || window->values == NULL
-      || window->values->buffer == NULL
-      || window->current_word.c < STS_MIN_CARDINALITY
-      || window->current_word.c > STS_MAX_CARDINALITY
-      || !values) {
+  if (window == NULL
+      || window->values == NULL
+      || window->values->buffer == NULL
+      || window->current_word.c < STS_MIN_CARDINALITY
+      || window->current_word.c > STS_MAX_CARDINALITY
+      || !values) {
+    return NULL;
+  }
+  STS_STATS_BEGIN(window);
+  size_t start =
+    n_values > window->current_word.n_values
+    ? n_values - window->current_word.n_values : 0;
+  for (size_t i = start; i < n_values; ++i) {
+    append_value(window, values[i]);
+  }
+  const struct sts_word* word = update_current_word(window);
+  STS_RECORD_ARRAY(window, values + start, n_values - start, word);
+  return word;
+}
+
+/*
+ * Whether window is a z-normalized SAX window full of finite values, only
+ * finite values appended to such window keep it so
+ */
+static bool is_finite_window(sts_window window)
+{
+  return window->normalization == STS_NORM_ZSCORE
+         && window->current_word.encoding == STS_ENC_SAX
+         && window->values->finite_cnt == window->current_word.n_values;
+}
+
+/*
+ * append_value for finite value and window of is_finite_window: the head is
+ * always evicted and replaced by value, the number of finite values stays
+ */
+static void append_finite_value(sts_window window, double value)
+{
+  STS_STATS_APPENDED(window);
+  struct sts_ring_buffer* rb = window->values;
+  if (++rb->tail == rb->buffer_end) rb->tail = rb->buffer;
+  if (++rb->head == rb->buffer_end) rb->head = rb->buffer;
+  double head = *rb->tail;
+  *rb->tail = value;
+  double n = (double)rb->finite_cnt;
+  double diff = value - head;
+  rb->mu += diff / n;
+  double a = value - rb->mu;
+  double b = head - rb->mu;
+  rb->s2 += diff * diff / n + a * a - b * b;
+  if (rb->s2 < 0 && rb->s2 > -STS_STAT_EPS) {
+    // to fight sqrt(-0)
+    rb->s2 = 0;
+  }
+  if (window->breakpoints) train_breakpoints(window);
+}
+
+/*
+ * update_current_word for window of is_finite_window: frames have no NaNs,
+ * so their sums are plain loops split at the end of the buffer
+ */
+static sts_word update_finite_word(sts_window window)
+{
+  struct sts_ring_buffer* rb = window->values;
+  size_t w = window->current_word.w;
+  size_t frame_size = window->current_word.n_values / w;
+  unsigned int c = window->current_word.c;
+  const float* breaks = window->breakpoints ? window->breakpoints->published
+                                            : get_breaks(c);
+  double mu = rb->mu;
+  double std = get_window_std(window);
+  const double* val = rb->head;
+  for (size_t i = 0; i < w; ++i) {
+    double sum = 0;
+    size_t left = frame_size;
+    while (left > 0) {
+      size_t run = (size_t)(rb->buffer_end - val);
+      if (run > left) run = left;
+      for (size_t j = 0; j < run; ++j) {
+        sum += val[j];
+      }
+      left -= run;
+      val += run;
+      if (val == rb->buffer_end) val = rb->buffer;
+    }
+    double average = std < STS_STAT_EPS
+                     ? 0 : (sum - frame_size * mu) / (frame_size * std);
+    window->current_word.symbols[i] = get_symbol(average, breaks, c);
+  }
+  STS_STATS_UPDATED(window);
+  return &window->current_word;
+}
+
+const struct sts_word* sts_append_finite_value(sts_window window, double value)
+{
+  assert(isfinite(value));
+  if (window == NULL
+      || window->values == NULL
+      || window->values->buffer == NULL
+      || window->current_word.c < STS_MIN_CARDINALITY
+      || window->current_word.c > STS_MAX_CARDINALITY) {
+    return NULL;
+  }
+  STS_STATS_BEGIN(window);
+  STS_RECORD_UNTRACKED(window);
+  if (!is_finite_window(window)) {
+    // Not filled yet or not supported, a regular append either fills it or
+    // leaves it unchanged
+    append_value(window, value);
+    return update_current_word(window);
+  }
+  append_finite_value(window, value);
+  return update_finite_word(window);
+}
+
+const struct sts_word* sts_append_finite_array(sts_window window,
+                                               const double* values,
+                                               size_t n_values)
+{
+  if (window == NULL
+      || window->values == NULL
+      || window->values->buffer == NULL
+      || window->current_word.c < STS_MIN_CARDINALITY
+      || window->current_word.c > STS_MAX_CARDINALITY
+      || !values) {
+    return NULL;
+  }
+  STS_STATS_BEGIN(window);
+  STS_RECORD_UNTRACKED(window);
+  size_t start =
+    n_values > window->current_word.n_values
+    ? n_values - window->current_word.n_values : 0;
+  size_t i = start;
+  for (; i < n_values && !is_finite_window(window); ++i) {
+    assert(isfinite(values[i]));
+    append_value(window, values[i]);
+  }
+  if (!is_finite_window(window)) return update_current_word(window);
+  for (; i < n_values; ++i) {
+    assert(isfinite(values[i]));
+    append_finite_value(window, values[i]);
+  }
+  return update_finite_word(window);
+}
+
+/*
+ * Checks that window can be appended to, as sts_append_value does
+ */
+static bool is_valid_window(const struct sts_window* window)
+{
+  return window != NULL
+         && window->values != NULL
+         && window->values->buffer != NULL
+         && window->current_word.c >= STS_MIN_CARDINALITY
+         && window->current_word.c <= STS_MAX_CARDINALITY;
+}
+
+bool sts_append_strided(sts_window* windows,
+                        size_t n_channels,
+                        const double* base,
+                        size_t n_rows,
+                        size_t stride)
+{
+  if (!windows || !base || n_channels == 0 || stride < n_channels) {
+    return false;
+  }
+  size_t first_row = n_rows;
+  for (size_t j = 0; j < n_channels; ++j) {
+    if (!is_valid_window(windows[j])) return false;
+    size_t n = windows[j]->current_word.n_values;
+    size_t start = n_rows > n ? n_rows - n : 0;
+    if (start < first_row) first_row = start;
+  }
+  for (size_t j = 0; j < n_channels; ++j) {
+    STS_STATS_BEGIN(windows[j]);
+    STS_RECORD_UNTRACKED(windows[j]);
+  }
+  // Row by row, values of a row are adjacent in memory
+  for (size_t i = first_row; i < n_rows; ++i) {
+    const double* row = base + i * stride;
+    for (size_t j = 0; j < n_channels; ++j) {
+      if (i + windows[j]->current_word.n_values >= n_rows) {
+        append_value(windows[j], row[j]);
+      }
+    }
+  }
+  for (size_t j = 0; j < n_channels; ++j) {
+    update_current_word(windows[j]);
+  }
+  return true;
+}
+
+/*
+ * Sums for encoding consecutive windows of a series in O(w) each: prefix
+ * sums of finite values and prefix counts of NaNs and infinities. Prefixes
+ * are kept for indices base..count and values for the last n. After every n
+ * values the prefixes are rebuilt from the last n values shifted by their
+ * mean, so that they stay small and their differences precise.
+ */
+typedef struct {
+  double sum, sum2; // of finite values minus shift
+  size_t nan, pos_inf, neg_inf;
+} prefix_sum;
+
+typedef struct {
+  size_t n;
+  double* values; // value i at i % n
+  prefix_sum* prefixes; // prefix of the first i values at i % (2 * n + 1)
+  size_t base, count;
+  double shift;
+  bool shifted;
+} sliding_sums;
+
+static bool ss_init(sliding_sums* ss, size_t n)
+{
+  // n doubles keep the prefixes that follow them aligned
+  ss->values = malloc(n * sizeof*ss->values
+                      + (2 * n + 1) * sizeof*ss->prefixes);
+  if (!ss->values) return false;
+  ss->prefixes = (prefix_sum*)(ss->values + n);
+  memset(ss->prefixes, 0, sizeof*ss->prefixes);
+  ss->n = n;
+  ss->base = ss->count = 0;
+  ss->shift = 0;
+  ss->shifted = false;
+  return true;
+}
+
+static prefix_sum* ss_at(const sliding_sums* ss, size_t i)
+{
+  return ss->prefixes + i % (2 * ss->n + 1);
+}
+
+/*
+ * Prefix i + 1 from prefix i and value i
+ */
+static void ss_accumulate(sliding_sums* ss, size_t i, double value)
+{
+  prefix_sum p = *ss_at(ss, i);
+  if (isnan(value)) {
+    ++p.nan;
+  } else if (isinf(value)) {
+    if (value > 0) {
+      ++p.pos_inf;
+    } else {
+      ++p.neg_inf;
+    }
+  } else {
+    double d = value - ss->shift;
+    p.sum += d;
+    p.sum2 += d * d;
+  }
+  *ss_at(ss, i + 1) = p;
+}
+
+static size_t ss_finite(const prefix_sum* a, const prefix_sum* b, size_t n)
+{
+  return n - (b->nan - a->nan) - (b->pos_inf - a->pos_inf)
+         - (b->neg_inf - a->neg_inf);
+}
+
+static void ss_rebase(sliding_sums* ss)
+{
+  size_t first = ss->count - ss->n;
+  const prefix_sum* a = ss_at(ss, first);
+  const prefix_sum* b = ss_at(ss, ss->count);
+  size_t finite = ss_finite(a, b, ss->n);
+  if (finite > 0) ss->shift += (b->sum - a->sum) / finite;
+  ss->base = first;
+  memset(ss_at(ss, first), 0, sizeof(prefix_sum));
+  for (size_t i = first; i < ss->count; ++i) {
+    ss_accumulate(ss, i, ss->values[i % ss->n]);
+  }
+}
+
+static void ss_push(sliding_sums* ss, double value)
+{
+  // Sums are zero until the first finite value, whatever the shift
+  if (!ss->shifted && isfinite(value)) {
+    ss->shift = value;
+    ss->shifted = true;
+  }
+  ss->values[ss->count % ss->n] = value;
+  ss_accumulate(ss, ss->count, value);
+  if (++ss->count - ss->base == 2 * ss->n) ss_rebase(ss);
+}
+
+/*
+ * Word of the last n values, the same arithmetic as normalize_frame_sum with
+ * sums and mu shifted
+ */
+static void ss_encode(const sliding_sums* ss,
+                      size_t w,
+                      unsigned int c,
+                      const float* breaks,
+                      sts_symbol* out)
+{
+  size_t frame_size = ss->n / w;
+  size_t first = ss->count - ss->n;
+  const prefix_sum* a = ss_at(ss, first);
+  const prefix_sum* b = ss_at(ss, ss->count);
+  size_t finite = ss_finite(a, b, ss->n);
+  double mu = 0, std = 0;
+  if (finite > 0) {
+    mu = (b->sum - a->sum) / finite;
+    double var = (b->sum2 - a->sum2) / finite - mu * mu;
+    std = var > 0 ? sqrt(var) : 0;
+  }
+  for (size_t i = 0; i < w; ++i) {
+    a = ss_at(ss, first + i * frame_size);
+    b = ss_at(ss, first + (i + 1) * frame_size);
+    size_t size = frame_size - (b->nan - a->nan);
+    bool pos_inf = b->pos_inf != a->pos_inf;
+    bool neg_inf = b->neg_inf != a->neg_inf;
+    double average;
+    if (size == 0 || (pos_inf && neg_inf)) {
+      average = NAN;
+    } else if (pos_inf || neg_inf) {
+      average = pos_inf ? INFINITY : -INFINITY;
+    } else {
+      average = std < STS_STAT_EPS
+                ? 0 : (b->sum - a->sum - size * mu) / (size * std);
+    }
+    out[i] = get_symbol(average, breaks, c);
+  }
+}
+
+bool sts_append_collect(sts_window window,
+                        const double* values,
+                        size_t n_values,
+                        sts_symbol* out)
+{
+  if (!is_valid_window(window) || !values || !out) return false;
+  size_t w = window->current_word.w;
+  if (window->normalization != STS_NORM_ZSCORE
+      || window->current_word.encoding != STS_ENC_SAX
+      || window->breakpoints) {
+    for (size_t i = 0; i < n_values; ++i) {
+      const struct sts_word* word = sts_append_value(window, values[i]);
+      if (!word) return false;
+      memcpy(out + i * w, word->symbols, w * sizeof*out);
+    }
+    return true;
+  }
+  sliding_sums ss;
+  if (!ss_init(&ss, window->current_word.n_values)) return false;
+  const struct sts_ring_buffer* rb = window->values;
+  const double* val = rb->head;
+  for (size_t i = 0; i < ss.n; ++i) {
+    ss_push(&ss, *val);
+    if (++val == rb->buffer_end) val = rb->buffer;
+  }
+  const float* breaks = get_breaks(window->current_word.c);
+  for (size_t i = 0; i < n_values; ++i) {
+    ss_push(&ss, values[i]);
+    ss_encode(&ss, w, window->current_word.c, breaks, out + i * w);
+  }
+  free(ss.values);
+  return sts_append_array(window, values, n_values) != NULL;
+}
+
+sts_mwindow sts_new_mwindow(size_t n, size_t w, unsigned int c, size_t d)
+{
+  if (d == 0 || w == 0 || n % w != 0
+      || c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY) {
     return NULL;
   }
-  size_t start =
-    n_values > window->current_word.n_values
-    ? n_values - window->current_word.n_values : 0;
-  for (size_t i = start; i < n_values; ++i) {
-    append_value(window, values[i]);
+  sts_mwindow mw = calloc(1, sizeof*mw);
+  if (!mw) return NULL;
+  mw->n = n;
+  mw->d = d;
+  mw->w = w;
+  mw->buffer = malloc(n * d * sizeof*mw->buffer);
+  mw->mu = malloc(d * sizeof*mw->mu);
+  mw->s2 = malloc(d * sizeof*mw->s2);
+  mw->finite_cnt = malloc(d * sizeof*mw->finite_cnt);
+  mw->frame_sums = malloc(d * sizeof*mw->frame_sums);
+  mw->frame_sizes = malloc(d * sizeof*mw->frame_sizes);
+  mw->current_word.symbols = malloc(w * d * sizeof*mw->current_word.symbols);
+  if (!mw->buffer || !mw->mu || !mw->s2 || !mw->finite_cnt
+      || !mw->frame_sums || !mw->frame_sizes || !mw->current_word.symbols) {
+    sts_free_mwindow(mw);
+    return NULL;
+  }
+  mw->current_word.n_values = n * d;
+  mw->current_word.w = w * d;
+  mw->current_word.c = c;
+  mw->current_word.encoding = STS_ENC_SAX;
+  mw->current_word.c_slope = 1;
+  mw->current_word.breaks = NULL;
+  sts_reset_mwindow(mw);
+  return mw;
+}
+
+/*
+ * Quantizes frames of all channels, values of a time slot are summed into d
+ * adjacent frame sums
+ */
+static void update_mwindow_word(sts_mwindow mw)
+{
+  size_t d = mw->d;
+  size_t frame_size = mw->n / mw->w;
+  unsigned int c = mw->current_word.c;
+  const float* breaks = get_breaks(c);
+  size_t slot = mw->head;
+  for (size_t i = 0; i < mw->w; ++i) {
+    for (size_t k = 0; k < d; ++k) {
+      mw->frame_sums[k] = 0;
+      mw->frame_sizes[k] = frame_size;
+    }
+    for (size_t t = 0; t < frame_size; ++t) {
+      const double* values = mw->buffer + slot * d;
+      for (size_t k = 0; k < d; ++k) {
+        if (isnan(values[k])) {
+          --mw->frame_sizes[k];
+        } else {
+          mw->frame_sums[k] += values[k];
+        }
+      }
+      if (++slot == mw->n) slot = 0;
+    }
+    for (size_t k = 0; k < d; ++k) {
+      double std = mw->finite_cnt[k] == 0
+                   ? 0 : sqrt(mw->s2[k] / mw->finite_cnt[k]);
+      double average = normalize_frame_sum(mw->frame_sums[k],
+                                           mw->frame_sizes[k], mw->mu[k], std);
+      mw->current_word.symbols[k * mw->w + i] = get_symbol(average, breaks, c);
+    }
   }
-  return update_current_word(window);
+}
+
+const struct sts_word* sts_mwindow_append(sts_mwindow mw,
+                                          const double* values)
+{
+  if (!mw || !values) return NULL;
+  // The oldest slot becomes the newest one
+  double* slot = mw->buffer + mw->head * mw->d;
+  if (++mw->head == mw->n) mw->head = 0;
+  for (size_t k = 0; k < mw->d; ++k) {
+    double head = slot[k];
+    size_t prev_finite = mw->finite_cnt[k];
+    if (isfinite(head)) --mw->finite_cnt[k];
+    if (isfinite(values[k])) ++mw->finite_cnt[k];
+    slot[k] = values[k];
+    update_mu_and_s2(mw->mu + k, mw->s2 + k, prev_finite, mw->finite_cnt[k],
+                     values[k], head);
+  }
+  update_mwindow_word(mw);
+  return &mw->current_word;
+}
+
+bool sts_mwindow_channel(const struct sts_mwindow* mw,
+                         size_t k,
+                         struct sts_word* view)
+{
+  if (!mw || !view || k >= mw->d) return false;
+  *view = mw->current_word;
+  view->symbols = mw->current_word.symbols + k * mw->w;
+  view->n_values = mw->n;
+  view->w = mw->w;
+  return true;
+}
+
+bool sts_reset_mwindow(sts_mwindow mw)
+{
+  if (!mw || !mw->buffer) return false;
+  for (size_t i = 0; i < mw->n * mw->d; ++i) {
+    mw->buffer[i] = NAN;
+  }
+  for (size_t k = 0; k < mw->d; ++k) {
+    mw->mu[k] = 0;
+    mw->s2[k] = 0;
+    mw->finite_cnt[k] = 0;
+  }
+  for (size_t i = 0; i < mw->current_word.w; ++i) {
+    mw->current_word.symbols[i] = mw->current_word.c;
+  }
+  mw->head = 0;
+  return true;
+}
+
+void sts_free_mwindow(sts_mwindow mw)
+{
+  if (!mw) return;
+  free(mw->buffer);
+  free(mw->mu);
+  free(mw->s2);
+  free(mw->finite_cnt);
+  free(mw->frame_sums);
+  free(mw->frame_sizes);
+  free(mw->current_word.symbols);
+  free(mw);
 }
 
 sts_word sts_from_double_array(const double* series,
@@ -527,40 +3063,498 @@ sts_word sts_from_double_array(const double* series,
   estimate_mu_and_std(series, n_values, &mu, &sigma);
   sts_symbol* symbols = malloc(w * sizeof*symbols);
   if (!symbols) return NULL;
-  apply_sax_transform(n_values, w, c, mu, sigma, symbols, series, NULL, NULL);
+  apply_sax_transform(n_values, w, c, get_breaks(c), mu, sigma, symbols, series,
+                      NULL, NULL);
+  return new_word(n_values, w, c, symbols);
+}
+
+bool sts_from_double_array_into(const double* series,
+                                size_t n_values,
+                                size_t w,
+                                unsigned int c,
+                                struct sts_word* out)
+{
+  if (!out || !out->symbols || w == 0 || n_values % w != 0
+      || c > STS_MAX_CARDINALITY
+      || c < STS_MIN_CARDINALITY
+      || series == NULL) {
+    return false;
+  }
+  double mu, sigma;
+  estimate_mu_and_std(series, n_values, &mu, &sigma);
+  apply_sax_transform(n_values, w, c, get_breaks(c), mu, sigma, out->symbols,
+                      series, NULL, NULL);
+  out->n_values = n_values;
+  out->w = w;
+  out->c = c;
+  out->encoding = STS_ENC_SAX;
+  out->c_slope = 1;
+  out->breaks = NULL;
+  return true;
+}
+
+size_t sts_sliding_words(const double* series,
+                         size_t n_values,
+                         size_t n,
+                         size_t w,
+                         unsigned int c,
+                         size_t stride,
+                         sts_symbol* out)
+{
+  if (!series || !out || w == 0 || n == 0 || n % w != 0 || stride == 0
+      || c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY
+      || n_values < n) {
+    return 0;
+  }
+  sliding_sums ss;
+  if (!ss_init(&ss, n)) return 0;
+  const float* breaks = get_breaks(c);
+  size_t words = 0;
+  for (size_t i = 0; i < n_values; ++i) {
+    ss_push(&ss, series[i]);
+    if (i + 1 >= n && (i + 1 - n) % stride == 0) {
+      ss_encode(&ss, w, c, breaks, out + words++ * w);
+    }
+  }
+  free(ss.values);
+  return words;
+}
+
+/*
+ * Entry points for series of other types. Values are widened one at a time
+ * inside the loops instead of converting the series into a temporary array
+ * of doubles, the arithmetic is the one of sts_from_double_array and
+ * sts_append_array
+ */
+#define STS_DEFINE_TYPED_INPUT(name, type)                                     \
+static void estimate_mu_and_std_##name(const type* series,                     \
+                                       size_t n_values,                        \
+                                       double* mu,                             \
+                                       double* std)                            \
+{                                                                              \
+  double mean = 0;                                                             \
+  double s2 = 0;                                                               \
+  size_t n = 0;                                                                \
+  for (size_t i = 0; i < n_values; ++i) {                                      \
+    double value = (double)series[i];                                          \
+    if (isfinite(value)) {                                                     \
+      ++n;                                                                     \
+      s2 += ((value - mean) * (value - mean) * (n - 1)) / n;                   \
+      mean += (value - mean) / n;                                              \
+    }                                                                          \
+  }                                                                            \
+  *mu = n == 0 ? 0 : mean;                                                     \
+  *std = n == 0 ? 0 : sqrt(s2 / n);                                            \
+}                                                                              \
+                                                                               \
+sts_word sts_from_##name##_array(const type* series,                           \
+                                 size_t n_values,                              \
+                                 size_t w,                                     \
+                                 unsigned int c)                               \
+{                                                                              \
+  if (w == 0                                                                   \
+      || n_values % w != 0                                                     \
+      || c > STS_MAX_CARDINALITY                                               \
+      || c < STS_MIN_CARDINALITY                                               \
+      || series == NULL) {                                                     \
+    return NULL;                                                               \
+  }                                                                            \
+  double mu, sigma;                                                            \
+  estimate_mu_and_std_##name(series, n_values, &mu, &sigma);                   \
+  sts_symbol* symbols = malloc(w * sizeof*symbols);                            \
+  if (!symbols) return NULL;                                                   \
+  const float* breaks = get_breaks(c);                                         \
+  size_t frame_size = n_values / w;                                            \
+  for (size_t i = 0; i < w; ++i) {                                             \
+    const type* frame = series + i * frame_size;                               \
+    double sum = 0;                                                            \
+    size_t current_frame_size = frame_size;                                    \
+    for (size_t j = 0; j < frame_size; ++j) {                                  \
+      double value = (double)frame[j];                                         \
+      if (isnan(value)) {                                                      \
+        --current_frame_size;                                                  \
+      } else {                                                                 \
+        sum += value;                                                          \
+      }                                                                        \
+    }                                                                          \
+    symbols[i] = get_symbol(normalize_frame_sum(sum, current_frame_size, mu,   \
+                                                sigma),                        \
+                            breaks, c);                                        \
+  }                                                                            \
+  return new_word(n_values, w, c, symbols);                                    \
+}                                                                              \
+                                                                               \
+const struct sts_word* sts_append_##name##_array(sts_window window,            \
+                                                 const type* values,           \
+                                                 size_t n_values)              \
+{                                                                              \
+  if (window == NULL                                                           \
+      || window->values == NULL                                                \
+      || window->values->buffer == NULL                                        \
+      || window->current_word.c < STS_MIN_CARDINALITY                          \
+      || window->current_word.c > STS_MAX_CARDINALITY                          \
+      || !values) {                                                            \
+    return NULL;                                                               \
+  }                                                                            \
+  STS_STATS_BEGIN(window);                                                     \
+  STS_RECORD_UNTRACKED(window);                                                \
+  size_t start =                                                               \
+    n_values > window->current_word.n_values                                   \
+    ? n_values - window->current_word.n_values : 0;                            \
+  for (size_t i = start; i < n_values; ++i) {                                  \
+    append_value(window, (double)values[i]);                                   \
+  }                                                                            \
+  return update_current_word(window);                                          \
+}
+
+STS_DEFINE_TYPED_INPUT(float, float)
+STS_DEFINE_TYPED_INPUT(int32, int32_t)
+STS_DEFINE_TYPED_INPUT(int64, int64_t)
+
+#undef STS_DEFINE_TYPED_INPUT
+
+sts_word sts_from_double_array_robust(const double* series,
+                                      size_t n_values,
+                                      size_t w,
+                                      unsigned int c)
+{
+  if (n_values % w != 0
+      || c > STS_MAX_CARDINALITY
+      || c < STS_MIN_CARDINALITY
+      || series == NULL) {
+    return NULL;
+  }
+  double median, std;
+  if (!estimate_median_and_mad(series, n_values, &median, &std)) return NULL;
+  sts_symbol* symbols = malloc(w * sizeof*symbols);
+  if (!symbols) return NULL;
+  apply_sax_transform(n_values, w, c, get_breaks(c), median, std, symbols,
+                      series, NULL, NULL);
+  return new_word(n_values, w, c, symbols);
+}
+
+sts_word sts_from_double_array_fixed(const double* series,
+                                     size_t n_values,
+                                     size_t w,
+                                     unsigned int c,
+                                     double mu,
+                                     double sigma)
+{
+  if (n_values % w != 0
+      || c > STS_MAX_CARDINALITY
+      || c < STS_MIN_CARDINALITY
+      || series == NULL
+      || !isfinite(mu)
+      || !isfinite(sigma)
+      || sigma <= 0) {
+    return NULL;
+  }
+  double thresholds[STS_MAX_CARDINALITY - 1];
+  scale_breaks(c, n_values / w, mu, sigma, thresholds);
+  sts_symbol* symbols = malloc(w * sizeof*symbols);
+  if (!symbols) return NULL;
+  apply_fixed_transform(n_values, w, c, thresholds, symbols, series, NULL,
+                        NULL);
   return new_word(n_values, w, c, symbols);
 }
 
-sts_word sts_from_sax_string(const char* symbols, unsigned char c)
+sts_word sts_from_double_array_esax(const double* series,
+                                    size_t n_values,
+                                    size_t w,
+                                    unsigned int c)
+{
+  if (w == 0
+      || n_values % w != 0
+      || c > STS_MAX_CARDINALITY
+      || c < STS_MIN_CARDINALITY
+      || series == NULL) {
+    return NULL;
+  }
+  double mu, sigma;
+  estimate_mu_and_std(series, n_values, &mu, &sigma);
+  sts_symbol* symbols = malloc(3 * w * sizeof*symbols);
+  if (!symbols) return NULL;
+  apply_esax_transform(n_values, w, c, mu, sigma, symbols, NULL, series, NULL,
+                       NULL);
+  sts_word word = new_word(n_values, 3 * w, c, symbols);
+  word->encoding = STS_ENC_ESAX;
+  return word;
+}
+
+sts_word sts_from_double_array_1dsax(const double* series,
+                                     size_t n_values,
+                                     size_t w,
+                                     unsigned int c,
+                                     unsigned int c_slope)
+{
+  if (w == 0
+      || n_values % w != 0
+      || c > STS_MAX_CARDINALITY
+      || c < STS_MIN_CARDINALITY
+      || c_slope > STS_MAX_CARDINALITY
+      || c_slope < STS_MIN_CARDINALITY
+      || c * c_slope > STS_MAX_SYMBOL
+      || series == NULL) {
+    return NULL;
+  }
+  double mu, sigma;
+  estimate_mu_and_std(series, n_values, &mu, &sigma);
+  double slope_breaks[STS_MAX_CARDINALITY - 1];
+  size_t frame_size = n_values / w;
+  scale_slope_breaks(c_slope, frame_size, slope_breaks);
+  sts_symbol* symbols = malloc(w * sizeof*symbols);
+  if (!symbols) return NULL;
+  const float* breaks = get_breaks(c);
+  const double* val = series;
+  for (size_t i = 0; i < w; ++i) {
+    struct sts_regression_sums sums;
+    frame_regression(frame_size, &sums, &val, NULL, NULL);
+    symbols[i] = encode_1dsax_frame(&sums, breaks, c, slope_breaks, c_slope,
+                                    mu, sigma);
+  }
+  sts_word word = new_word(n_values, w, c, symbols);
+  word->encoding = STS_ENC_1DSAX;
+  word->c_slope = c_slope;
+  return word;
+}
+
+sts_word sts_from_double_array_sfa(const double* series,
+                                   size_t n_values,
+                                   const struct sts_sfa* sfa)
+{
+  if (!sfa || !series || n_values != sfa->n) return NULL;
+  struct sts_sliding_dft* sd = sdft_new(n_values, (sfa->w + 1) / 2);
+  sts_symbol* symbols = malloc(sfa->w * sizeof*symbols);
+  if (!sd || !symbols) {
+    sdft_free(sd);
+    free(symbols);
+    return NULL;
+  }
+  bool all_finite = true;
+  for (size_t i = 0; i < n_values; ++i) {
+    all_finite = all_finite && isfinite(series[i]);
+  }
+  double mu, sigma;
+  estimate_mu_and_std(series, n_values, &mu, &sigma);
+  sdft_refresh(sd, series, NULL, NULL);
+  apply_sfa_transform(sfa, sd, sigma, all_finite, symbols);
+  sdft_free(sd);
+  sts_word word = new_word(n_values, sfa->w, sfa->c, symbols);
+  word->encoding = STS_ENC_SFA;
+  word->breaks = sfa->breaks;
+  return word;
+}
+
+bool sts_from_double_array_multi(const double* series,
+                                 size_t n_values,
+                                 size_t w,
+                                 const unsigned int* c,
+                                 size_t n_c,
+                                 sts_word* out)
+{
+  if (series == NULL || c == NULL || out == NULL || n_c == 0 || w == 0
+      || n_values % w != 0) {
+    return false;
+  }
+  unsigned int max_c = 0;
+  for (size_t i = 0; i < n_c; ++i) {
+    if (c[i] > STS_MAX_CARDINALITY || c[i] < STS_MIN_CARDINALITY) return false;
+    if (c[i] > max_c) max_c = c[i];
+  }
+  double* paa = malloc(w * sizeof*paa);
+  sts_symbol* max_symbols = malloc(w * sizeof*max_symbols);
+  if (!paa || !max_symbols) {
+    free(paa);
+    free(max_symbols);
+    return false;
+  }
+  double mu, sigma;
+  estimate_mu_and_std(series, n_values, &mu, &sigma);
+  const float* breaks = get_breaks(max_c);
+  const double* val = series;
+  for (size_t i = 0; i < w; ++i) {
+    paa[i] = normalized_frame_average(n_values / w, mu, sigma, &val, NULL,
+                                      NULL);
+    max_symbols[i] = get_symbol(paa[i], breaks, max_c);
+  }
+
+  size_t done = 0;
+  for (; done < n_c; ++done) {
+    sts_symbol* symbols = malloc(w * sizeof*symbols);
+    if (!symbols) break;
+    if (max_c % c[done] == 0) {
+      derive_symbols(max_symbols, w, max_c, c[done], symbols);
+    } else {
+      // Breakpoints don't nest, quantize the stored PAA instead
+      breaks = get_breaks(c[done]);
+      for (size_t i = 0; i < w; ++i) {
+        symbols[i] = get_symbol(paa[i], breaks, c[done]);
+      }
+    }
+    out[done] = new_word(n_values, w, c[done], symbols);
+  }
+  free(paa);
+  free(max_symbols);
+  if (done != n_c) {
+    for (size_t i = 0; i < done; ++i) {
+      sts_free_word(out[i]);
+      out[i] = NULL;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool sts_from_strided_array(const double* base,
+                            size_t n_values,
+                            size_t stride,
+                            size_t n_channels,
+                            size_t w,
+                            unsigned int c,
+                            sts_word* out)
+{
+  if (base == NULL || out == NULL || n_channels == 0 || stride < n_channels
+      || w == 0 || n_values % w != 0
+      || c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY) {
+    return false;
+  }
+  // Per channel Welford statistics, raw frame sums and their sizes
+  double* stats = calloc(2 * n_channels + w * n_channels, sizeof*stats);
+  size_t* finite = calloc(n_channels + w * n_channels, sizeof*finite);
+  if (!stats || !finite) {
+    free(stats);
+    free(finite);
+    return false;
+  }
+  double* mean = stats;
+  double* s2 = stats + n_channels;
+  double* sums = stats + 2 * n_channels;
+  size_t* sizes = finite + n_channels;
+  size_t frame_size = n_values / w;
+  for (size_t i = 0; i < n_values; ++i) {
+    const double* row = base + i * stride;
+    double* frame_sums = sums + (i / frame_size) * n_channels;
+    size_t* frame_sizes = sizes + (i / frame_size) * n_channels;
+    for (size_t j = 0; j < n_channels; ++j) {
+      double value = row[j];
+      if (isfinite(value)) {
+        size_t n = ++finite[j];
+        s2[j] += ((value - mean[j]) * (value - mean[j]) * (n - 1)) / n;
+        mean[j] += (value - mean[j]) / n;
+      }
+      if (!isnan(value)) {
+        frame_sums[j] += value;
+        ++frame_sizes[j];
+      }
+    }
+  }
+  const float* breaks = get_breaks(c);
+  size_t done = 0;
+  for (; done < n_channels; ++done) {
+    sts_symbol* symbols = malloc(w * sizeof*symbols);
+    if (!symbols) break;
+    double std = finite[done] == 0 ? 0 : sqrt(s2[done] / finite[done]);
+    double mu = finite[done] == 0 ? 0 : mean[done];
+    for (size_t i = 0; i < w; ++i) {
+      symbols[i] =
+        get_symbol(normalize_frame_sum(sums[i * n_channels + done],
+                                       sizes[i * n_channels + done], mu, std),
+                   breaks, c);
+    }
+    out[done] = new_word(n_values, w, c, symbols);
+  }
+  free(stats);
+  free(finite);
+  if (done != n_channels) {
+    for (size_t i = 0; i < done; ++i) {
+      sts_free_word(out[i]);
+      out[i] = NULL;
+    }
+    return false;
+  }
+  return true;
+}
+
+sts_word sts_word_to_cardinality(const struct sts_word* a, unsigned int c)
 {
-  if (!symbols || c < STS_MIN_CARDINALITY || c > STS_MAX_CARDINALITY) {
+  if (a == NULL
+      || a->symbols == NULL
+      || a->c < STS_MIN_CARDINALITY
+      || a->c > STS_MAX_CARDINALITY
+      || c < STS_MIN_CARDINALITY
+      || a->c % c != 0
+      || a->encoding == STS_ENC_1DSAX
+      || a->encoding == STS_ENC_SFA) {
     return NULL;
   }
+  for (size_t i = 0; i < a->w; ++i) {
+    if (a->symbols[i] > a->c) return NULL;
+  }
+  sts_symbol* symbols = malloc(a->w * sizeof*symbols);
+  if (!symbols) return NULL;
+  derive_symbols(a->symbols, a->w, a->c, c, symbols);
+  sts_word word = new_word(a->n_values, a->w, c, symbols);
+  word->encoding = a->encoding;
+  return word;
+}
+
+bool sts_from_sax_string_into(const char* symbols,
+                              unsigned int c,
+                              struct sts_word* out)
+{
+  if (!symbols || !out || !out->symbols || c < STS_MIN_CARDINALITY
+      || c > STS_MAX_SAX_CARDINALITY) {
+    return false;
+  }
   size_t w = strlen(symbols);
   if (w == 0) {
-    return NULL;
+    return false;
   }
-  sts_symbol* sts_symbols = malloc(w * sizeof*sts_symbols);
-  if (!sts_symbols) return NULL;
   for (size_t i = 0; i < w; ++i) {
     if (symbols[i] == '#') {
-      sts_symbols[i] = c;
+      out->symbols[i] = c;
     } else {
-      if (symbols[i] < 'A' || symbols[i] >= (char)('A' + c)) return NULL;
-      sts_symbols[i] = c - (symbols[i] - 'A') - 1;
+      if (symbols[i] < 'A' || symbols[i] >= (char)('A' + c)) {
+        return false;
+      }
+      out->symbols[i] = c - (symbols[i] - 'A') - 1;
     }
   }
-  return new_word(0, w, c, sts_symbols);
+  out->n_values = 0;
+  out->w = w;
+  out->c = c;
+  out->encoding = STS_ENC_SAX;
+  out->c_slope = 1;
+  out->breaks = NULL;
+  return true;
+}
+
+sts_word sts_from_sax_string(const char* symbols, unsigned int c)
+{
+  if (!symbols) return NULL;
+  size_t w = strlen(symbols);
+  if (w == 0) return NULL;
+  struct sts_word word;
+  word.symbols = malloc(w * sizeof*word.symbols);
+  if (!word.symbols) return NULL;
+  if (!sts_from_sax_string_into(symbols, c, &word)) {
+    free(word.symbols);
+    return NULL;
+  }
+  return new_word(0, w, c, word.symbols);
 }
 
 char* sts_word_to_sax_string(const struct sts_word* a)
 {
-  if (!a || !a->symbols) return NULL;
+  if (!a || !a->symbols || a->c > STS_MAX_SAX_CARDINALITY
+      || a->encoding == STS_ENC_1DSAX || a->encoding == STS_ENC_SFA) {
+    return NULL;
+  }
   char* str = malloc((a->w + 1) * sizeof*str);
   if (!str) return NULL;
   str[a->w] = '\0';
   for (size_t i = 0; i < a->w; ++i) {
-    unsigned char dig = a->symbols[i];
+    sts_symbol dig = a->symbols[i];
     if (dig > a->c) {
       free(str);
       return NULL;
@@ -582,13 +3576,30 @@ double sts_mindist(const struct sts_word* a, const struct sts_word* b)
 }
 
 
-double sts_mindist_ab(const struct sts_word* a,
-                      const struct sts_word* b,
-                      double* above,
-                      double* below)
+/*
+ * Symbol of the i-th frame average, 1d-SAX symbols are unpacked
+ */
+static sts_symbol mean_symbol(const struct sts_word* a, size_t i)
+{
+  sts_symbol s = a->symbols[i];
+  if (a->c_slope == 1) return s;
+  return s == a->c * a->c_slope ? (sts_symbol)a->c
+                                : (sts_symbol)(s / a->c_slope);
+}
+
+/*
+ * Mindist of a and b quantized with bp or the Gaussian breakpoints if NULL
+ */
+static double words_mindist(const struct sts_word* a,
+                            const struct sts_word* b,
+                            struct sts_breakpoints* bp,
+                            double* above,
+                            double* below)
 {
   // TODO: mindist estimation for words of different n, w and c
-  if (!a || !b || a->c != b->c || a->w != b->w) {
+  if (!a || !b || a->c != b->c || a->w != b->w
+      || a->encoding != b->encoding || a->c_slope != b->c_slope
+      || a->c_slope == 0 || a->breaks != b->breaks) {
     return NAN;
   }
   if (a->n_values != b->n_values && (a->n_values != 0 && b->n_values != 0)) {
@@ -608,18 +3619,29 @@ double sts_mindist_ab(const struct sts_word* a,
     return NAN;
   }
 
+  if (bp && bp->c != c) {
+    return NAN;
+  }
+  const float* breaks = bp ? bp->published : get_breaks(c);
+  const float* dist = bp ? get_adaptive_dist(bp) : get_dist(c);
+  if (a->breaks) {
+    // SFA rows differ per position and are in the units of the distance
+    dist = NULL;
+    n = w;
+  }
   *above = *below = 0;
   sts_symbol sa, sb;
   for (size_t i = 0; i < w; ++i) {
-    sa = a->symbols[i];
-    sb = b->symbols[i];
+    if (a->breaks) breaks = a->breaks + i * (c - 1);
+    sa = mean_symbol(a, i);
+    sb = mean_symbol(b, i);
     if (sa != sb) {
       if (sa == a->c) {  // if NaN use the maximum mindist
         sa = sb > b->c - 1 - sb ? 0 : b->c - 1;
       } else if (sb == b->c) {
         sb = sa > a->c - 1 - sa ? 0 : a->c - 1;
       }
-      double sym_distance = dist_table[c - STS_MIN_CARDINALITY][sa * c + sb];
+      double sym_distance = symbol_distance(dist, breaks, c, sa, sb);
       sym_distance *= sym_distance;
       if (sa < sb) { // internally we use the reversed iSAX ordering
         *above += sym_distance;
@@ -635,10 +3657,227 @@ double sts_mindist_ab(const struct sts_word* a,
   return distance;
 }
 
+double sts_mindist_ab(const struct sts_word* a,
+                      const struct sts_word* b,
+                      double* above,
+                      double* below)
+{
+  return words_mindist(a, b, NULL, above, below);
+}
+
+double sts_adaptive_mindist(sts_breakpoints bp,
+                            const struct sts_word* a,
+                            const struct sts_word* b)
+{
+  double above, below;
+  if (!bp) return NAN;
+  return words_mindist(a, b, bp, &above, &below);
+}
+
+struct sts_library {
+  size_t n, w;
+  unsigned int c;
+  sts_symbol* symbols; // word i at symbols + i * w
+  size_t count, capacity;
+};
+
+sts_library sts_new_library(size_t n, size_t w, unsigned int c)
+{
+  if (w == 0 || n == 0 || n % w != 0
+      || c > STS_MAX_CARDINALITY || c < STS_MIN_CARDINALITY) {
+    return NULL;
+  }
+  sts_library lib = calloc(1, sizeof*lib);
+  if (!lib) return NULL;
+  lib->n = n;
+  lib->w = w;
+  lib->c = c;
+  return lib;
+}
+
+bool sts_library_add(sts_library lib, const struct sts_word* word)
+{
+  if (!lib || !word || !word->symbols || word->w != lib->w
+      || word->c != lib->c || word->encoding != STS_ENC_SAX
+      || word->c_slope != 1 || word->breaks
+      || (word->n_values != 0 && word->n_values != lib->n)) {
+    return false;
+  }
+  if (lib->count == lib->capacity) {
+    size_t capacity = lib->capacity ? 2 * lib->capacity : 64;
+    sts_symbol* symbols = realloc(lib->symbols,
+                                  capacity * lib->w * sizeof*symbols);
+    if (!symbols) return false;
+    lib->symbols = symbols;
+    lib->capacity = capacity;
+  }
+  memcpy(lib->symbols + lib->count++ * lib->w, word->symbols,
+         lib->w * sizeof*lib->symbols);
+  return true;
+}
+
+bool sts_library_clear(sts_library lib)
+{
+  if (!lib) return false;
+  lib->count = 0;
+  return true;
+}
+
+size_t sts_library_size(const struct sts_library* lib)
+{
+  return lib ? lib->count : 0;
+}
+
+bool sts_library_word(const struct sts_library* lib,
+                      size_t i,
+                      struct sts_word* view)
+{
+  if (!lib || !view || i >= lib->count) return false;
+  view->symbols = lib->symbols + i * lib->w;
+  view->n_values = lib->n;
+  view->w = lib->w;
+  view->c = lib->c;
+  view->encoding = STS_ENC_SAX;
+  view->c_slope = 1;
+  view->breaks = NULL;
+  return true;
+}
+
+/*
+ * Whether found word i is farther than found word j, ties broken by index
+ */
+static bool farther(const size_t* indices,
+                    const double* sums,
+                    size_t i,
+                    size_t j)
+{
+  return sums[i] > sums[j] || (sums[i] == sums[j] && indices[i] > indices[j]);
+}
+
+/*
+ * Restores max-heap of found words after the root was replaced
+ */
+static void sift_down(size_t* indices, double* sums, size_t size)
+{
+  size_t i = 0;
+  for (;;) {
+    size_t top = i, l = 2 * i + 1, r = 2 * i + 2;
+    if (l < size && farther(indices, sums, l, top)) top = l;
+    if (r < size && farther(indices, sums, r, top)) top = r;
+    if (top == i) return;
+    size_t index = indices[i];
+    double sum = sums[i];
+    indices[i] = indices[top];
+    sums[i] = sums[top];
+    indices[top] = index;
+    sums[top] = sum;
+    i = top;
+  }
+}
+
+static void sift_up(size_t* indices, double* sums, size_t i)
+{
+  while (i > 0 && farther(indices, sums, i, (i - 1) / 2)) {
+    size_t parent = (i - 1) / 2;
+    size_t index = indices[i];
+    double sum = sums[i];
+    indices[i] = indices[parent];
+    sums[i] = sums[parent];
+    indices[parent] = index;
+    sums[parent] = sum;
+    i = parent;
+  }
+}
+
+size_t sts_library_nearest(const struct sts_library* lib,
+                           const struct sts_word* query,
+                           size_t k,
+                           double threshold,
+                           size_t* indices,
+                           double* distances)
+{
+  if (!lib || !query || !query->symbols || !indices || !distances
+      || query->w != lib->w || query->c != lib->c
+      || query->encoding != STS_ENC_SAX || query->c_slope != 1
+      || query->breaks || !(threshold >= 0)
+      || (query->n_values != 0 && query->n_values != lib->n)) {
+    return 0;
+  }
+  size_t w = lib->w;
+  unsigned int c = lib->c;
+  // Squared symbol distances from every query symbol, NaN column included,
+  // the same as words_mindist sums
+  double* table = malloc(w * (c + 1) * sizeof*table);
+  if (!table) return 0;
+  const float* breaks = get_breaks(c);
+  const float* dist = get_dist(c);
+  for (size_t i = 0; i < w; ++i) {
+    for (sts_symbol s = 0; s <= c; ++s) {
+      sts_symbol sa = query->symbols[i], sb = s;
+      double d = 0;
+      if (sa != sb) {
+        if (sa == c) {
+          sa = sb > c - 1 - sb ? 0 : c - 1;
+        } else if (sb == c) {
+          sb = sa > c - 1 - sa ? 0 : c - 1;
+        }
+        d = symbol_distance(dist, breaks, c, sa, sb);
+      }
+      table[i * (c + 1) + s] = d * d;
+    }
+  }
+  double compression = (double)lib->n / (double)w;
+  double limit = threshold * threshold / compression;
+  // distances hold the sums of the found words as a max-heap until the end
+  size_t found = 0;
+  for (size_t j = 0; j < lib->count && k > 0; ++j) {
+    const sts_symbol* symbols = lib->symbols + j * w;
+    double bound = found == k && distances[0] < limit ? distances[0] : limit;
+    double sum = 0;
+    size_t i = 0;
+    for (; i < w && sum <= bound; ++i) {
+      sum += table[i * (c + 1) + symbols[i]];
+    }
+    if (sum > bound || (found == k && sum >= distances[0])) continue;
+    if (found < k) {
+      indices[found] = j;
+      distances[found] = sum;
+      sift_up(indices, distances, found++);
+    } else {
+      indices[0] = j;
+      distances[0] = sum;
+      sift_down(indices, distances, k);
+    }
+  }
+  free(table);
+  // Heap sort, the farthest goes to the end
+  for (size_t size = found; size > 1; --size) {
+    size_t index = indices[0];
+    double sum = distances[0];
+    indices[0] = indices[size - 1];
+    distances[0] = distances[size - 1];
+    indices[size - 1] = index;
+    distances[size - 1] = sum;
+    sift_down(indices, distances, size - 1);
+  }
+  for (size_t j = 0; j < found; ++j) {
+    distances[j] = sqrt(compression * distances[j]);
+  }
+  return found;
+}
+
+void sts_free_library(sts_library lib)
+{
+  if (!lib) return;
+  free(lib->symbols);
+  free(lib);
+}
+
 bool sts_words_equal(const struct sts_word* a, const struct sts_word* b)
 {
   if (!a || !b) return false;
-  if (a->w != b->w || a->c != b->c) {
+  if (a->w != b->w || a->c != b->c || a->encoding != b->encoding
+      || a->c_slope != b->c_slope || a->breaks != b->breaks) {
     return false;
   }
   return memcmp(a->symbols, b->symbols, a->w * sizeof*a->symbols) == 0;
@@ -654,12 +3893,27 @@ bool sts_reset_window(sts_window w)
   w->values->mu = 0;
   w->values->s2 = 0;
   w->values->finite_cnt = 0;
+  if (w->order) os_clear(w->order);
+  if (w->extrema) fe_clear(w->extrema);
+  if (w->regression) {
+    memset(w->regression->sums, 0, w->regression->w
+           * sizeof*w->regression->sums);
+    w->regression->since_refresh = 0;
+  }
+  if (w->dft) {
+    // The buffer is all NaNs, which enter the transform as zeros
+    memset(w->dft->re, 0, w->dft->k * sizeof*w->dft->re);
+    memset(w->dft->im, 0, w->dft->k * sizeof*w->dft->im);
+    w->dft->since_refresh = 0;
+  }
   for (size_t i = 0; i < w->current_word.n_values; ++i) {
     w->values->buffer[i] = NAN;
   }
   for (size_t i = 0; i < w->current_word.w; ++i) {
-    w->current_word.symbols[i] = w->current_word.c;
+    w->current_word.symbols[i] =
+      (sts_symbol)(w->current_word.c * w->current_word.c_slope);
   }
+  STS_RECORD_RESET(w);
   return true;
 }
 
@@ -671,6 +3925,14 @@ void sts_free_window(sts_window w)
     free(w->values);
   }
   if (w->current_word.symbols != NULL) free(w->current_word.symbols);
+  free(w->thresholds);
+  os_free(w->order);
+  fe_free(w->extrema);
+  fr_free(w->regression);
+  sdft_free(w->dft);
+#ifdef STS_ENABLE_STATS
+  stats_free(w->stats);
+#endif
   free(w);
 }
 
@@ -691,7 +3953,11 @@ sts_word sts_dup_word(const struct sts_word* a)
   }
   sts_symbol* sts_symbols = malloc(a->w * sizeof*sts_symbols);
   memcpy(sts_symbols, a->symbols, a->w * sizeof*sts_symbols);
-  return new_word(a->n_values, a->w, a->c, sts_symbols);
+  sts_word word = new_word(a->n_values, a->w, a->c, sts_symbols);
+  word->encoding = a->encoding;
+  word->c_slope = a->c_slope;
+  word->breaks = a->breaks;
+  return word;
 }
 
 /* No namespaces in C, so it goes here */
@@ -703,8 +3969,8 @@ sts_word sts_dup_word(const struct sts_word* a)
 
 static char* test_get_symbol_zero()
 {
-  for (unsigned char c = STS_MIN_CARDINALITY; c <= STS_MAX_CARDINALITY; ++c) {
-    sts_symbol zero_encoded = get_symbol(0.0, c);
+  for (unsigned int c = STS_MIN_CARDINALITY; c <= STS_MAX_CARDINALITY; ++c) {
+    sts_symbol zero_encoded = get_symbol(0.0, get_breaks(c), c);
     mu_assert(zero_encoded == (c / 2) - 1 + (c % 2),
               "zero encoded into %u for cardinality %u", zero_encoded, c);
   }
@@ -715,16 +3981,22 @@ static char* test_get_symbol_breaks()
 {
   sts_symbol break_encoded;
   double value;
-  for (unsigned char c = STS_MIN_CARDINALITY; c <= STS_MAX_CARDINALITY; ++c) {
-    for (int i = 0; i < c - 1; ++i) { // test below the break
-      value = breaks[c - STS_MIN_CARDINALITY][i] - STS_STAT_EPS;
-      break_encoded = get_symbol(value, c);
+  for (unsigned int c = STS_MIN_CARDINALITY; c <= STS_MAX_CARDINALITY; ++c) {
+    const float* breaks = get_breaks(c);
+    for (unsigned int i = 0; i < c - 1; ++i) { // test below the break
+      // breakpoints of large cardinalities are closer than STS_STAT_EPS
+      value = nextafter(breaks[i], -INFINITY);
+      break_encoded = get_symbol(value, breaks, c);
       mu_assert(break_encoded == c - i - 1,
                 "%f encoded into %u instead of %u. c == %u", value,
                 break_encoded, c - i - 1, c);
+      break_encoded = get_symbol(breaks[i], breaks, c); // test on the break
+      mu_assert(break_encoded == c - i - 2,
+                "%f encoded into %u instead of %u. c == %u", value,
+                break_encoded, c - i - 2, c);
     }
-    value = breaks[c - STS_MIN_CARDINALITY][c - 2]; // test on the last break
-    break_encoded = get_symbol(value, c);
+    value = breaks[c - 2]; // test on the last break
+    break_encoded = get_symbol(value, breaks, c);
     mu_assert(break_encoded == 0, "%f encoded into %u instead of %u. c == %u",
               value, break_encoded, 0, c);
 
@@ -732,6 +4004,69 @@ static char* test_get_symbol_breaks()
   return NULL;
 }
 
+static char* test_generated_tables()
+{
+  // large rows are generated on first use
+  float* row = breaks_table + 507 * 508 / 2;
+  breaks_ready[509] = 0;
+  memset(row, 0, 508 * sizeof*row);
+  mu_assert(get_breaks(509) == row && breaks_ready[509]
+            && row[0] == (float)generated_break(1, 509),
+            "c == 509 row not generated on first use");
+
+  // Published iSAX values
+  const float* breaks = get_breaks(4);
+  mu_assert(breaks[0] == -0.674f && breaks[1] == 0 && breaks[2] == 0.674f,
+            "c == 4 breakpoints differ from the iSAX table");
+  breaks = get_breaks(16);
+  mu_assert(breaks[0] == -1.534f && breaks[14] == 1.534f,
+            "c == 16 breakpoints differ from the iSAX table");
+  mu_assert(symbol_distance(get_dist(16), breaks, 16, 0, 15) == 3.068f,
+            "c == 16 distances differ from the iSAX table");
+  breaks = get_breaks(7);
+  mu_assert(symbol_distance(get_dist(7), breaks, 7, 5, 0) == 1.634f,
+            "c == 7 distances differ from the iSAX table");
+
+  for (unsigned int c = STS_MIN_CARDINALITY; c <= STS_MAX_CARDINALITY; ++c) {
+    breaks = get_breaks(c);
+    for (unsigned int i = 0; i < c - 1; ++i) {
+      mu_assert(i == 0 || breaks[i - 1] < breaks[i],
+                "breakpoints of %u aren't ascending at %u", c, i);
+      mu_assert(breaks[i] == -breaks[c - 2 - i],
+                "breakpoints of %u aren't symmetric at %u", c, i);
+    }
+  }
+  // nested breakpoints are bit-identical
+  const float* b512 = get_breaks(512);
+  const float* b256 = get_breaks(256);
+  const float* b16 = get_breaks(16);
+  for (unsigned int i = 0; i < 255; ++i) {
+    mu_assert(b512[2 * i + 1] == b256[i], "256 isn't nested in 512 at %u", i);
+  }
+  for (unsigned int i = 0; i < 15; ++i) {
+    mu_assert(b512[32 * i + 31] == b16[i], "16 isn't nested in 512 at %u", i);
+  }
+  mu_assert(fabs(b512[0] + 2.885) < 1e-3, "unexpected %f", b512[0]);
+
+  // Large cardinalities: mindist of neighbouring symbols is zero, the rest is
+  // the width of the regions between them
+  sts_word a = sts_from_double_array((double[]) { -1, 1 }, 2, 2, 256);
+  sts_word b = sts_from_double_array((double[]) { 1, -1 }, 2, 2, 256);
+  mu_assert(a && b, "sts_from_double_array failed for c == 256");
+  breaks = get_breaks(256);
+  // -1 and 1 lie in the regions 40 and 215 of N(0, 1) split into 256 parts
+  mu_assert(a->symbols[0] == 255 - 40 && a->symbols[1] == 255 - 215,
+            "unexpected symbols %u %u", a->symbols[0], a->symbols[1]);
+  double expected = sqrt(2) * (breaks[214] - breaks[40]);
+  mu_assert(fabs(sts_mindist(a, b) - expected) < 1e-6, "mindist %f != %f",
+            sts_mindist(a, b), expected);
+  mu_assert(sts_word_to_sax_string(a) == NULL,
+            "c == 256 doesn't have SAX notation");
+  sts_free_word(a);
+  sts_free_word(b);
+  return NULL;
+}
+
 static char* test_to_sax_sample()
 {
   // After averaging and normalization this series looks like:
@@ -777,7 +4112,7 @@ static char* test_to_sax_stationary()
     8, 8 + STS_STAT_EPS, 8, 8 + STS_STAT_EPS,
     8 - STS_STAT_EPS, 8, 8 + STS_STAT_EPS, 8
   };
-  for (unsigned char c = STS_MIN_CARDINALITY; c <= STS_MAX_CARDINALITY; ++c) {
+  for (unsigned int c = STS_MIN_CARDINALITY; c <= STS_MAX_CARDINALITY; ++c) {
     for (size_t w = 1; w <= 60; ++w) {
       sts_word sax = sts_from_double_array(sseq, 60 - (60 % w), w, c);
       mu_assert(sax->symbols != NULL, "sax conversion failed");
@@ -801,7 +4136,8 @@ static char* test_to_sax_stationary()
     } \
     mu_assert((window)->values->finite_cnt == 16, "ring buffer failed"); \
     mu_assert((word)->symbols != NULL, "ring buffer failed"); \
-    mu_assert(memcmp((test)->symbols, (word)->symbols, w) == 0, \
+    mu_assert(memcmp((test)->symbols, (word)->symbols, \
+                     w * sizeof*(word)->symbols) == 0, \
     "ring buffer failed"); \
     mu_assert(((word) = sts_append_value((window), 0)) != NULL, \
     "ring buffer failed"); \
@@ -810,6 +4146,8 @@ static char* test_to_sax_stationary()
 static bool words_equal(const struct sts_word* a, const struct sts_word* b)
 {
   return a->n_values == b->n_values && a->w == b->w && a->c == b->c &&
+         a->encoding == b->encoding && a->c_slope == b->c_slope &&
+         a->breaks == b->breaks &&
          memcmp(a->symbols, b->symbols, a->w * sizeof*a->symbols) == 0;
 }
 
@@ -819,7 +4157,7 @@ static char* test_sliding_word()
     4, -3.5, 1.8, -0.4 };
   double nseq[17] = { 5, 4.2, -3.7, 1.0, 0.1, -2.1, 2.2, -3.3, 4, 0.8, 0.7,
     -0.2, 4, -3.5, 1.8, -0.4, 0.0 };
-  for (unsigned char c = STS_MIN_CARDINALITY; c < STS_MAX_CARDINALITY; ++c) {
+  for (unsigned int c = STS_MIN_CARDINALITY; c < STS_MAX_CARDINALITY; ++c) {
     for (size_t w = 1; w <= 16; w *= 2) {
       sts_word word = sts_from_double_array(seq, 16, w, c);
       sts_window window = sts_new_window(16, w, c);
@@ -873,7 +4211,7 @@ static char* test_online_mu_sigma_random()
   size_t n_values = 32;
   size_t prev_fin = 0, new_fin = 0;
   size_t w = 8;
-  unsigned char c = 6;
+  unsigned int c = 6;
   for (size_t i = 0; i < n_runs; ++i) {
     for (size_t j = 0; j < STS_TEST_BUF_SIZE; ++j) {
       buf[j] = (float)rand() / (float)(RAND_MAX / 10.0);
@@ -939,15 +4277,957 @@ static char* test_nan_and_infinity_in_series()
   return NULL;
 }
 
+static char* test_derived_cardinalities()
+{
+  double seq[64];
+  srand(42);
+  for (size_t i = 0; i < 64; ++i) {
+    seq[i] = (double)rand() / RAND_MAX - 0.5;
+  }
+  seq[5] = seq[6] = seq[7] = seq[8] = NAN; // all-NaN frame at w == 16
+  for (unsigned int max_c = STS_MIN_CARDINALITY; max_c <= STS_MAX_CARDINALITY;
+       max_c += max_c < 64 ? 1 : 61) {
+    sts_word full = sts_from_double_array(seq, 64, 16, max_c);
+    mu_assert(full != NULL, "sts_from_double_array failed");
+    for (unsigned int c = STS_MIN_CARDINALITY; c <= max_c; ++c) {
+      sts_word expected = sts_from_double_array(seq, 64, 16, c);
+      sts_word derived = sts_word_to_cardinality(full, c);
+      if (max_c % c != 0) {
+        mu_assert(derived == NULL, "%u isn't nested in %u", c, max_c);
+      } else {
+        mu_assert(derived != NULL && words_equal(expected, derived),
+                  "deriving %u from %u failed", c, max_c);
+      }
+      sts_free_word(derived);
+      sts_free_word(expected);
+    }
+    sts_free_word(full);
+  }
+
+  unsigned int cs[] = { 4, 16, 5, 8, 2 };
+  sts_word words[5];
+  mu_assert(sts_from_double_array_multi(seq, 64, 16, cs, 5, words),
+            "sts_from_double_array_multi failed");
+  for (size_t i = 0; i < 5; ++i) {
+    sts_word expected = sts_from_double_array(seq, 64, 16, cs[i]);
+    mu_assert(words_equal(expected, words[i]),
+              "multi-cardinality conversion failed for %u", cs[i]);
+    sts_free_word(expected);
+    sts_free_word(words[i]);
+  }
+  cs[2] = STS_MAX_CARDINALITY + 1;
+  mu_assert(!sts_from_double_array_multi(seq, 64, 16, cs, 5, words),
+            "illegal cardinality accepted");
+  return NULL;
+}
+
+static char* test_fixed_normalization()
+{
+  double seq[96];
+  srand(7);
+  for (size_t i = 0; i < 96; ++i) {
+    seq[i] = 50 + 20 * ((double)rand() / RAND_MAX - 0.5);
+  }
+  seq[10] = seq[11] = NAN;
+  seq[40] = INFINITY;
+  double mu, sigma;
+  estimate_mu_and_std(seq, 96, &mu, &sigma);
+  for (unsigned int c = STS_MIN_CARDINALITY; c <= 32; ++c) {
+    // Known statistics of the series give the regular SAX word
+    sts_word expected = sts_from_double_array(seq, 96, 12, c);
+    sts_word fixed = sts_from_double_array_fixed(seq, 96, 12, c, mu, sigma);
+    mu_assert(fixed != NULL && words_equal(expected, fixed),
+              "fixed normalization differs from z-normalization, c == %u", c);
+    sts_free_word(expected);
+    sts_free_word(fixed);
+
+    sts_window window = sts_new_fixed_window(24, 4, c, 50, 5);
+    mu_assert(window != NULL, "sts_new_fixed_window failed");
+    for (size_t i = 0; i < 96; ++i) {
+      const struct sts_word* word = sts_append_value(window, seq[i]);
+      if (i + 1 < 24) continue;
+      expected = sts_from_double_array_fixed(seq + i + 1 - 24, 24, 4, c, 50, 5);
+      mu_assert(words_equal(expected, word), "fixed window failed at %"
+                PRIuSIZE ", c == %u", i, c);
+      sts_free_word(expected);
+    }
+    sts_free_window(window);
+  }
+  // Raw values, frames with NaNs are compared by their average
+  sts_word raw = sts_from_double_array_fixed((double[]) { 0.7, 0.7, -0.7, NAN,
+                                                          NAN, NAN }, 6, 3, 4,
+                                             0, 1);
+  char* str = sts_word_to_sax_string(raw);
+  mu_assert(strcmp(str, "DA#") == 0, "expected DA#, got %s", str);
+  free(str);
+  sts_free_word(raw);
+  mu_assert(sts_new_fixed_window(4, 2, 4, 0, 0) == NULL, "sigma == 0 accepted");
+  mu_assert(sts_new_fixed_window(4, 2, 4, NAN, 1) == NULL, "mu == NaN accepted");
+  return NULL;
+}
+
+static char* test_robust_normalization()
+{
+  double buf[400];
+  srand(11);
+  for (size_t i = 0; i < 400; ++i) {
+    // few distinct values to exercise equal keys
+    buf[i] = rand() % 4 == 0 ? (double)(rand() % 5)
+                             : (double)rand() / RAND_MAX * 10.0;
+    int r = rand() % 15;
+    if (r == 0) buf[i] = NAN;
+    else if (r == 1) buf[i] = INFINITY;
+    else if (r == 2) buf[i] = -INFINITY;
+  }
+  size_t sizes[] = { 1, 2, 7, 32 };
+  for (size_t s = 0; s < 4; ++s) {
+    size_t n = sizes[s];
+    sts_window win = sts_new_robust_window(n, 1, 8);
+    mu_assert(win != NULL, "sts_new_robust_window failed");
+    for (size_t i = 0; i < 400; ++i) {
+      const struct sts_word* word = sts_append_value(win, buf[i]);
+      mu_assert(word != NULL, "sts_append_value failed");
+      size_t from = i + 1 >= n ? i + 1 - n : 0;
+      double median, std, win_median, win_std;
+      estimate_median_and_mad(buf + from, i + 1 - from, &median, &std);
+      os_median_and_mad(win->order, &win_median, &win_std);
+      mu_assert(median == win_median && isclose(std, win_std),
+                "median/MAD differ at %" PRIuSIZE ": %f/%f vs %f/%f", i,
+                median, std, win_median, win_std);
+      if (i + 1 >= n) {
+        sts_word expected = sts_from_double_array_robust(buf + from, n, 1, 8);
+        mu_assert(words_equal(expected, word), "robust window failed");
+        sts_free_word(expected);
+      }
+    }
+    sts_reset_window(win);
+    mu_assert(os_count(win->order) == 0, "sts_reset_window failed");
+    sts_free_window(win);
+  }
+
+  // An outlier flattens z-normalized word but not the robust one
+  double spiky[8] = { 1, 1, 2, 2, 3, 3, 1000, 2 };
+  sts_word plain = sts_from_double_array(spiky, 8, 4, 4);
+  sts_word robust = sts_from_double_array_robust(spiky, 8, 4, 4);
+  char* plain_str = sts_word_to_sax_string(plain);
+  char* robust_str = sts_word_to_sax_string(robust);
+  mu_assert(strcmp(plain_str, "BBBD") == 0, "got %s", plain_str);
+  mu_assert(strcmp(robust_str, "ACDD") == 0, "got %s", robust_str);
+  free(plain_str);
+  free(robust_str);
+  sts_free_word(plain);
+  sts_free_word(robust);
+  return NULL;
+}
+
+static char* test_adaptive_breakpoints()
+{
+  sts_breakpoints bp = sts_new_adaptive_breakpoints(8, 0.01);
+  mu_assert(bp != NULL, "sts_new_adaptive_breakpoints failed");
+  mu_assert(sts_breakpoints_values(bp)[0] == get_breaks(8)[0],
+            "breakpoints don't start Gaussian");
+  srand(13);
+  for (size_t i = 0; i < 200; ++i) {
+    double value = -log(1 - (double)rand() / ((double)RAND_MAX + 1));
+    bool published = sts_breakpoints_add(bp, value);
+    const float* breaks = sts_breakpoints_values(bp);
+    if (i + 1 < 8 * STS_P2_WARMUP) {
+      mu_assert(!published && memcmp(breaks, get_breaks(8), 7 * sizeof*breaks)
+                == 0, "breakpoints published after %" PRIuSIZE " values",
+                i + 1);
+    }
+    // warmed up estimates of Exp(1) quantiles from 0.13 to 2.08
+    mu_assert(breaks[0] < 0.5 && breaks[6] > 1, "breakpoints collapsed "
+              "after %" PRIuSIZE " values", i + 1);
+    for (unsigned int j = 1; j < 7; ++j) {
+      mu_assert(breaks[j - 1] < breaks[j], "not ascending at %u after %"
+                PRIuSIZE " values", j, i + 1);
+    }
+  }
+  for (size_t i = 200; i < 20000; ++i) {
+    // Exp(1), which i / 8 quantile is -log(1 - i / 8)
+    sts_breakpoints_add(bp, -log(1 - (double)rand() / ((double)RAND_MAX + 1)));
+  }
+  const float* breaks = sts_breakpoints_values(bp);
+  for (unsigned int i = 0; i < 7; ++i) {
+    double expected = -log(1 - (i + 1) / 8.0);
+    mu_assert(fabs(breaks[i] - expected) < 0.1, "quantile %u/8 is %f, not %f",
+              i + 1, breaks[i], expected);
+    mu_assert(i == 0 || breaks[i - 1] < breaks[i], "not ascending at %u", i);
+  }
+  sts_word a = sts_from_sax_string("AH", 8);
+  sts_word b = sts_from_sax_string("HH", 8);
+  double expected = sqrt(2.0 / 2) * (double)(breaks[6] - breaks[0]);
+  mu_assert(isclose(sts_adaptive_mindist(bp, a, b), expected),
+            "adaptive mindist %f != %f", sts_adaptive_mindist(bp, a, b),
+            expected);
+  // Shifted data republishes breakpoints and regenerates the distances
+  for (size_t i = 0; i < 20000; ++i) {
+    double u = (double)rand() / ((double)RAND_MAX + 1);
+    sts_breakpoints_add(bp, -3 * log(1 - u));
+  }
+  expected = breaks[6] - breaks[0];
+  mu_assert(expected > 4, "breakpoints weren't republished");
+  mu_assert(isclose(sts_adaptive_mindist(bp, a, b), expected),
+            "adaptive mindist %f != %f", sts_adaptive_mindist(bp, a, b),
+            expected);
+  sts_free_word(a);
+  sts_free_word(b);
+
+  // Heavy-tailed series yields balanced words with adaptive breakpoints only
+  sts_free_breakpoints(bp);
+  bp = sts_new_adaptive_breakpoints(4, 0.01);
+  sts_window adaptive = sts_new_adaptive_window(32, 4, bp);
+  sts_window plain = sts_new_window(32, 4, 4);
+  mu_assert(adaptive != NULL, "sts_new_adaptive_window failed");
+  size_t adaptive_cnt[4] = { 0 }, plain_cnt[4] = { 0 };
+  for (size_t i = 0; i < 40000; ++i) {
+    // Pareto with shape 1.5
+    double value = pow(1 - (double)rand() / ((double)RAND_MAX + 1), -1 / 1.5);
+    const struct sts_word* word = sts_append_value(adaptive, value);
+    const struct sts_word* plain_word = sts_append_value(plain, value);
+    if (i < 20000) continue;
+    ++adaptive_cnt[word->symbols[3]];
+    ++plain_cnt[plain_word->symbols[3]];
+  }
+  for (unsigned int s = 0; s < 4; ++s) {
+    mu_assert(adaptive_cnt[s] > 4000 && adaptive_cnt[s] < 6000,
+              "symbol %u appeared %" PRIuSIZE " times", s, adaptive_cnt[s]);
+  }
+  mu_assert(plain_cnt[3] < 1000, "Gaussian breakpoints are balanced");
+  mu_assert(sts_new_adaptive_window(32, 4, NULL) == NULL, "NULL bp accepted");
+  mu_assert(sts_new_adaptive_breakpoints(1, 0.1) == NULL, "c == 1 accepted");
+  sts_free_window(adaptive);
+  sts_free_window(plain);
+  sts_free_breakpoints(bp);
+  return NULL;
+}
+
+static char* test_esax()
+{
+  double buf[300];
+  srand(17);
+  for (size_t i = 0; i < 300; ++i) {
+    buf[i] = (double)rand() / RAND_MAX * 10.0;
+    int r = rand() % 20;
+    if (r == 0) buf[i] = NAN;
+    else if (r == 1) buf[i] = INFINITY;
+    else if (r == 2) buf[i] = -INFINITY;
+  }
+  // single frame is avoided, its normalized average is zero up to rounding
+  size_t sizes[][2] = { { 12, 3 }, { 8, 8 }, { 20, 2 }, { 30, 5 } };
+  for (size_t s = 0; s < 4; ++s) {
+    size_t n = sizes[s][0], w = sizes[s][1];
+    sts_window win = sts_new_esax_window(n, w, 8);
+    mu_assert(win != NULL, "sts_new_esax_window failed");
+    for (size_t i = 0; i < 300; ++i) {
+      const struct sts_word* word = sts_append_value(win, buf[i]);
+      mu_assert(word != NULL && word->w == 3 * w, "sts_append_value failed");
+      if (i + 1 < n) continue;
+      sts_word expected = sts_from_double_array_esax(buf + i + 1 - n, n, w, 8);
+      mu_assert(words_equal(expected, word),
+                "ESAX window failed at %" PRIuSIZE ", n == %" PRIuSIZE, i, n);
+      sts_free_word(expected);
+    }
+    sts_reset_window(win);
+    sts_append_array(win, buf, 150);
+    sts_word expected = sts_from_double_array_esax(buf + 150 - n, n, w, 8);
+    mu_assert(words_equal(expected, &win->current_word),
+              "ESAX window failed after reset");
+    sts_free_word(expected);
+    sts_free_window(win);
+  }
+
+  // The spike is lost by the average but kept by the maximum
+  double spiky[8] = { 0, 1, 0, 1, 0, 1, 8, 1 };
+  sts_word sax = sts_from_double_array(spiky, 8, 2, 4);
+  sts_word esax = sts_from_double_array_esax(spiky, 8, 2, 4);
+  char* sax_str = sts_word_to_sax_string(sax);
+  char* esax_str = sts_word_to_sax_string(esax);
+  mu_assert(strcmp(sax_str, "BC") == 0, "got %s", sax_str);
+  mu_assert(strcmp(esax_str, "BBBBCD") == 0, "got %s", esax_str);
+  mu_assert(isnan(sts_mindist(sax, esax)), "words of different encodings");
+  mu_assert(!sts_words_equal(sax, esax), "words of different encodings");
+  free(sax_str);
+  free(esax_str);
+  sts_free_word(sax);
+  sts_free_word(esax);
+  return NULL;
+}
+
+static char* test_1dsax()
+{
+  // Integer values keep incremental regression sums exact
+  double buf[300];
+  srand(19);
+  for (size_t i = 0; i < 300; ++i) {
+    buf[i] = (double)(rand() % 10 + (i % 50 < 25 ? i / 10 : 0));
+    int r = rand() % 20;
+    if (r == 0) buf[i] = NAN;
+    else if (r == 1) buf[i] = INFINITY;
+    else if (r == 2) buf[i] = -INFINITY;
+  }
+  size_t sizes[][2] = { { 12, 3 }, { 8, 8 }, { 20, 2 }, { 30, 5 } };
+  for (size_t s = 0; s < 4; ++s) {
+    size_t n = sizes[s][0], w = sizes[s][1];
+    // no breakpoint at 0, where frames as large as the window mean would lie
+    sts_window win = sts_new_1dsax_window(n, w, 7, 4);
+    mu_assert(win != NULL, "sts_new_1dsax_window failed");
+    for (size_t i = 0; i < 300; ++i) {
+      const struct sts_word* word = sts_append_value(win, buf[i]);
+      mu_assert(word != NULL, "sts_append_value failed");
+      if (i + 1 < n) continue;
+      sts_word expected = sts_from_double_array_1dsax(buf + i + 1 - n, n, w, 7,
+                                                      4);
+      mu_assert(words_equal(expected, word),
+                "1d-SAX window failed at %" PRIuSIZE ", n == %" PRIuSIZE, i,
+                n);
+      sts_free_word(expected);
+    }
+    sts_free_window(win);
+  }
+
+  // Rising and falling frames of equal averages differ in slopes only
+  double trend[8] = { 0, 1, 2, 3, 3, 2, 1, 0 };
+  sts_word a = sts_from_double_array_1dsax(trend, 8, 2, 4, 4);
+  mu_assert(a->symbols[0] / 4 == a->symbols[1] / 4, "averages differ");
+  mu_assert(a->symbols[0] % 4 == 0 && a->symbols[1] % 4 == 3,
+            "unexpected slopes %u %u", a->symbols[0] % 4, a->symbols[1] % 4);
+  double step[8] = { 0, 0, 0, 0, 5, 5, 5, 5 };
+  sts_word b = sts_from_double_array_1dsax(step, 8, 2, 4, 4);
+  sts_word sax_a = sts_from_double_array(trend, 8, 2, 4);
+  sts_word sax_b = sts_from_double_array(step, 8, 2, 4);
+  mu_assert(sts_mindist(a, b) == sts_mindist(sax_a, sax_b),
+            "1d-SAX mindist %f != %f", sts_mindist(a, b),
+            sts_mindist(sax_a, sax_b));
+  mu_assert(sts_word_to_sax_string(a) == NULL, "1d-SAX has no SAX notation");
+  mu_assert(sts_new_1dsax_window(8, 2, 512, 256) == NULL,
+            "symbols overflow accepted");
+  sts_free_word(a);
+  sts_free_word(b);
+  sts_free_word(sax_a);
+  sts_free_word(sax_b);
+  return NULL;
+}
+
+static char* test_sfa()
+{
+  double buf[600];
+  srand(23);
+  for (size_t i = 0; i < 600; ++i) {
+    // periodic series with noise
+    buf[i] = sin(STS_TWO_PI * i / 12) + 0.5 * sin(STS_TWO_PI * i / 5)
+             + (double)rand() / RAND_MAX;
+  }
+  sts_sfa sfa = sts_new_sfa(24, 6, 4);
+  mu_assert(sfa != NULL, "sts_new_sfa failed");
+  mu_assert(sts_sfa_train(sfa, buf, 600), "sts_sfa_train failed");
+  // Equi-depth bins are balanced on the training data
+  size_t hist[6][4] = { { 0 } };
+  for (size_t i = 0; i + 24 <= 600; ++i) {
+    sts_word word = sts_from_double_array_sfa(buf + i, 24, sfa);
+    for (size_t j = 0; j < 6; ++j) {
+      ++hist[j][word->symbols[j]];
+    }
+    sts_free_word(word);
+  }
+  for (size_t j = 0; j < 6; ++j) {
+    for (size_t s = 0; s < 4; ++s) {
+      mu_assert(hist[j][s] > 130 && hist[j][s] < 160,
+                "symbol %" PRIuSIZE " at %" PRIuSIZE " appeared %" PRIuSIZE
+                " times", s, j, hist[j][s]);
+    }
+  }
+
+  buf[100] = NAN;
+  buf[300] = INFINITY;
+  sts_window win = sts_new_sfa_window(sfa);
+  mu_assert(win != NULL, "sts_new_sfa_window failed");
+  for (size_t i = 0; i < 600; ++i) {
+    const struct sts_word* word = sts_append_value(win, buf[i]);
+    if (i + 1 < 24) continue;
+    sts_word expected = sts_from_double_array_sfa(buf + i + 1 - 24, 24, sfa);
+    mu_assert(words_equal(expected, word), "SFA window failed at %" PRIuSIZE,
+              i);
+    sts_free_word(expected);
+
+    // mindist lower bounds the distance of z-normalized series
+    size_t j = (i * 7) % (600 - 24);
+    sts_word other = sts_from_double_array_sfa(buf + j, 24, sfa);
+    double mu_a, std_a, mu_b, std_b, dist = 0;
+    estimate_mu_and_std(buf + i + 1 - 24, 24, &mu_a, &std_a);
+    estimate_mu_and_std(buf + j, 24, &mu_b, &std_b);
+    for (size_t t = 0; t < 24; ++t) {
+      double d = (buf[i + 1 - 24 + t] - mu_a) / std_a
+                 - (buf[j + t] - mu_b) / std_b;
+      dist += d * d;
+    }
+    double mindist = sts_mindist(word, other);
+    mu_assert(!isfinite(dist) || mindist <= sqrt(dist) + 1e-6,
+              "mindist %f exceeds distance %f", mindist, sqrt(dist));
+    sts_free_word(other);
+  }
+  sts_word sax = sts_from_double_array(buf, 24, 6, 4);
+  mu_assert(isnan(sts_mindist(sax, &win->current_word)),
+            "SAX and SFA words are comparable");
+  sts_free_word(sax);
+  sts_free_window(win);
+  sts_free_sfa(sfa);
+  mu_assert(sts_new_sfa(24, 23, 4) == NULL, "Nyquist coefficient accepted");
+  return NULL;
+}
+
+static char* test_finite_fast_path()
+{
+  double buf[500];
+  srand(29);
+  for (size_t i = 0; i < 500; ++i) {
+    buf[i] = (double)rand() / RAND_MAX * 100.0 - 30;
+  }
+  size_t sizes[][2] = { { 12, 3 }, { 8, 8 }, { 20, 2 }, { 30, 5 } };
+  for (size_t s = 0; s < 4; ++s) {
+    size_t n = sizes[s][0], w = sizes[s][1];
+    sts_window regular = sts_new_window(n, w, 16);
+    sts_window finite = sts_new_window(n, w, 16);
+    // NaNs appended by the regular path are replaced by the finite values
+    sts_append_value(finite, NAN);
+    sts_append_value(regular, NAN);
+    for (size_t i = 0; i < 500; ++i) {
+      const struct sts_word* expected = sts_append_value(regular, buf[i]);
+      const struct sts_word* word = i % 100 < 50
+        ? sts_append_finite_value(finite, buf[i])
+        : sts_append_finite_array(finite, buf + i, 1);
+      mu_assert(words_equal(expected, word), "finite path failed at %"
+                PRIuSIZE ", n == %" PRIuSIZE, i, n);
+      mu_assert(regular->values->mu == finite->values->mu
+                && regular->values->s2 == finite->values->s2,
+                "finite path statistics differ at %" PRIuSIZE, i);
+    }
+    sts_append_array(regular, buf, 100);
+    mu_assert(words_equal(sts_append_finite_array(finite, buf, 100),
+                          &regular->current_word), "finite array failed");
+    sts_free_window(regular);
+    sts_free_window(finite);
+  }
+  return NULL;
+}
+
+static char* test_typed_input()
+{
+  float fbuf[240];
+  int32_t ibuf[240];
+  int64_t lbuf[240];
+  double fwide[240], iwide[240], lwide[240];
+  srand(31);
+  for (size_t i = 0; i < 240; ++i) {
+    fbuf[i] = (float)rand() / RAND_MAX * 10.0f;
+    if (i % 37 == 0) fbuf[i] = NAN;
+    if (i % 53 == 0) fbuf[i] = INFINITY;
+    ibuf[i] = rand() % 2001 - 1000;
+    lbuf[i] = ((int64_t)1 << 40) + (int64_t)(rand() % 100) * 1000000;
+    fwide[i] = fbuf[i];
+    iwide[i] = ibuf[i];
+    lwide[i] = (double)lbuf[i];
+  }
+  for (unsigned int c = 3; c <= 256; c *= 2) {
+    sts_word expected = sts_from_double_array(fwide, 240, 24, c);
+    sts_word word = sts_from_float_array(fbuf, 240, 24, c);
+    mu_assert(words_equal(expected, word), "float conversion failed");
+    sts_free_word(expected);
+    sts_free_word(word);
+    expected = sts_from_double_array(iwide, 240, 24, c);
+    word = sts_from_int32_array(ibuf, 240, 24, c);
+    mu_assert(words_equal(expected, word), "int32 conversion failed");
+    sts_free_word(expected);
+    sts_free_word(word);
+    expected = sts_from_double_array(lwide, 240, 24, c);
+    word = sts_from_int64_array(lbuf, 240, 24, c);
+    mu_assert(words_equal(expected, word), "int64 conversion failed");
+    sts_free_word(expected);
+    sts_free_word(word);
+  }
+  sts_window regular = sts_new_window(40, 8, 8);
+  sts_window typed = sts_new_window(40, 8, 8);
+  for (size_t i = 0; i < 240; i += 30) {
+    mu_assert(words_equal(sts_append_array(regular, fwide + i, 30),
+                          sts_append_float_array(typed, fbuf + i, 30)),
+              "float append failed at %" PRIuSIZE, i);
+    mu_assert(words_equal(sts_append_array(regular, iwide + i, 30),
+                          sts_append_int32_array(typed, ibuf + i, 30)),
+              "int32 append failed at %" PRIuSIZE, i);
+    mu_assert(words_equal(sts_append_array(regular, lwide + i, 30),
+                          sts_append_int64_array(typed, lbuf + i, 30)),
+              "int64 append failed at %" PRIuSIZE, i);
+  }
+  sts_free_window(regular);
+  sts_free_window(typed);
+  return NULL;
+}
+
+static char* test_strided_input()
+{
+  // 6 channels in rows of 8 elements
+  double rows[120 * 8];
+  double channel[120];
+  srand(37);
+  for (size_t i = 0; i < 120 * 8; ++i) {
+    rows[i] = (double)rand() / RAND_MAX * (i % 8 + 1);
+    if (rand() % 30 == 0) rows[i] = NAN;
+    if (rand() % 50 == 0) rows[i] = -INFINITY;
+  }
+  sts_word words[6];
+  mu_assert(sts_from_strided_array(rows, 120, 8, 6, 12, 8, words),
+            "sts_from_strided_array failed");
+  sts_window windows[6];
+  for (size_t j = 0; j < 6; ++j) {
+    windows[j] = sts_new_window(10 * (j + 1), 5, 8);
+  }
+  mu_assert(sts_append_strided(windows, 6, rows, 100, 8),
+            "sts_append_strided failed");
+  mu_assert(sts_append_strided(windows, 6, rows + 100 * 8, 20, 8),
+            "sts_append_strided failed");
+  for (size_t j = 0; j < 6; ++j) {
+    for (size_t i = 0; i < 120; ++i) {
+      channel[i] = rows[i * 8 + j];
+    }
+    sts_word expected = sts_from_double_array(channel, 120, 12, 8);
+    mu_assert(words_equal(expected, words[j]), "channel %" PRIuSIZE, j);
+    sts_free_word(expected);
+    sts_free_word(words[j]);
+
+    sts_window window = sts_new_window(10 * (j + 1), 5, 8);
+    sts_append_array(window, channel, 120);
+    mu_assert(words_equal(&window->current_word, &windows[j]->current_word),
+              "window of channel %" PRIuSIZE, j);
+    sts_free_window(window);
+    sts_free_window(windows[j]);
+  }
+  mu_assert(!sts_from_strided_array(rows, 120, 4, 6, 12, 8, words),
+            "overlapping rows accepted");
+  return NULL;
+}
+
+static char* test_multivariate_window()
+{
+  double rows[200][5];
+  srand(41);
+  for (size_t i = 0; i < 200; ++i) {
+    for (size_t k = 0; k < 5; ++k) {
+      rows[i][k] = (double)rand() / RAND_MAX * (k + 1) + (k == 2 ? i : 0);
+      if (rand() % 25 == 0) rows[i][k] = NAN;
+      if (rand() % 40 == 0) rows[i][k] = INFINITY;
+    }
+  }
+  sts_mwindow mw = sts_new_mwindow(24, 4, 8, 5);
+  sts_mwindow shifted = sts_new_mwindow(24, 4, 8, 5);
+  mu_assert(mw != NULL && shifted != NULL, "sts_new_mwindow failed");
+  sts_window windows[5];
+  for (size_t k = 0; k < 5; ++k) {
+    windows[k] = sts_new_window(24, 4, 8);
+  }
+  for (size_t i = 0; i < 200; ++i) {
+    if (i == 120) {
+      sts_reset_mwindow(mw);
+      for (size_t k = 0; k < 5; ++k) {
+        sts_reset_window(windows[k]);
+      }
+    }
+    const struct sts_word* word = sts_mwindow_append(mw, rows[i]);
+    const struct sts_word* other = sts_mwindow_append(shifted,
+                                                      rows[(i + 50) % 200]);
+    mu_assert(word && word->w == 20 && word->n_values == 120,
+              "sts_mwindow_append failed");
+    double squares = 0;
+    for (size_t k = 0; k < 5; ++k) {
+      const struct sts_word* expected = sts_append_value(windows[k],
+                                                         rows[i][k]);
+      struct sts_word view, other_view;
+      mu_assert(sts_mwindow_channel(mw, k, &view), "no channel %" PRIuSIZE, k);
+      mu_assert(words_equal(expected, &view), "channel %" PRIuSIZE
+                " differs at %" PRIuSIZE, k, i);
+      sts_mwindow_channel(shifted, k, &other_view);
+      double dist = sts_mindist(&view, &other_view);
+      squares += dist * dist;
+    }
+    // Multivariate mindist combines the ones of channels
+    mu_assert(isclose(sts_mindist(word, other), sqrt(squares)),
+              "multivariate mindist %f != %f", sts_mindist(word, other),
+              sqrt(squares));
+  }
+  sts_free_mwindow(mw);
+  sts_free_mwindow(shifted);
+  for (size_t k = 0; k < 5; ++k) {
+    sts_free_window(windows[k]);
+  }
+  mu_assert(sts_new_mwindow(24, 5, 8, 5) == NULL, "n %% w != 0 accepted");
+  return NULL;
+}
+
+static char* test_caller_storage()
+{
+  double series[] = { 2.02, 2.33, 2.99, 6.85, 9.20, 8.80, 7.50, 6.00, 5.85,
+                      3.85, 4.85, 3.85, 2.22, 1.45, 1.34, NAN };
+  sts_symbol symbols[8];
+  struct sts_word word = { .symbols = symbols };
+  for (unsigned int c = 2; c <= 32; ++c) {
+    sts_word expected = sts_from_double_array(series, 16, 8, c);
+    mu_assert(sts_from_double_array_into(series, 16, 8, c, &word),
+              "encoding into caller's storage failed");
+    mu_assert(words_equal(expected, &word), "words differ for c = %u", c);
+    sts_free_word(expected);
+  }
+  mu_assert(!sts_from_double_array_into(series, 16, 5, 4, &word),
+            "w not dividing n accepted");
+  mu_assert(sts_from_sax_string_into("#BAD", 4, &word)
+            && word.w == 4 && word.c == 4, "SAX string into storage failed");
+  sts_word expected = sts_from_sax_string("#BAD", 4);
+  mu_assert(words_equal(expected, &word), "SAX string words differ");
+  sts_free_word(expected);
+  mu_assert(!sts_from_sax_string_into("#BAE", 4, &word), "E accepted");
+  word.symbols = NULL;
+  mu_assert(!sts_from_double_array_into(series, 16, 8, 4, &word),
+            "word without storage accepted");
+
+  // 240, 24, 8 has a specialized transform
+  static const size_t sizes[][2] = { { 16, 4 }, { 240, 24 } };
+  for (size_t k = 0; k < 2; ++k) {
+    size_t n = sizes[k][0], w = sizes[k][1];
+    double* storage = malloc(sts_window_storage_size(n, w));
+    sts_window window = sts_init_window(storage, n, w, 8);
+    sts_window allocated = sts_new_window(n, w, 8);
+    mu_assert(window == (sts_window)storage, "window isn't at the storage");
+    for (size_t i = 0; i < 3 * n; ++i) {
+      double value = i % 7 == 0 ? NAN : series[i % 16] + i;
+      mu_assert(words_equal(sts_append_value(window, value),
+                            sts_append_value(allocated, value)),
+                "windows differ at %" PRIuSIZE, i);
+    }
+    mu_assert(sts_reset_window(window), "window in storage not reset");
+    sts_free_window(allocated);
+    free(storage);
+  }
+  mu_assert(!sts_init_window(series, 16, 5, 8), "w not dividing n accepted");
+  return NULL;
+}
+
+static char* test_sliding_words()
+{
+  // Drifting far from the first value, with NaN runs and infinities
+  static double series[2000];
+  srand(5);
+  for (size_t i = 0; i < 2000; ++i) {
+    series[i] = 1e4 + i * 3.5 + rand() % 1000 / 10.0;
+    if (i % 211 < 30) series[i] = NAN;
+    if (i == 700 || i == 703) series[i] = i == 700 ? INFINITY : -INFINITY;
+    if (i == 1500) series[i] = -INFINITY;
+  }
+  static sts_symbol symbols[2000 * 10];
+  static const size_t strides[] = { 1, 7 };
+  for (size_t k = 0; k < 2; ++k) {
+    size_t words = sts_sliding_words(series, 2000, 60, 10, 8, strides[k],
+                                     symbols);
+    mu_assert(words == (2000 - 60) / strides[k] + 1,
+              "%" PRIuSIZE " words written", words);
+    for (size_t i = 0; i < words; ++i) {
+      sts_word expected =
+        sts_from_double_array(series + i * strides[k], 60, 10, 8);
+      mu_assert(memcmp(expected->symbols, symbols + i * 10,
+                       10 * sizeof*symbols) == 0,
+                "word %" PRIuSIZE " differs with stride %" PRIuSIZE, i,
+                strides[k]);
+      sts_free_word(expected);
+    }
+  }
+  mu_assert(sts_sliding_words(series, 59, 60, 10, 8, 1, symbols) == 0,
+            "series shorter than window encoded");
+  mu_assert(sts_sliding_words(series, 2000, 60, 7, 8, 1, symbols) == 0,
+            "w not dividing n accepted");
+
+  // Collected words are the ones of appends, the first window isn't empty
+  sts_window window = sts_new_window(60, 10, 8);
+  sts_window expected = sts_new_window(60, 10, 8);
+  sts_append_array(window, series, 20);
+  sts_append_array(expected, series, 20);
+  mu_assert(sts_append_collect(window, series + 20, 1980, symbols),
+            "sts_append_collect failed");
+  for (size_t i = 0; i < 1980; ++i) {
+    const struct sts_word* word = sts_append_value(expected, series[20 + i]);
+    mu_assert(memcmp(word->symbols, symbols + i * 10,
+                     10 * sizeof*symbols) == 0,
+              "collected word %" PRIuSIZE " differs", i);
+  }
+  mu_assert(words_equal(&window->current_word, &expected->current_word),
+            "window not appended to");
+  sts_free_window(window);
+  sts_free_window(expected);
+  return NULL;
+}
+
+static char* test_library()
+{
+  sts_library lib = sts_new_library(64, 8, 6);
+  mu_assert(lib != NULL, "sts_new_library failed");
+  double series[64];
+  sts_word words[300];
+  srand(3);
+  for (size_t j = 0; j < 300; ++j) {
+    for (size_t i = 0; i < 64; ++i) {
+      series[i] = rand() % 100 + (i % 8 < j % 8 ? 50 : 0);
+      if (j % 37 == 0 && i < 8) series[i] = NAN;
+    }
+    words[j] = sts_from_double_array(series, 64, 8, 6);
+    // duplicates for ties
+    mu_assert(sts_library_add(lib, words[j % 250]), "word %" PRIuSIZE
+              " not added", j);
+  }
+  mu_assert(sts_library_size(lib) == 300, "wrong library size");
+  struct sts_word view;
+  mu_assert(sts_library_word(lib, 260, &view) && words_equal(&view, words[10])
+            && view.n_values == 64, "library word differs");
+  mu_assert(!sts_library_word(lib, 300, &view), "word past the end");
+  sts_word other = sts_from_double_array(series, 64, 4, 6);
+  mu_assert(!sts_library_add(lib, other), "w = 4 word added");
+  sts_free_word(other);
+
+  size_t indices[20];
+  double distances[20];
+  for (size_t q = 0; q < 10; ++q) {
+    const struct sts_word* query = words[290 + q];
+    for (size_t t = 0; t < 2; ++t) {
+      double threshold = t == 0 ? INFINITY : 4;
+      size_t found = sts_library_nearest(lib, query, 20, threshold, indices,
+                                         distances);
+      // Brute force: a word is missed only if 20 others are at least as close
+      size_t within = 0;
+      for (size_t j = 0; j < 300; ++j) {
+        double d = sts_mindist(query, words[j % 250]);
+        if (d <= threshold) ++within;
+      }
+      mu_assert(found == (within < 20 ? within : 20),
+                "%" PRIuSIZE " found of %" PRIuSIZE, found, within);
+      for (size_t r = 0; r < found; ++r) {
+        double d = sts_mindist(query, words[indices[r] % 250]);
+        mu_assert(fabs(d - distances[r]) < 1e-9, "distance %f, not %f",
+                  distances[r], d);
+        mu_assert(r == 0 || distances[r - 1] < distances[r]
+                  || (distances[r - 1] == distances[r]
+                      && indices[r - 1] < indices[r]), "not ordered at %"
+                  PRIuSIZE, r);
+        size_t closer = 0;
+        for (size_t j = 0; j < 300; ++j) {
+          double dj = sts_mindist(query, words[j % 250]);
+          if (dj < d - 1e-9 || (fabs(dj - d) <= 1e-9 && j < indices[r])) {
+            ++closer;
+          }
+        }
+        mu_assert(closer == r, "%" PRIuSIZE " words closer than rank %"
+                  PRIuSIZE, closer, r);
+      }
+    }
+  }
+  mu_assert(sts_library_nearest(lib, words[0], 0, INFINITY, indices,
+                                distances) == 0, "k = 0 found words");
+  mu_assert(sts_library_nearest(lib, words[0], 20, -1, indices,
+                                distances) == 0, "threshold -1 found words");
+  mu_assert(sts_library_nearest(lib, words[0], 20, NAN, indices,
+                                distances) == 0, "threshold NaN found words");
+  mu_assert(sts_library_clear(lib) && sts_library_size(lib) == 0,
+            "library not cleared");
+  mu_assert(sts_library_nearest(lib, words[0], 20, INFINITY, indices,
+                                distances) == 0, "cleared library found words");
+  mu_assert(sts_library_add(lib, words[5]) && sts_library_word(lib, 0, &view)
+            && words_equal(&view, words[5]), "word not added after clear");
+  mu_assert(!sts_library_clear(NULL), "NULL library cleared");
+  for (size_t j = 0; j < 300; ++j) sts_free_word(words[j]);
+  sts_free_library(lib);
+  return NULL;
+}
+
+static char* test_kernel_dispatch()
+{
+  static const char* names[] = { "avx512", "avx2", "sse4.2", "scalar" };
+  static const unsigned int cards[] = { 4, 16, 64 };
+  const char* active = sts_active_kernel();
+  mu_assert(sts_select_kernel("scalar"), "scalar kernels unavailable");
+  mu_assert(!sts_select_kernel("mmx"), "unknown kernels selected");
+  mu_assert(!sts_select_kernel(NULL), "NULL kernels selected");
+  double series[1024];
+  srand(11);
+  for (size_t i = 0; i < 1024; ++i) {
+    series[i] = rand() % 1000 / 10.0 - 50;
+    if (i % 97 < 9) series[i] = NAN;
+    if (i == 500) series[i] = INFINITY;
+  }
+  // frames of 5 and 10 values
+  static const size_t configs[][3] = { { 200, 40, 9 }, { 240, 24, 8 } };
+  sts_word expected[3];
+  sts_window scalar[2], window = NULL;
+  for (size_t k = 0; k < 2; ++k) {
+    scalar[k] = sts_new_window(configs[k][0], configs[k][1],
+                               (unsigned int)configs[k][2]);
+  }
+  for (size_t k = 0; k < 3; ++k) {
+    expected[k] = sts_from_double_array(series, 1024, 64, cards[k]);
+  }
+  for (size_t v = 0; v < sizeof(names) / sizeof(names[0]); ++v) {
+    if (!sts_select_kernel(names[v])) continue;
+    mu_assert(strcmp(sts_active_kernel(), names[v]) == 0, "%s not active",
+              names[v]);
+    for (size_t k = 0; k < 3; ++k) {
+      sts_word word = sts_from_double_array(series, 1024, 64, cards[k]);
+      mu_assert(words_equal(word, expected[k]), "%s differs for c = %u",
+                names[v], cards[k]);
+      sts_free_word(word);
+    }
+    // the ring buffer wraps around in the middle of frames
+    for (size_t k = 0; k < 2; ++k) {
+      window = sts_new_window(configs[k][0], configs[k][1],
+                              (unsigned int)configs[k][2]);
+      sts_reset_window(scalar[k]);
+      for (size_t i = 0; i < 1024; ++i) {
+        sts_select_kernel("scalar");
+        const struct sts_word* a = sts_append_value(scalar[k], series[i]);
+        sts_select_kernel(names[v]);
+        const struct sts_word* b = sts_append_value(window, series[i]);
+        mu_assert((!a && !b) || words_equal(a, b), "%s differs at %" PRIuSIZE
+                  " for n = %" PRIuSIZE, names[v], i, configs[k][0]);
+      }
+      sts_free_window(window);
+    }
+  }
+  for (size_t k = 0; k < 3; ++k) sts_free_word(expected[k]);
+  for (size_t k = 0; k < 2; ++k) sts_free_window(scalar[k]);
+  mu_assert(sts_select_kernel(active), "%s can't be restored", active);
+  return NULL;
+}
+
+static char* test_window_stats()
+{
+  struct sts_window_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  mu_assert(sts_stats_percentile(&stats, 0.99) == 0, "empty histogram");
+  stats.latency[5] = 98;
+  stats.latency[8 * 8 + 3] = 1; // [11 << 7, 12 << 7)
+  stats.latency[STS_STATS_BUCKETS - 1] = 1;
+  mu_assert(sts_stats_percentile(&stats, 0.5) == 5, "p50 isn't 5");
+  mu_assert(sts_stats_percentile(&stats, 0.99) == (12 << 7) - 1,
+            "p99 isn't %d", (12 << 7) - 1);
+  mu_assert(sts_stats_percentile(&stats, 1) == ((uint64_t)16 << 36) - 1,
+            "p100 isn't the last bucket");
+
+  sts_window window = sts_new_window(8, 2, 4);
+  double series[] = { 1, 2, NAN, NAN, NAN, NAN, 3, 1, 5, 3, 2, 7 };
+  uint64_t nan_frames = 0, word_changes = 0;
+  sts_symbol last[2] = { 4, 4 };
+  for (size_t i = 0; i <= 10; ++i) {
+    const struct sts_word* word = i < 10
+      ? sts_append_value(window, series[i])
+      : sts_append_array(window, series + 10, 2);
+    for (size_t j = 0; j < 2; ++j) nan_frames += word->symbols[j] == 4;
+    if (memcmp(last, word->symbols, sizeof(last))) {
+      memcpy(last, word->symbols, sizeof(last));
+      ++word_changes;
+    }
+  }
+#ifdef STS_ENABLE_STATS
+  mu_assert(sts_get_window_stats(window, &stats), "no stats");
+  mu_assert(stats.appends == 12, "appends %" PRIuSIZE, (size_t)stats.appends);
+  mu_assert(stats.recomputes == 11, "recomputes %" PRIuSIZE,
+            (size_t)stats.recomputes);
+  mu_assert(stats.nan_frames == nan_frames, "NaN frames %" PRIuSIZE,
+            (size_t)stats.nan_frames);
+  mu_assert(stats.word_changes == word_changes, "word changes %" PRIuSIZE,
+            (size_t)stats.word_changes);
+  mu_assert(sts_stats_percentile(&stats, 1) > 0, "no latencies");
+#else
+  (void)nan_frames;
+  (void)word_changes;
+  mu_assert(!sts_get_window_stats(window, &stats), "stats without counters");
+#endif
+  sts_free_window(window);
+  return NULL;
+}
+
+static char* test_recording()
+{
+#ifdef STS_ENABLE_RECORDING
+  static const char* path = "sts_test_record.bin";
+  sts_window before = sts_new_window(8, 2, 4);
+  mu_assert(sts_start_recording(path), "recording didn't start");
+  mu_assert(!sts_start_recording(path), "recording started twice");
+  sts_window a = sts_new_window(8, 2, 4);
+  sts_window b = sts_new_esax_window(8, 2, 4);
+  double values[] = { 1, NAN, 3, 4, 5, 6, 7, 8, 9, 10 };
+  uint64_t hash = word_hash(sts_append_value(a, 1));
+  sts_append_value(before, 1);
+  sts_append_array(a, values, 10);
+  sts_append_value(b, 2);
+  sts_reset_window(a);
+  sts_append_finite_value(b, 3);
+  sts_append_value(b, 4);
+  mu_assert(sts_stop_recording(), "recording failed");
+  mu_assert(!sts_stop_recording(), "recording stopped twice");
+  sts_append_value(a, 3);
+
+  FILE* file = fopen(path, "rb");
+  mu_assert(file, "no recording");
+  unsigned char buf[512];
+  size_t size = fread(buf, 1, sizeof(buf), file);
+  fclose(file);
+  remove(path);
+  // magic, W a, V a, A a with 8 values, W b, V b, R a, U b, nothing of the
+  // window created before and of b after its finite append
+  mu_assert(size == 8 + 2 * 32 + 2 * 29 + 29 + 8 * 8 + 2 * 13,
+            "recorded %" PRIuSIZE " bytes", size);
+  mu_assert(memcmp(buf, STS_RECORD_MAGIC, 8) == 0, "no magic");
+  mu_assert(buf[8] == 'W' && buf[40] == 'V' && buf[69] == 'A'
+            && buf[162] == 'W' && buf[194] == 'V' && buf[223] == 'R'
+            && buf[236] == 'U', "unexpected records");
+  mu_assert(buf[9] == 1 && buf[41] == 1 && buf[70] == 1 && buf[163] == 2
+            && buf[195] == 2 && buf[224] == 1 && buf[237] == 2,
+            "unexpected window ids");
+  mu_assert(buf[21] == 2 && buf[175] == 2, "frames aren't recorded");
+  mu_assert(buf[82] == 8, "array isn't truncated to the window");
+  uint64_t recorded = 0;
+  for (size_t i = 0; i < 8; ++i) recorded |= (uint64_t)buf[61 + i] << 8 * i;
+  mu_assert(recorded == hash, "word hash differs");
+  sts_free_window(before);
+  sts_free_window(a);
+  sts_free_window(b);
+#else
+  mu_assert(!sts_start_recording("sts_test_record.bin"), "recording started");
+  mu_assert(!sts_stop_recording(), "recording stopped");
+#endif
+  return NULL;
+}
+
 static char* all_tests()
 {
   mu_run_test(test_get_symbol_zero);
   mu_run_test(test_get_symbol_breaks);
+  mu_run_test(test_generated_tables);
   mu_run_test(test_to_sax_sample);
   mu_run_test(test_to_sax_stationary);
   mu_run_test(test_nan_and_infinity_in_series);
   mu_run_test(test_sliding_word);
   mu_run_test(test_online_mu_sigma_random);
+  mu_run_test(test_derived_cardinalities);
+  mu_run_test(test_fixed_normalization);
+  mu_run_test(test_robust_normalization);
+  mu_run_test(test_adaptive_breakpoints);
+  mu_run_test(test_esax);
+  mu_run_test(test_1dsax);
+  mu_run_test(test_sfa);
+  mu_run_test(test_finite_fast_path);
+  mu_run_test(test_typed_input);
+  mu_run_test(test_strided_input);
+  mu_run_test(test_multivariate_window);
+  mu_run_test(test_caller_storage);
+  mu_run_test(test_sliding_words);
+  mu_run_test(test_library);
+  mu_run_test(test_kernel_dispatch);
+  mu_run_test(test_window_stats);
+  mu_run_test(test_recording);
   return NULL;
 }
 
@@ -0,0 +1,130 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/** @brief Unit tests of the C++17 layer symtseries.hpp @file */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "symtseries.hpp"
+#include "sts_test.h"
+
+static double series[64];
+
+static void fill_series()
+{
+  for (int i = 0; i < 64; ++i) {
+    series[i] = 10 * std::sin(i / 5.0) + i % 3;
+  }
+  series[9] = NAN;
+}
+
+static char* test_word_encode()
+{
+  auto word = sts::Word<8, 6>::encode(series, 64);
+  struct sts_word* expected = sts_from_double_array(series, 64, 8, 6);
+  mu_assert(word && expected, "encoding failed");
+  mu_assert(word->n_values() == 64, "n_values %zu", word->n_values());
+  mu_assert(std::memcmp(word->data(), expected->symbols,
+                        8 * sizeof(sts_symbol)) == 0, "symbols differ");
+  char* str = sts_word_to_sax_string(expected);
+  mu_assert(word->to_string() == str, "%s instead of %s",
+            word->to_string().c_str(), str);
+  std::free(str);
+  sts_free_word(expected);
+  mu_assert(!(sts::Word<8, 6>::encode(series, 60)), "60 values encoded");
+  return NULL;
+}
+
+static char* test_word_mindist()
+{
+  for (std::size_t shift = 0; shift < 32; shift += 4) {
+    auto a = sts::Word<8, 6>::encode(series, 32);
+    auto b = sts::Word<8, 6>::encode(series + shift, 32);
+    struct sts_word* ca = sts_from_double_array(series, 32, 8, 6);
+    struct sts_word* cb = sts_from_double_array(series + shift, 32, 8, 6);
+    double expected = sts_mindist(ca, cb);
+    mu_assert(std::fabs(a->mindist(*b) - expected) < 1e-12,
+              "mindist %f instead of %f", a->mindist(*b), expected);
+    mu_assert((*a == *b) == (sts_words_equal(ca, cb) != 0),
+              "equality differs at shift %zu", shift);
+    sts_free_word(ca);
+    sts_free_word(cb);
+  }
+  // cardinality without constexpr table goes through sts_mindist
+  auto a = sts::Word<8, 64>::encode(series, 32);
+  auto b = sts::Word<8, 64>::encode(series + 8, 32);
+  struct sts_word va = a->view(), vb = b->view();
+  mu_assert(a->mindist(*b) == sts_mindist(&va, &vb), "c = 64 mindist differs");
+  return NULL;
+}
+
+static char* test_window()
+{
+  sts::Window<16, 4, 6> window;
+  struct sts_window* expected = sts_new_window(16, 4, 6);
+  for (int i = 0; i < 40; ++i) {
+    mu_assert(window.append(series[i]), "append %d failed", i);
+    sts_append_value(expected, series[i]);
+    mu_assert(window.full() == (i >= 15), "full() is %d after %d values",
+              window.full(), i + 1);
+    sts::Word<4, 6> word = window.word();
+    mu_assert(std::memcmp(word.data(), expected->current_word.symbols,
+                          4 * sizeof(sts_symbol)) == 0,
+              "words differ after %d values", i + 1);
+  }
+  mu_assert(window.reset() && !window.full(), "reset window is full");
+  mu_assert(window.append(series, 20) && window.full(),
+            "array append didn't fill the window");
+  sts_free_window(expected);
+  return NULL;
+}
+
+static char* test_moved_window()
+{
+  sts::Window<16, 4, 6> a;
+  a.append(series, 16);
+  struct sts_window* c_window = a.get();
+  sts::Window<16, 4, 6> b(std::move(a));
+  mu_assert(b.get() == c_window && b.full(), "window not moved");
+  mu_assert(!a.append(1.0) && !a.full(), "moved-from window appended");
+  mu_assert(a.current() == nullptr && !a.reset(),
+            "moved-from window has a word");
+  mu_assert(a.word() == (sts::Word<4, 6>()), "moved-from word not empty");
+
+  sts::Window<16, 4, 6> c;
+  c = std::move(b);
+  mu_assert(c.get() == c_window && c.full(), "window not move-assigned");
+  mu_assert(b.get() != nullptr && !b.full(), "windows not swapped");
+  struct sts_window* released = c.release();
+  mu_assert(released == c_window && !c.append(1.0), "window not released");
+  sts_free_window(released);
+  return NULL;
+}
+
+static char* all_tests()
+{
+  fill_series();
+  mu_run_test(test_word_encode);
+  mu_run_test(test_word_mindist);
+  mu_run_test(test_window);
+  mu_run_test(test_moved_window);
+  return NULL;
+}
+
+int main()
+{
+  char* result = all_tests();
+  if (result) {
+    printf("%s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", mu_tests_run);
+  return result != 0;
+}
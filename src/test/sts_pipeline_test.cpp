@@ -0,0 +1,168 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/** @brief Offline tests of the C++20 pipeline symtseries_pipeline.hpp @file */
+
+#include <cmath>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "symtseries_pipeline.hpp"
+#include "sts_test.h"
+
+using namespace sts::pipeline;
+
+static const std::size_t N = 16, W = 4, n_series = 3, n_samples = 300;
+static const unsigned int C = 4;
+static const double threshold = 1.5;
+
+static std::vector<Sample> samples;
+static std::vector<sts::Word<W, C>> patterns;
+
+static void fill_samples()
+{
+  // series interleaved unevenly, so that they fill at different positions
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    std::size_t series = i % 7 % n_series;
+    samples.push_back(Sample{ series, std::sin(i / (3.0 + series)) + i % 5 });
+  }
+  double ramp[N], wave[N];
+  for (std::size_t i = 0; i < N; ++i) {
+    ramp[i] = static_cast<double>(i);
+    wave[i] = std::cos(i / 2.0);
+  }
+  patterns.push_back(*sts::Word<W, C>::encode(ramp, N));
+  patterns.push_back(*sts::Word<W, C>::encode(wave, N));
+}
+
+/* Alerts of samples computed sequentially with C windows */
+static std::vector<Alert> expected_alerts(const std::vector<Sample>& input)
+{
+  std::vector<Alert> alerts;
+  std::vector<struct sts_window*> windows;
+  std::vector<std::uint64_t> positions(n_series, 0);
+  for (std::size_t s = 0; s < n_series; ++s) {
+    windows.push_back(sts_new_window(N, W, C));
+  }
+  for (const Sample& sample : input) {
+    std::uint64_t position = ++positions[sample.series];
+    const struct sts_word* current =
+      sts_append_value(windows[sample.series], sample.value);
+    if (position < N) continue;
+    sts::Word<W, C> word;
+    word.assign(*current);
+    for (std::size_t p = 0; p < patterns.size(); ++p) {
+      struct sts_word a = word.view(), b = patterns[p].view();
+      double distance = sts_mindist(&a, &b);
+      if (distance <= threshold) {
+        alerts.push_back(Alert{ sample.series, position, p, distance });
+      }
+    }
+  }
+  for (struct sts_window* window : windows) sts_free_window(window);
+  return alerts;
+}
+
+static char* check_alerts(const std::vector<Alert>& alerts,
+                          const std::vector<Alert>& expected)
+{
+  mu_assert(alerts.size() == expected.size(), "%zu alerts instead of %zu",
+            alerts.size(), expected.size());
+  for (std::size_t i = 0; i < alerts.size(); ++i) {
+    const Alert& a = alerts[i];
+    const Alert& e = expected[i];
+    mu_assert(a.series == e.series && a.position == e.position
+              && a.pattern == e.pattern
+              && std::fabs(a.distance - e.distance) < 1e-12,
+              "alert %zu: series %zu position %llu pattern %zu", i, a.series,
+              static_cast<unsigned long long>(a.position), a.pattern);
+    mu_assert(a.position >= N, "alert %zu of a window not full", i);
+  }
+  return NULL;
+}
+
+static char* run_pipeline(Options options)
+{
+  std::vector<Alert> expected = expected_alerts(samples);
+  mu_assert(!expected.empty(), "no alert expected");
+  ThreadPool pool(3);
+  Pipeline<N, W, C> pipeline(pool, n_series, patterns, threshold, options);
+  ReplaySource source(samples);
+  CollectSink sink;
+  pipeline.run(source, sink);
+  return check_alerts(sink.alerts, expected);
+}
+
+static char* test_replay()
+{
+  return run_pipeline(Options());
+}
+
+static char* test_backpressure()
+{
+  // every batch waits for the previous one to be consumed
+  Options options;
+  options.batch_size = 1;
+  options.queue_capacity = 1;
+  return run_pipeline(options);
+}
+
+static char* test_stream()
+{
+  std::stringstream capture;
+  capture.precision(17);
+  for (const Sample& sample : samples) {
+    capture << sample.series << ' ' << sample.value << '\n';
+  }
+  capture << "1 x\n2 3.0\n"; // replay stops at the first malformed pair
+
+  ThreadPool pool(2);
+  Options options;
+  options.batch_size = 7;
+  Pipeline<N, W, C> pipeline(pool, n_series, patterns, threshold, options);
+  ReplaySource source = ReplaySource::from_stream(capture);
+  CollectSink sink;
+  pipeline.run(source, sink);
+  return check_alerts(sink.alerts, expected_alerts(samples));
+}
+
+static char* test_runs_keep_windows()
+{
+  ThreadPool pool(2);
+  Pipeline<N, W, C> pipeline(pool, n_series, patterns, threshold);
+  std::size_t half = samples.size() / 2;
+  ReplaySource first(std::vector<Sample>(samples.begin(),
+                                         samples.begin() + half));
+  ReplaySource second(std::vector<Sample>(samples.begin() + half,
+                                          samples.end()));
+  CollectSink sink;
+  pipeline.run(first, sink);
+  pipeline.run(second, sink);
+  return check_alerts(sink.alerts, expected_alerts(samples));
+}
+
+static char* all_tests()
+{
+  fill_samples();
+  mu_run_test(test_replay);
+  mu_run_test(test_backpressure);
+  mu_run_test(test_stream);
+  mu_run_test(test_runs_keep_windows);
+  return NULL;
+}
+
+int main()
+{
+  char* result = all_tests();
+  if (result) {
+    printf("%s\n", result);
+  } else {
+    printf("ALL TESTS PASSED\n");
+  }
+  printf("Tests run: %d\n", mu_tests_run);
+  return result != 0;
+}